@@ -0,0 +1,237 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Hale {
+
+BrickIndex::BrickIndex(const float *data, const unsigned int size[3],
+                       unsigned int brickSize)
+  : BrickIndex(data, nrrdTypeFloat, size, brickSize) {
+}
+
+BrickIndex::BrickIndex(const void *data, int type, const unsigned int size[3],
+                       unsigned int brickSize) {
+  static const std::string me="Hale::BrickIndex::BrickIndex";
+  if (!(data && size)) {
+    throw std::runtime_error(me + ": got NULL pointer");
+  }
+  if (!(size[0] >= 2 && size[1] >= 2 && size[2] >= 2)) {
+    throw std::runtime_error(me + ": need at least 2 samples per axis (not "
+                             + std::to_string(size[0]) + ","
+                             + std::to_string(size[1]) + ","
+                             + std::to_string(size[2]) + ")");
+  }
+  if (!brickSize) {
+    throw std::runtime_error(me + ": need non-zero brick size");
+  }
+  if (!_typeInPlace(type)) {
+    throw std::runtime_error(me + ": can't read type "
+                             + airEnumStr(nrrdType, type) + " data");
+  }
+  TraceZone tzone("Hale::BrickIndex::BrickIndex");
+  _data = data;
+  _type = type;
+  _brickSize = brickSize;
+  for (unsigned int ai=0; ai<3; ai++) {
+    _size[ai] = size[ai];
+    _brickNum[ai] = (size[ai] - 2)/brickSize + 1;
+  }
+  unsigned int bnum = _brickNum[0]*_brickNum[1]*_brickNum[2];
+  _min.resize(bnum);
+  _max.resize(bnum);
+  {
+    /* one task per slab of bricks */
+    WorkerPool pool(0, "brickindex");
+    for (unsigned int bz=0; bz<_brickNum[2]; bz++) {
+      pool.add([this, bz]() {
+          unsigned int bnxy = _brickNum[0]*_brickNum[1];
+          for (unsigned int bi=bz*bnxy; bi<(bz+1)*bnxy; bi++) {
+            _rangeFind(bi);
+          }
+        });
+    }
+    pool.wait();
+  }
+  _valMin = *std::min_element(_min.begin(), _min.end());
+  _valMax = *std::max_element(_max.begin(), _max.end());
+
+  /* bricks of constant value can't contain an isosurface */
+  std::vector<unsigned int> live;
+  for (unsigned int bi=0; bi<bnum; bi++) {
+    if (_min[bi] < _max[bi]) {
+      live.push_back(bi);
+    }
+  }
+  _root = _build(live);
+}
+
+unsigned int BrickIndex::brickSize() const { return _brickSize; }
+unsigned int BrickIndex::brickNum() const {
+  return _brickNum[0]*_brickNum[1]*_brickNum[2];
+}
+unsigned int BrickIndex::brickNum(unsigned int axis) const {
+  return _brickNum[axis < 3 ? axis : 2];
+}
+float BrickIndex::min() const { return _valMin; }
+float BrickIndex::max() const { return _valMax; }
+float BrickIndex::min(unsigned int bi) const { return _min[bi]; }
+float BrickIndex::max(unsigned int bi) const { return _max[bi]; }
+
+void BrickIndex::cells(unsigned int bi, unsigned int lo[3],
+                       unsigned int hi[3]) const {
+  unsigned int bb[3] = {bi % _brickNum[0],
+                        (bi/_brickNum[0]) % _brickNum[1],
+                        bi/(_brickNum[0]*_brickNum[1])};
+  for (unsigned int ai=0; ai<3; ai++) {
+    lo[ai] = bb[ai]*_brickSize;
+    /* there are size-1 cells along each axis */
+    hi[ai] = std::min(lo[ai] + _brickSize, _size[ai] - 1);
+  }
+}
+
+/* sets mnmx to the range of data over samples [lo,hi] (inclusive); found
+   in the data's own type, since conversion to float is monotonic. Samples
+   that don't exist (NaN) are skipped; with none left the range is empty
+   (mnmx[0] > mnmx[1]), so the brick is never live */
+template<typename T> static void
+rangeOf(float mnmx[2], const T *data, const unsigned int size[3],
+        const unsigned int lo[3], const unsigned int hi[3]) {
+  const size_t sx = size[0], sxy = sx*size[1];
+  bool some = false;
+  T mn = 0, mx = 0;
+  for (unsigned int zi=lo[2]; zi<=hi[2]; zi++) {
+    for (unsigned int yi=lo[1]; yi<=hi[1]; yi++) {
+      const T *dd = data + lo[0] + sx*yi + sxy*zi;
+      for (unsigned int xi=lo[0]; xi<=hi[0]; xi++, dd++) {
+        if (!AIR_EXISTS(*dd)) {
+          continue;
+        }
+        if (!some) {
+          mn = mx = *dd;
+          some = true;
+        }
+        mn = std::min(mn, *dd);
+        mx = std::max(mx, *dd);
+      }
+    }
+  }
+  if (some) {
+    mnmx[0] = static_cast<float>(mn);
+    mnmx[1] = static_cast<float>(mx);
+  } else {
+    mnmx[0] = std::numeric_limits<float>::max();
+    mnmx[1] = -std::numeric_limits<float>::max();
+  }
+}
+
+/* range of values over the samples of brick bi's cells, which includes
+   the samples shared with the next brick over */
+void BrickIndex::_rangeFind(unsigned int bi) {
+  unsigned int lo[3], hi[3];
+  cells(bi, lo, hi);
+  float mnmx[2];
+  HALE_TYPE_SWITCH(_type, T, rangeOf(mnmx, static_cast<const T*>(_data),
+                                     _size, lo, hi));
+  _min[bi] = mnmx[0];
+  _max[bi] = mnmx[1];
+}
+
+/* builds (recursively) the interval tree node for the given bricks,
+   returning its index in _node, or -1 if there are no bricks. The node's
+   center is the median of the brick range midpoints; the bricks with
+   ranges containing the center stay in this node (sorted both ways), and
+   the rest go into the left (lower) or right (higher) subtrees */
+int BrickIndex::_build(std::vector<unsigned int> &bricks) {
+  if (bricks.empty()) {
+    return -1;
+  }
+  std::vector<float> mid(bricks.size());
+  for (unsigned int ii=0; ii<bricks.size(); ii++) {
+    mid[ii] = (_min[bricks[ii]] + _max[bricks[ii]])/2;
+  }
+  std::nth_element(mid.begin(), mid.begin() + mid.size()/2, mid.end());
+  Node node;
+  node.center = mid[mid.size()/2];
+  std::vector<unsigned int> here, left, right;
+  for (unsigned int bi : bricks) {
+    if (_max[bi] < node.center) {
+      left.push_back(bi);
+    } else if (_min[bi] > node.center) {
+      right.push_back(bi);
+    } else {
+      here.push_back(bi);
+    }
+  }
+  /* no longer needed, and recursion can be deep-ish */
+  std::vector<unsigned int>().swap(bricks);
+  node.start = _byMin.size();
+  node.num = here.size();
+  std::sort(here.begin(), here.end(), [this](unsigned int aa, unsigned int bb) {
+      return _min[aa] < _min[bb];
+    });
+  _byMin.insert(_byMin.end(), here.begin(), here.end());
+  std::sort(here.begin(), here.end(), [this](unsigned int aa, unsigned int bb) {
+      return _max[aa] > _max[bb];
+    });
+  _byMax.insert(_byMax.end(), here.begin(), here.end());
+  int ni = _node.size();
+  _node.push_back(node);
+  int li = _build(left);
+  int ri = _build(right);
+  _node[ni].left = li;
+  _node[ni].right = ri;
+  return ni;
+}
+
+void BrickIndex::query(std::vector<unsigned int> &bricks,
+                       double value) const {
+  int ni = _root;
+  while (ni >= 0) {
+    const Node &node = _node[ni];
+    const unsigned int *bmin = _byMin.data() + node.start;
+    const unsigned int *bmax = _byMax.data() + node.start;
+    if (value < node.center) {
+      /* all of these have max >= center > value */
+      for (unsigned int ii=0; ii<node.num && _min[bmin[ii]] <= value; ii++) {
+        bricks.push_back(bmin[ii]);
+      }
+      ni = node.left;
+    } else if (value > node.center) {
+      /* all of these have min <= center < value */
+      for (unsigned int ii=0; ii<node.num && _max[bmax[ii]] >= value; ii++) {
+        bricks.push_back(bmax[ii]);
+      }
+      ni = node.right;
+    } else {
+      bricks.insert(bricks.end(), bmin, bmin + node.num);
+      break;
+    }
+  }
+}
+
+} // namespace Hale
@@ -161,6 +161,8 @@ void Camera::updateView() {
      _vv = glm::vec3(vp[1], vp[5], vp[9]); (2nd row of _view)
   */
   _vv = glm::cross(_nn, _uu);
+  /* (not changed(): see _sceneChangeCount) */
+  _changeCount++;
 
   return;
 }
@@ -192,10 +194,36 @@ void Camera::updateProject() {
   }
   // printf("!%s: %s projection = \n", me, _orthographic ? "ortho" : "persp");
   // ell_4m_print_f(stdout, glm::value_ptr(glm::transpose(_project)));
+  /* (not changed(): see _sceneChangeCount) */
+  _changeCount++;
 
   return;
 }
 
+/* Projection for the sub-rectangle [u0,u1]x[v0,v1] of the image plane,
+   where (0,0) is the lower-left corner of the whole image and (1,1) the
+   upper-right; this is the same as project() for (0,1,0,1). For tiled
+   rendering, each tile gets this "off-center" frustum, so that the tiles
+   put together are exactly the full image */
+glm::mat4 Camera::project(double u0, double u1, double v0, double v1) {
+  glm::vec3 diff = _at - _from;
+  double dist = glm::length(diff);
+  double vspNear = dist + _clipNear;
+  double vspFar = dist + _clipFar;
+  double fangle = _fov*AIR_PI/360;
+  /* half-height of view window at near plane (perspective) or at look-at
+     point (orthographic) */
+  double vMax = (_orthographic ? dist : vspNear)*tan(fangle);
+  double uMax = _aspect*vMax;
+  float left = AIR_LERP(u0, -uMax, uMax);
+  float right = AIR_LERP(u1, -uMax, uMax);
+  float bottom = AIR_LERP(v0, -vMax, vMax);
+  float top = AIR_LERP(v1, -vMax, vMax);
+  return (_orthographic
+          ? glm::ortho(left, right, bottom, top, (float)vspNear, (float)vspFar)
+          : glm::frustum(left, right, bottom, top, (float)vspNear, (float)vspFar));
+}
+
 #define V2S(vv)                                 \
   (sprintf(buff[0], "%g", vv[0]),               \
    sprintf(buff[1], "%g", vv[1]),               \
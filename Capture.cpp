@@ -0,0 +1,337 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <signal.h>
+
+namespace Hale {
+
+/* RGBA to RGB, in place; the first pixel is already where it should be */
+static void
+rgbPack(unsigned char *data, size_t pixNum) {
+  for (size_t ii=1; ii<pixNum; ii++) {
+    data[0 + 3*ii] = data[0 + 4*ii];
+    data[1 + 3*ii] = data[1 + 4*ii];
+    data[2 + 3*ii] = data[2 + 4*ii];
+  }
+}
+
+/* RGBA to planar YUV 4:2:0 ("I420" or ffmpeg's "yuv420p") with BT.601
+   limited-range coefficients. Chroma is averaged over 2x2 blocks; with odd
+   sizes the chroma planes are rounded up, as ffmpeg expects */
+static void
+yuvConvert(std::vector<unsigned char> &yuv, const Image *img) {
+  int sx = img->width(), sy = img->height();
+  int cx = (sx + 1)/2, cy = (sy + 1)/2;
+  const unsigned char *rgba = img->data();
+  yuv.resize(static_cast<size_t>(sx)*sy + 2*static_cast<size_t>(cx)*cy);
+  unsigned char *yp = &(yuv[0]);
+  unsigned char *up = yp + static_cast<size_t>(sx)*sy;
+  unsigned char *vp = up + static_cast<size_t>(cx)*cy;
+
+  for (int yi=0; yi<sy; yi++) {
+    for (int xi=0; xi<sx; xi++) {
+      const unsigned char *pp = rgba + 4*(xi + static_cast<size_t>(sx)*yi);
+      yp[xi + static_cast<size_t>(sx)*yi] = static_cast<unsigned char>
+        ((66*pp[0] + 129*pp[1] + 25*pp[2] + 128)/256 + 16);
+    }
+  }
+  for (int yi=0; yi<cy; yi++) {
+    for (int xi=0; xi<cx; xi++) {
+      int rr=0, gg=0, bb=0, nn=0;
+      for (int dy=0; dy<2 && 2*yi+dy<sy; dy++) {
+        for (int dx=0; dx<2 && 2*xi+dx<sx; dx++) {
+          const unsigned char *pp =
+            rgba + 4*(2*xi+dx + static_cast<size_t>(sx)*(2*yi+dy));
+          rr += pp[0]; gg += pp[1]; bb += pp[2]; nn++;
+        }
+      }
+      rr /= nn; gg /= nn; bb /= nn;
+      up[xi + static_cast<size_t>(cx)*yi] = static_cast<unsigned char>
+        ((-38*rr - 74*gg + 112*bb + 128)/256 + 128);
+      vp[xi + static_cast<size_t>(cx)*yi] = static_cast<unsigned char>
+        ((112*rr - 94*gg - 18*bb + 128)/256 + 128);
+    }
+  }
+}
+
+/* whether pat is a printf pattern with one conversion, for an unsigned
+   int, so that it can be safely given to snprintf with a frame index */
+static bool
+patternCheck(const char *pat) {
+  unsigned int convNum = 0;
+  for (const char *cc = pat; *cc; cc++) {
+    if ('%' != *cc) {
+      continue;
+    }
+    cc++;
+    if ('%' == *cc) {
+      continue;
+    }
+    cc += strspn(cc, "-+ #0");
+    cc += strspn(cc, "0123456789");
+    if ('.' == *cc) {
+      cc++;
+      cc += strspn(cc, "0123456789");
+    }
+    if (!(*cc && strchr("uoxXdi", *cc))) {
+      return false;
+    }
+    convNum++;
+  }
+  return 1 == convNum;
+}
+
+Capture::Capture(int output, const char *target, int policy,
+                 unsigned int queueMax, unsigned int threadNum) {
+  static const std::string me="Hale::Capture::Capture";
+
+  if (airEnumValCheck(captureOutput, output)) {
+    throw std::runtime_error(me + ": " + std::to_string(output)
+                             + " not a valid captureOutput");
+  }
+  if (airEnumValCheck(capturePolicy, policy)) {
+    throw std::runtime_error(me + ": " + std::to_string(policy)
+                             + " not a valid capturePolicy");
+  }
+  if (!target || !strlen(target)) {
+    throw std::runtime_error(me + ": got empty target");
+  }
+  if (!queueMax) {
+    throw std::runtime_error(me + ": need queueMax > 0");
+  }
+  _output = output;
+  _target = target;
+  _policy = policy;
+  _queueMax = queueMax;
+  _verbose = 0;
+  _pipe = NULL;
+  _width = _height = 0;
+  _frameIdx = 0;
+  _frameNum = _dropNum = 0;
+  _queueNum = 0;
+  _finished = false;
+  _sigpipe = NULL;
+  if (captureOutputFiles == _output) {
+    /* make sure the pattern makes sense, and names a known format */
+    if (!patternCheck(target)) {
+      throw std::runtime_error(me + ": pattern \"" + target + "\" doesn't "
+                               "have exactly one unsigned int conversion "
+                               "(like %05u)");
+    }
+    char buff[AIR_STRLEN_HUGE];
+    snprintf(buff, AIR_STRLEN_HUGE, target, 0u);
+    if (imageFormatUnknown == imageFormatFromName(buff)) {
+      throw std::runtime_error(me + ": couldn't learn image format from "
+                               "\"" + buff + "\" (from pattern \""
+                               + target + "\")");
+    }
+    /* files can be written in any order, so use many threads */
+    _writer = new WorkerPool(threadNum, "capture");
+  } else {
+    _pipe = popen(target, "w");
+    if (!_pipe) {
+      throw std::runtime_error(me + ": couldn't popen \"" + target
+                               + "\": " + strerror(errno));
+    }
+    /* if the other end quits early, we want an error from fwrite, not
+       to be killed by SIGPIPE (the previous handler is restored by
+       ~Capture) */
+    _sigpipe = signal(SIGPIPE, SIG_IGN);
+    /* the stream has to be written in order, so one thread */
+    _writer = new WorkerPool(1, "capture");
+  }
+  _readback = NULL;
+}
+
+Capture::~Capture() {
+  finish();
+  delete _writer;
+  if (captureOutputFiles != _output) {
+    signal(SIGPIPE, _sigpipe);
+  }
+}
+
+int Capture::verbose() { return _verbose; }
+void Capture::verbose(int vv) { _verbose = vv; }
+
+unsigned int
+Capture::frameNum() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _frameNum;
+}
+
+unsigned int
+Capture::dropNum() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _dropNum;
+}
+
+/* Called (via Readback::poll) on the render thread, with a finished
+   frame, which goes to the writer queue, if there's room */
+void
+Capture::_enqueue(Image *img) {
+  static const char me[]="Hale::Capture::_enqueue";
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_queueNum >= _queueMax) {
+      if (capturePolicyDrop == _policy) {
+        unsigned int dropNum = ++_dropNum;
+        lock.unlock();
+        delete img;
+        if (_verbose) {
+          fprintf(stderr, "%s: writers behind; dropped frame (%u so far)\n",
+                  me, dropNum);
+        }
+        return;
+      }
+      /* else capturePolicyBlock: stall rendering until there's room */
+      TraceZone tzone("Hale::Capture::_enqueue(blocked)");
+      while (_queueNum >= _queueMax) {
+        _dequeued.wait(lock);
+      }
+    }
+    _queueNum++;
+  }
+  unsigned int fidx = _frameIdx++;
+  if (captureOutputFiles == _output) {
+    char fname[AIR_STRLEN_HUGE];
+    snprintf(fname, AIR_STRLEN_HUGE, _target.c_str(), fidx);
+    std::string sname(fname);
+    _writer->add([this, img, sname]() {
+        try {
+          img->save(sname.c_str());
+        } catch (...) {
+          delete img;
+          _dequeue(false);
+          throw;
+        }
+        delete img;
+        _dequeue(true);
+      });
+  } else {
+    _writer->add([this, img]() {
+        static const char me[]="Hale::Capture::write";
+        TraceZone tzone(me);
+        bool okay;
+        if (captureOutputRGB == _output) {
+          size_t pixNum = static_cast<size_t>(img->width())*img->height();
+          rgbPack(img->data(), pixNum);
+          okay = (pixNum == fwrite(img->data(), 3, pixNum, _pipe));
+        } else {
+          yuvConvert(_yuv, img);
+          okay = (_yuv.size() == fwrite(&(_yuv[0]), 1, _yuv.size(), _pipe));
+        }
+        delete img;
+        _dequeue(okay);
+        if (!okay) {
+          throw std::runtime_error(std::string(me) + ": error writing to \""
+                                   + _target + "\": " + strerror(errno));
+        }
+      });
+  }
+}
+
+void
+Capture::_dequeue(bool written) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queueNum--;
+    if (written) {
+      _frameNum++;
+    } else {
+      _dropNum++;
+    }
+  }
+  _dequeued.notify_one();
+}
+
+void
+Capture::frame(int width, int height) {
+  static const char me[]="Hale::Capture::frame";
+  TraceZone tzone(me);
+
+  if (_finished) {
+    throw std::runtime_error(std::string(me) + ": already finished");
+  }
+  if (!_readback) {
+    _readback = new Readback(3);
+  }
+  if (!_width) {
+    _width = width;
+    _height = height;
+  } else if (_output != captureOutputFiles
+             && (width != _width || height != _height)) {
+    /* a raw stream can't change size midway */
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_dropNum || _verbose) {
+      fprintf(stderr, "%s: size %dx%d != initial %dx%d; dropping frame\n",
+              me, width, height, _width, _height);
+    }
+    _dropNum++;
+    return;
+  }
+  /* finish whatever reads the GPU has done, so there's a slot free */
+  _readback->poll();
+  ReadbackDone done = [this](Image *img) { _enqueue(img); };
+  if (!_readback->start(0, 0, width, height, done)) {
+    if (capturePolicyDrop == _policy) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _dropNum++;
+      return;
+    }
+    _readback->poll(true);
+    _readback->start(0, 0, width, height, done);
+  }
+}
+
+void
+Capture::finish() {
+  static const char me[]="Hale::Capture::finish";
+
+  if (_finished) {
+    return;
+  }
+  _finished = true;
+  if (_readback) {
+    delete _readback; // waits for (and enqueues) pending reads
+    _readback = NULL;
+  }
+  _writer->wait();
+  if (_pipe) {
+    if (pclose(_pipe)) {
+      fprintf(stderr, "%s: \"%s\" didn't exit cleanly\n", me, _target.c_str());
+    }
+    _pipe = NULL;
+  }
+  unsigned int dropNum = this->dropNum();
+  if (_verbose || dropNum) {
+    printf("%s: %u frames captured to %s, %u dropped\n", me,
+           frameNum(), _target.c_str(), dropNum);
+  }
+}
+
+} // namespace Hale
@@ -0,0 +1,282 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace Hale {
+
+/* the root of xx's set, halving the path there as it goes. Parents only
+   ever decrease (below), and each thread's reads of a parent are of one
+   atomic word, so this is safe while other threads unite() */
+static unsigned int
+ufFind(std::atomic<unsigned int> *parent, unsigned int xx) {
+  while (true) {
+    unsigned int pp = parent[xx].load(std::memory_order_relaxed);
+    if (pp == xx) {
+      return xx;
+    }
+    unsigned int gp = parent[pp].load(std::memory_order_relaxed);
+    if (pp != gp) {
+      parent[xx].compare_exchange_weak(pp, gp, std::memory_order_relaxed);
+    }
+    xx = gp;
+  }
+}
+
+/* joins the sets of aa and bb: the higher-indexed root is linked under
+   the lower one, if it is still a root (else the roots are found again) */
+static void
+ufUnite(std::atomic<unsigned int> *parent, unsigned int aa, unsigned int bb) {
+  while (true) {
+    aa = ufFind(parent, aa);
+    bb = ufFind(parent, bb);
+    if (aa == bb) {
+      return;
+    }
+    if (aa < bb) {
+      std::swap(aa, bb);
+    }
+    unsigned int root = aa;
+    if (parent[aa].compare_exchange_strong(root, bb,
+                                           std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+Components::Components(unsigned int threadNum)
+  : _pool(threadNum, "components") {
+  _vertNumIn = _indxNumIn = 0;
+}
+
+Components::~Components() {
+}
+
+void Components::find(const limnPolyData *lpld) {
+  static const std::string me="Hale::Components::find";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL pointer");
+  }
+  for (unsigned int pi=0; pi<lpld->primNum; pi++) {
+    if (limnPrimitiveTriangles != lpld->type[pi]) {
+      throw std::runtime_error(me + ": primitive " + std::to_string(pi)
+                               + " isn't triangles (but "
+                               + airEnumStr(limnPrimitive, lpld->type[pi])
+                               + ")");
+    }
+  }
+  TraceZone tzone("Hale::Components::find");
+  const unsigned int vnum = lpld->xyzwNum, tnum = lpld->indxNum/3;
+  const unsigned int *indx = lpld->indx;
+  if (_parent.size() < vnum) {
+    _parent = std::vector<std::atomic<unsigned int> >(vnum);
+  }
+  std::atomic<unsigned int> *parent = _parent.data();
+  _pool.parallel(vnum, [parent](unsigned int start, unsigned int stop) {
+      for (unsigned int vi=start; vi<stop; vi++) {
+        parent[vi].store(vi, std::memory_order_relaxed);
+      }
+    });
+  /* the triangles, divided among the threads, each unite their vertices;
+     and their areas are found along the way */
+  _triArea.resize(tnum);
+  const float *xyzw = lpld->xyzw;
+  double *triArea = _triArea.data();
+  _pool.parallel(tnum, [=](unsigned int start, unsigned int stop) {
+      for (unsigned int ti=start; ti<stop; ti++) {
+        const unsigned int *tv = indx + 3*ti;
+        ufUnite(parent, tv[0], tv[1]);
+        ufUnite(parent, tv[0], tv[2]);
+        const float *p0 = xyzw + 4*tv[0], *p1 = xyzw + 4*tv[1],
+          *p2 = xyzw + 4*tv[2];
+        const double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        const double cr[3] = {e1[1]*e2[2] - e1[2]*e2[1],
+                              e1[2]*e2[0] - e1[0]*e2[2],
+                              e1[0]*e2[1] - e1[1]*e2[0]};
+        triArea[ti] = sqrt(cr[0]*cr[0] + cr[1]*cr[1] + cr[2]*cr[2])/2;
+      }
+    });
+  /* every vertex's root, which (since roots are the lowest index in their
+     set) is its set's first vertex */
+  _label.resize(vnum);
+  unsigned int *label = _label.data();
+  _pool.parallel(vnum, [parent, label](unsigned int start, unsigned int stop) {
+      for (unsigned int vi=start; vi<stop; vi++) {
+        label[vi] = ufFind(parent, vi);
+      }
+    });
+  /* per-root sums, and then components numbered by first vertex, skipping
+     vertices in no triangle */
+  std::vector<unsigned int> rootTri(vnum, 0);
+  std::vector<double> rootArea(vnum, 0);
+  for (unsigned int ti=0; ti<tnum; ti++) {
+    const unsigned int root = label[indx[3*ti]];
+    rootTri[root]++;
+    rootArea[root] += triArea[ti];
+  }
+  std::vector<unsigned int> comp(vnum), cvert;
+  unsigned int cnum = 0;
+  for (unsigned int vi=0; vi<vnum; vi++) {
+    if (label[vi] == vi) {
+      comp[vi] = rootTri[vi] ? cnum++ : UINT_MAX;
+      if (rootTri[vi]) {
+        cvert.push_back(0);
+      }
+    }
+    unsigned int ci = comp[label[vi]];
+    if (UINT_MAX != ci) {
+      cvert[ci]++;
+    }
+  }
+  /* biggest first, with ties in order of first vertex */
+  std::vector<unsigned int> order(cnum), rank(cnum);
+  for (unsigned int ci=0; ci<cnum; ci++) {
+    order[ci] = ci;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&cvert](unsigned int aa, unsigned int bb) {
+                     return cvert[aa] > cvert[bb];
+                   });
+  for (unsigned int ci=0; ci<cnum; ci++) {
+    rank[order[ci]] = ci;
+  }
+  _vertNum.assign(cnum, 0);
+  _triNum.assign(cnum, 0);
+  _area.assign(cnum, 0);
+  for (unsigned int vi=0; vi<vnum; vi++) {
+    if (label[vi] == vi && UINT_MAX != comp[vi]) {
+      const unsigned int ci = rank[comp[vi]];
+      _vertNum[ci] = cvert[comp[vi]];
+      _triNum[ci] = rootTri[vi];
+      _area[ci] = rootArea[vi];
+    }
+  }
+  _pool.parallel(vnum, [&](unsigned int start, unsigned int stop) {
+      for (unsigned int vi=start; vi<stop; vi++) {
+        const unsigned int ci = comp[label[vi]];
+        label[vi] = UINT_MAX == ci ? cnum : rank[ci];
+      }
+    });
+  _vertNumIn = vnum;
+  _indxNumIn = lpld->indxNum;
+}
+
+unsigned int Components::num() const { return _vertNum.size(); }
+unsigned int Components::vertNum(unsigned int ci) const {
+  return _vertNum[ci];
+}
+unsigned int Components::triNum(unsigned int ci) const { return _triNum[ci]; }
+double Components::area(unsigned int ci) const { return _area[ci]; }
+const std::vector<unsigned int> &Components::label() const { return _label; }
+
+unsigned int Components::cull(limnPolyData *lpld, unsigned int vertMin,
+                              double areaMin, unsigned int keepNum) {
+  static const std::string me="Hale::Components::cull";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL pointer");
+  }
+  if (lpld->xyzwNum != _vertNumIn || lpld->indxNum != _indxNumIn) {
+    throw std::runtime_error(me + ": mesh (" + std::to_string(lpld->xyzwNum)
+                             + " verts, " + std::to_string(lpld->indxNum)
+                             + " indices) isn't the one last find()ed ("
+                             + std::to_string(_vertNumIn) + ", "
+                             + std::to_string(_indxNumIn) + ")");
+  }
+  TraceZone tzone("Hale::Components::cull");
+  const unsigned int cnum = num(), vnum = lpld->xyzwNum;
+  /* new number of each kept component (still biggest first), or UINT_MAX;
+     vertices in no triangle (of component cnum) go too */
+  std::vector<unsigned int> cmap(cnum + 1, UINT_MAX);
+  unsigned int kept = 0;
+  for (unsigned int ci=0; ci<cnum; ci++) {
+    if (_vertNum[ci] >= vertMin && _area[ci] >= areaMin
+        && (!keepNum || kept < keepNum)) {
+      _vertNum[kept] = _vertNum[ci];
+      _triNum[kept] = _triNum[ci];
+      _area[kept] = _area[ci];
+      cmap[ci] = kept++;
+    }
+  }
+  cmap[cnum] = kept;
+  /* new index of each kept vertex; vertices only move down, so the
+     per-vertex arrays are compacted in place */
+  std::vector<unsigned int> vmap(vnum, UINT_MAX);
+  unsigned int vout = 0;
+  for (unsigned int vi=0; vi<vnum; vi++) {
+    if (cmap[_label[vi]] < kept) {
+      vmap[vi] = vout;
+      _label[vout] = cmap[_label[vi]];
+      if (vout != vi) {
+        memcpy(lpld->xyzw + 4*vout, lpld->xyzw + 4*vi, 4*sizeof(float));
+        if (lpld->normNum == vnum) {
+          memcpy(lpld->norm + 3*vout, lpld->norm + 3*vi, 3*sizeof(float));
+        }
+        if (lpld->rgbaNum == vnum) {
+          memcpy(lpld->rgba + 4*vout, lpld->rgba + 4*vi, 4);
+        }
+        if (lpld->tex2Num == vnum) {
+          memcpy(lpld->tex2 + 2*vout, lpld->tex2 + 2*vi, 2*sizeof(float));
+        }
+        if (lpld->tangNum == vnum) {
+          memcpy(lpld->tang + 3*vout, lpld->tang + 3*vi, 3*sizeof(float));
+        }
+      }
+      vout++;
+    }
+  }
+  /* likewise the triangles, per primitive */
+  unsigned int *indx = lpld->indx;
+  unsigned int iin = 0, iout = 0;
+  for (unsigned int pi=0; pi<lpld->primNum; pi++) {
+    const unsigned int istop = iin + lpld->icnt[pi], istart = iout;
+    for (; iin < istop; iin += 3) {
+      if (UINT_MAX != vmap[indx[iin]]) {
+        indx[iout++] = vmap[indx[iin + 0]];
+        indx[iout++] = vmap[indx[iin + 1]];
+        indx[iout++] = vmap[indx[iin + 2]];
+      }
+    }
+    lpld->icnt[pi] = iout - istart;
+  }
+  lpld->normNum = (lpld->normNum == vnum ? vout : lpld->normNum);
+  lpld->rgbaNum = (lpld->rgbaNum == vnum ? vout : lpld->rgbaNum);
+  lpld->tex2Num = (lpld->tex2Num == vnum ? vout : lpld->tex2Num);
+  lpld->tangNum = (lpld->tangNum == vnum ? vout : lpld->tangNum);
+  lpld->xyzwNum = vout;
+  lpld->indxNum = iout;
+  /* so that we now describe what's left */
+  _vertNum.resize(kept);
+  _triNum.resize(kept);
+  _area.resize(kept);
+  _label.resize(vout);
+  _vertNumIn = vout;
+  _indxNumIn = iout;
+  return cnum - kept;
+}
+
+} // namespace Hale
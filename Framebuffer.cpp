@@ -0,0 +1,192 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+/* learn the format and type to pass to glTexImage2D for a given
+   internal format; these don't matter for the NULL data we pass, but
+   they do have to be compatible */
+static void
+texFormatType(GLenum *format, GLenum *type, GLenum internalFormat) {
+  static const std::string me="Hale::texFormatType";
+  switch (internalFormat) {
+  case GL_RGBA8:
+    *format = GL_RGBA; *type = GL_UNSIGNED_BYTE;
+    break;
+  case GL_RGBA32F:
+    *format = GL_RGBA; *type = GL_FLOAT;
+    break;
+  case GL_RG32F:
+    *format = GL_RG; *type = GL_FLOAT;
+    break;
+  case GL_R32F:
+    *format = GL_RED; *type = GL_FLOAT;
+    break;
+  case GL_DEPTH_COMPONENT24:
+    *format = GL_DEPTH_COMPONENT; *type = GL_UNSIGNED_INT;
+    break;
+  case GL_DEPTH_COMPONENT32F:
+    *format = GL_DEPTH_COMPONENT; *type = GL_FLOAT;
+    break;
+  case GL_DEPTH24_STENCIL8:
+    *format = GL_DEPTH_STENCIL; *type = GL_UNSIGNED_INT_24_8;
+    break;
+  default:
+    throw std::runtime_error(me + ": internal format "
+                             + std::to_string(internalFormat)
+                             + " not handled");
+  }
+}
+
+static GLuint
+texNew(GLenum internalFormat, int width, int height) {
+  GLenum format, type;
+  GLuint tex;
+
+  texFormatType(&format, &type, internalFormat);
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+               format, type, NULL);
+  /* nearest, since these are mostly read back or blitted; whoever wants
+     filtered sampling can change it */
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (debugging)
+    printf("# glTexImage2D(GL_TEXTURE_2D, 0, %u, %d, %d, 0, %u, %u, NULL) -> %u\n",
+           internalFormat, width, height, format, type, tex);
+  return tex;
+}
+
+void
+Framebuffer::_alloc() {
+  static const std::string me="Hale::Framebuffer::_alloc";
+
+  glGenFramebuffers(1, &_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  if (debugging)
+    printf("# glGenFramebuffers(1, &); glBindFramebuffer(GL_FRAMEBUFFER, %u)\n", _fbo);
+  std::vector<GLenum> drawBuff;
+  for (unsigned int ci=0; ci<_colorFormat.size(); ci++) {
+    _colorTex.push_back(texNew(_colorFormat[ci], _width, _height));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + ci,
+                           GL_TEXTURE_2D, _colorTex[ci], 0);
+    drawBuff.push_back(GL_COLOR_ATTACHMENT0 + ci);
+  }
+  if (_depthFormat) {
+    _depthTex = texNew(_depthFormat, _width, _height);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           (GL_DEPTH24_STENCIL8 == _depthFormat
+                            ? GL_DEPTH_STENCIL_ATTACHMENT
+                            : GL_DEPTH_ATTACHMENT),
+                           GL_TEXTURE_2D, _depthTex, 0);
+  } else {
+    _depthTex = 0;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (drawBuff.size()) {
+    glDrawBuffers(static_cast<GLsizei>(drawBuff.size()), &(drawBuff[0]));
+  } else {
+    glDrawBuffer(GL_NONE);
+  }
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glErrorCheck(me, "creating " + std::to_string(_width) + "x"
+               + std::to_string(_height) + " framebuffer");
+  if (GL_FRAMEBUFFER_COMPLETE != status) {
+    throw std::runtime_error(me + ": framebuffer incomplete (status "
+                             + std::to_string(status) + ")");
+  }
+}
+
+void
+Framebuffer::_free() {
+  if (_colorTex.size()) {
+    glDeleteTextures(static_cast<GLsizei>(_colorTex.size()), &(_colorTex[0]));
+    _colorTex.clear();
+  }
+  glDeleteTextures(1, &_depthTex);
+  glDeleteFramebuffers(1, &_fbo);
+  _depthTex = _fbo = 0;
+}
+
+Framebuffer::Framebuffer(int width, int height,
+                         const std::vector<GLenum> &colorFormat,
+                         GLenum depthFormat) {
+  static const std::string me="Hale::Framebuffer::Framebuffer";
+
+  if (!(width > 0 && height > 0)) {
+    throw std::runtime_error(me + ": got non-positive size "
+                             + std::to_string(width) + "x"
+                             + std::to_string(height));
+  }
+  _width = width;
+  _height = height;
+  _colorFormat = colorFormat;
+  _depthFormat = depthFormat;
+  _fbo = _depthTex = 0;
+  _alloc();
+}
+
+Framebuffer::~Framebuffer() {
+  _free();
+}
+
+void
+Framebuffer::resize(int width, int height) {
+  if (width == _width && height == _height) {
+    return;
+  }
+  _free();
+  _width = width;
+  _height = height;
+  _alloc();
+}
+
+int Framebuffer::width() const { return _width; }
+int Framebuffer::height() const { return _height; }
+GLuint Framebuffer::fboId() const { return _fbo; }
+GLuint Framebuffer::colorTex(unsigned int idx) const { return _colorTex.at(idx); }
+GLuint Framebuffer::depthTex() const { return _depthTex; }
+
+void
+Framebuffer::bind() const {
+  glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+  glViewport(0, 0, _width, _height);
+  if (debugging)
+    printf("# glBindFramebuffer(GL_FRAMEBUFFER, %u); glViewport(0, 0, %d, %d)\n",
+           _fbo, _width, _height);
+}
+
+void
+Framebuffer::unbind() {
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (debugging)
+    printf("# glBindFramebuffer(GL_FRAMEBUFFER, 0)\n");
+}
+
+} // namespace Hale
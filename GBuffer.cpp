@@ -0,0 +1,199 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+static std::vector<GLenum>
+gbColorFormat() {
+  std::vector<GLenum> ret;
+  ret.push_back(GL_RGBA32F); // world-space position, and coverage
+  ret.push_back(GL_R32F);    // scalar value
+  return ret;
+}
+
+GBuffer::GBuffer(int width, int height) {
+  _fbuff = new Framebuffer(width, height, gbColorFormat(),
+                           GL_DEPTH_COMPONENT32F);
+  /* enough for two frames in flight */
+  _readback = new Readback(6);
+}
+
+GBuffer::~GBuffer() {
+  delete _readback;
+  delete _fbuff;
+}
+
+int GBuffer::width() const { return _fbuff->width(); }
+int GBuffer::height() const { return _fbuff->height(); }
+void GBuffer::resize(int width, int height) { _fbuff->resize(width, height); }
+const Framebuffer *GBuffer::framebuffer() const { return _fbuff; }
+
+void
+GBuffer::draw(Scene *scene, Camera &camera, glm::mat4 project) {
+  static const char me[]="Hale::GBuffer::draw";
+  TraceZone tzone(me);
+  const float nan1 = AIR_NAN, one = 1.0f;
+  const float nan4[4] = {nan1, nan1, nan1, 0.0f};
+
+  _fbuff->bind();
+  /* the background has no position or value */
+  glClearBufferfv(GL_COLOR, 0, nan4);
+  glClearBufferfv(GL_COLOR, 1, &nan1);
+  glClearBufferfv(GL_DEPTH, 0, &one);
+  glEnable(GL_DEPTH_TEST);
+  uniform("projectMat", project, true);
+  uniform("viewMat", camera.view(), true);
+  scene->drawPolydata(ProgramLib(preprogramGBuffer));
+  glErrorCheck(me, "drawing");
+}
+
+void
+GBuffer::draw(Scene *scene, Camera &camera) {
+  draw(scene, camera, camera.project());
+}
+
+/* for copying from a mapped PBO into a float nrrd, flipping rows */
+static void
+rowsFlip(Nrrd *nout, const void *data, size_t rowSize, int height) {
+  const char *src = static_cast<const char *>(data);
+  char *dst = static_cast<char *>(nout->data);
+  for (int yi=0; yi<height; yi++) {
+    memcpy(dst + rowSize*yi, src + rowSize*(height - 1 - yi), rowSize);
+  }
+}
+
+bool
+GBuffer::read(GBufferDone done) {
+  static const std::string me="Hale::GBuffer::read";
+  TraceZone tzone("Hale::GBuffer::read");
+  int sx = width(), sy = height();
+
+  if (_readback->slotNum() - _readback->pending() < 3) {
+    return false;
+  }
+  Nrrd *ndepth = nrrdNew();
+  Nrrd *nxyz = nrrdNew();
+  Nrrd *nval = nrrdNew();
+  if (nrrdMaybeAlloc_va(ndepth, nrrdTypeFloat, 2, (size_t)sx, (size_t)sy)
+      || nrrdMaybeAlloc_va(nxyz, nrrdTypeFloat, 3, (size_t)3,
+                           (size_t)sx, (size_t)sy)
+      || nrrdMaybeAlloc_va(nval, nrrdTypeFloat, 2, (size_t)sx, (size_t)sy)) {
+    char *err = biffGetDone(NRRD);
+    std::string serr(err);
+    free(err);
+    nrrdNuke(ndepth);
+    nrrdNuke(nxyz);
+    nrrdNuke(nval);
+    throw std::runtime_error(me + ": couldn't allocate output:\n" + serr);
+  }
+  ndepth->axis[0].kind = ndepth->axis[1].kind = nrrdKindSpace;
+  nxyz->axis[0].kind = nrrdKind3Vector;
+  nxyz->axis[1].kind = nxyz->axis[2].kind = nrrdKindSpace;
+  nval->axis[0].kind = nval->axis[1].kind = nrrdKindSpace;
+
+  size_t rowSize = sizeof(float)*sx;
+  _fbuff->bind();
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  _readback->start(0, 0, sx, sy, GL_RGB, GL_FLOAT,
+                   [nxyz, rowSize, sy](const void *data) {
+                     rowsFlip(nxyz, data, 3*rowSize, sy);
+                   });
+  glReadBuffer(GL_COLOR_ATTACHMENT1);
+  _readback->start(0, 0, sx, sy, GL_RED, GL_FLOAT,
+                   [nval, rowSize, sy](const void *data) {
+                     rowsFlip(nval, data, rowSize, sy);
+                   });
+  /* reads finish in order, so when this one is done, they all are */
+  _readback->start(0, 0, sx, sy, GL_DEPTH_COMPONENT, GL_FLOAT,
+                   [ndepth, nxyz, nval, rowSize, sy, done](const void *data) {
+                     rowsFlip(ndepth, data, rowSize, sy);
+                     done(ndepth, nxyz, nval);
+                   });
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  return true;
+}
+
+unsigned int
+GBuffer::poll(bool wait) {
+  return _readback->poll(wait)/3;
+}
+
+/* the difference from pp to whichever of its neighbors pa and pb (either
+   may be NULL) is nearer in world space; false if neither is covered */
+static bool
+nearDiff(glm::vec3 &diff, const float *pp, const float *pa,
+         const float *pb) {
+  bool got = false;
+  double len = AIR_POS_INF;
+  const float *nn[2] = {pa, pb};
+  for (unsigned int ni=0; ni<2; ni++) {
+    if (!(nn[ni] && AIR_EXISTS(nn[ni][0]))) {
+      continue;
+    }
+    glm::vec3 dd(nn[ni][0] - pp[0], nn[ni][1] - pp[1], nn[ni][2] - pp[2]);
+    if (glm::length(dd) < len) {
+      len = glm::length(dd);
+      diff = dd;
+      got = true;
+    }
+  }
+  return got;
+}
+
+double
+gbufferArea(const Nrrd *nxyz) {
+  static const std::string me="Hale::gbufferArea";
+  if (!( nxyz && nrrdTypeFloat == nxyz->type && 3 == nxyz->dim
+         && 3 == nxyz->axis[0].size )) {
+    throw std::runtime_error(me + ": need a 3 x sx x sy float nrrd");
+  }
+  size_t sx = nxyz->axis[1].size, sy = nxyz->axis[2].size;
+  const float *xyz = static_cast<const float *>(nxyz->data);
+  double area = 0;
+  /* the parallelogram spanned by the two differences is the surface
+     patch seen through the pixel; across a silhouette or occlusion
+     boundary the depth jumps on one side only, so the nearer neighbor
+     is on the same surface */
+  for (size_t yi=0; yi<sy; yi++) {
+    for (size_t xi=0; xi<sx; xi++) {
+      const float *pp = xyz + 3*(xi + sx*yi);
+      if (!AIR_EXISTS(pp[0])) {
+        continue;
+      }
+      glm::vec3 dx, dy;
+      if (!(nearDiff(dx, pp, xi ? pp - 3 : NULL,
+                     xi+1 < sx ? pp + 3 : NULL)
+            && nearDiff(dy, pp, yi ? pp - 3*sx : NULL,
+                        yi+1 < sy ? pp + 3*sx : NULL))) {
+        continue;
+      }
+      area += glm::length(glm::cross(dx, dy));
+    }
+  }
+  return area;
+}
+
+} // namespace Hale
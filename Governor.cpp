@@ -0,0 +1,178 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+/* frame times are "slow" above SLOW_FRAC*target, "fast" below
+   FAST_FRAC*target, and in between is the dead band */
+#define SLOW_FRAC 1.1
+#define FAST_FRAC 0.8
+/* weight of latest frame in smoothed frame time */
+#define SMOOTH 0.25
+/* consecutive slow frames for lowering a knob */
+#define LOWER_WAIT 3
+/* initial and maximum consecutive fast frames for raising a knob */
+#define RAISE_WAIT 30
+#define RAISE_WAIT_MAX 480
+
+namespace Hale {
+
+Governor::Governor(double target) {
+  _verbose = 0;
+  frameTarget(target);
+  _frameTime = AIR_NAN;
+  _overNum = _underNum = 0;
+  _raiseWait = RAISE_WAIT;
+  _sinceRaise = 0;
+  _raised = false;
+}
+
+int Governor::verbose() { return _verbose; }
+void Governor::verbose(int vv) { _verbose = vv; }
+
+void Governor::frameTarget(double sec) {
+  static const std::string me="Hale::Governor::frameTarget";
+  if (!(sec > 0)) {
+    throw std::runtime_error(me + ": need positive time (not "
+                             + std::to_string(sec) + ")");
+  }
+  _frameTarget = sec;
+}
+double Governor::frameTarget() const { return _frameTarget; }
+double Governor::frameTime() const { return _frameTime; }
+
+void Governor::knob(const std::string &name, int levelNum, int level,
+                    GovernorSet set) {
+  static const std::string me="Hale::Governor::knob";
+  if (!(levelNum > 0 && 0 <= level && level < levelNum)) {
+    throw std::runtime_error(me + ": need 0 <= level (" + std::to_string(level)
+                             + ") < levelNum (" + std::to_string(levelNum)
+                             + ")");
+  }
+  if (!set) {
+    throw std::runtime_error(me + ": got NULL set callback");
+  }
+  for (unsigned int ki=0; ki<_knob.size(); ki++) {
+    if (name == _knob[ki].name) {
+      throw std::runtime_error(me + ": already have knob \"" + name + "\"");
+    }
+  }
+  Knob knb = {name, levelNum, level, set};
+  _knob.push_back(knb);
+  set(level);
+}
+
+int Governor::level(const std::string &name) const {
+  static const std::string me="Hale::Governor::level";
+  for (unsigned int ki=0; ki<_knob.size(); ki++) {
+    if (name == _knob[ki].name) {
+      return _knob[ki].level;
+    }
+  }
+  throw std::runtime_error(me + ": no knob \"" + name + "\"");
+}
+
+/* lowers the first knob (in order added) that can go lower; returns false
+   if there was none */
+bool Governor::_lower() {
+  static const char me[]="Hale::Governor::_lower";
+  for (unsigned int ki=0; ki<_knob.size(); ki++) {
+    Knob &knb = _knob[ki];
+    if (knb.level > 0) {
+      knb.level--;
+      if (_verbose) {
+        printf("%s: (%g > %g) %s --> %d\n", me, _frameTime, _frameTarget,
+               knb.name.c_str(), knb.level);
+      }
+      knb.set(knb.level);
+      _lowered.push_back(ki);
+      /* if the last raise was a mistake, wait longer to try again */
+      if (_raised && _sinceRaise < 2*_raiseWait) {
+        _raiseWait = AIR_MIN(2*_raiseWait, RAISE_WAIT_MAX);
+      }
+      _raised = false;
+      return true;
+    }
+  }
+  /* else everything is already as cheap as it gets */
+  return false;
+}
+
+/* raises the knob most recently lowered */
+void Governor::_raise() {
+  static const char me[]="Hale::Governor::_raise";
+  if (_lowered.empty()) {
+    return;
+  }
+  Knob &knb = _knob[_lowered.back()];
+  _lowered.pop_back();
+  knb.level++;
+  if (_verbose) {
+    printf("%s: (%g < %g) %s --> %d\n", me, _frameTime, _frameTarget,
+           knb.name.c_str(), knb.level);
+  }
+  knb.set(knb.level);
+  _sinceRaise = 0;
+  _raised = true;
+}
+
+bool Governor::frame(double sec, double floor) {
+  double target = AIR_MAX(_frameTarget, floor);
+  _frameTime = (AIR_EXISTS(_frameTime)
+                ? _frameTime + SMOOTH*(sec - _frameTime)
+                : sec);
+  _sinceRaise++;
+  if (_raised && _sinceRaise > 2*_raiseWait) {
+    /* the last raise held up; go back to raising more readily */
+    _raiseWait = RAISE_WAIT;
+  }
+  if (_frameTime > SLOW_FRAC*target) {
+    _overNum++;
+    _underNum = 0;
+  } else if (_frameTime < FAST_FRAC*target
+             /* with vsync, frames can't get any faster than floor */
+             || (floor > 0 && _frameTime < SLOW_FRAC*floor
+                 && floor >= _frameTarget)) {
+    _underNum++;
+    _overNum = 0;
+  } else {
+    _overNum = _underNum = 0;
+  }
+  bool ret = false;
+  if (_overNum >= LOWER_WAIT) {
+    ret = _lower();
+    _overNum = 0;
+  } else if (_underNum >= _raiseWait && !_lowered.empty()) {
+    _raise();
+    ret = true;
+  }
+  if (ret) {
+    /* start over measuring, with the new setting */
+    _frameTime = AIR_NAN;
+    _overNum = _underNum = 0;
+  }
+  return ret;
+}
+
+} // namespace Hale
@@ -28,6 +28,14 @@
 #include <stdexcept>
 #include <map>
 #include <list>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 /* This will include all the Teem headers at once */
 #include <teem/meet.h>
@@ -125,9 +133,11 @@ enum {
   vertAttrIdxNorm,         /*  2: 3-vector normal */
   vertAttrIdxTex2,         /*  3: (s,t) texture coords */
   vertAttrIdxTang,         /*  4: unit-length surface tangent 3-vectors */
-  vertAttrIdxLast          /*  5 */
+  vertAttrIdxValue,        /*  5: scalar value (not from limnPolyData; see
+                               Polydata::scalar()) */
+  vertAttrIdxLast          /*  6 */
 };
-#define HALE_VERT_ATTR_IDX_NUM 5
+#define HALE_VERT_ATTR_IDX_NUM 6
 
 enum {
   finishingStatusUnknown,   /* 0 */
@@ -138,6 +148,48 @@ enum {
 };
 extern airEnum *finishingStatus;
 
+/*
+** imageFormat* enum
+**
+** Formats in which Image can save itself; the airEnum strings double as
+** the filename extensions.  These are chosen for being fast to write.
+*/
+enum {
+  imageFormatUnknown,   /* 0 */
+  imageFormatNrrd,      /* 1: NRRD with raw encoding */
+  imageFormatPPM,       /* 2: binary PPM (dropping alpha) */
+  imageFormatPNG,       /* 3: PNG, but with fast (low) zlib compression */
+  imageFormatLast
+};
+extern airEnum *imageFormat;
+
+/*
+** captureOutput* enum
+**
+** Where Capture sends frames
+*/
+enum {
+  captureOutputUnknown,   /* 0 */
+  captureOutputFiles,     /* 1: numbered image files */
+  captureOutputRGB,       /* 2: raw 8-bit RGB stream, to a pipe */
+  captureOutputYUV,       /* 3: raw 8-bit YUV 4:2:0 planar stream, to a pipe */
+  captureOutputLast
+};
+extern airEnum *captureOutput;
+
+/*
+** capturePolicy* enum
+**
+** What Capture does when frames arrive faster than they can be written
+*/
+enum {
+  capturePolicyUnknown,   /* 0 */
+  capturePolicyBlock,     /* 1: stall rendering until there's room */
+  capturePolicyDrop,      /* 2: drop the frame (and count it) */
+  capturePolicyLast
+};
+extern airEnum *capturePolicy;
+
 /*
 ** GLSL programs that are "pre-programmed"; the source for them is internal
 ** to Hale
@@ -148,18 +200,37 @@ typedef enum {
   preprogramAmbDiffSolid,       /* 2 */
   preprogramAmbDiff2Side,       /* 3 */
   preprogramAmbDiff2SideSolid,  /* 4 */
+  preprogramGBuffer,            /* 5: world-space position and per-vertex
+                                   scalar, to two float render targets */
+  preprogramReproject,          /* 6: previous frame's pixels, as points
+                                   moved to where the new camera sees them;
+                                   no vertex attributes */
   preprogramLast
 } preprogram;
 
 /* globals.cpp */
-extern bool finishing;
+extern std::atomic<bool> finishing;
 extern int debugging;
 
-/* utils.cpp */
-extern void init();
+/* utils.cpp: init() with windowing=false does not initialize GLFW, which
+   will fail without a window system; this is only useful with Offscreen.
+   programsDone() deletes the ProgramLib programs, which needs the GL
+   context they were made in; done() calls it (if not already called),
+   and then terminates GLFW. So to finish: with the Viewer's or
+   Offscreen's context current, delete the Polydatas and call
+   programsDone(), then delete the Viewer or Offscreen, then call done() */
+extern void init(bool windowing=true);
+extern void programsDone();
 extern void done();
 extern GLuint limnToGLPrim(int type);
 extern void glErrorCheck(std::string whence, std::string context);
+/* changed() notes that something visible (camera, scene, Polydata, or
+   sticky uniform) has changed, so that Viewer::run() knows to redraw; it
+   is called by all the Hale methods that make such changes, so it only
+   needs to be called directly for changes Hale doesn't know about.
+   changeCount() is the number of changes so far */
+extern void changed(void);
+extern unsigned int changeCount(void);
 typedef struct {
   /* copy of the same enum value used for indexing into glEnumDesc */
   GLenum enumVal;
@@ -171,6 +242,276 @@ typedef struct {
 /* gadget to map GLenum values to something readable */
 extern std::map<GLenum,glEnumItem> glEnumDesc;
 
+/* Trace.cpp: timing "zones" for seeing where frames (and any background
+   work) spend their time. A TraceZone records the interval from its
+   construction to its destruction, if tracing was enabled when it was
+   constructed; otherwise it costs one atomic load. Events are buffered in
+   memory per-thread, and traceSave() writes them in the Chrome trace-event
+   JSON format, for chrome://tracing or https://ui.perfetto.dev. If the
+   environment variable HALE_TRACE is set to a filename, init() enables
+   tracing and done() saves to that file. */
+extern void traceEnable(bool on);
+extern bool traceEnabled();
+extern void traceFile(const char *fname); // file for done() to save to
+extern std::string traceFile();
+extern void traceThreadName(const char *name); // label for calling thread
+extern void traceSave(const char *fname);
+extern void traceClear();
+class TraceZone {
+ public:
+  /* name is not copied, so it should be a literal or a static "me[]".
+     The detail (which may be NULL) is copied only if tracing is on, so
+     that nothing is allocated when it's off; a detail that has to be put
+     together should be built only if traceEnabled() */
+  explicit TraceZone(const char *name);
+  explicit TraceZone(const char *name, const char *detail);
+  explicit TraceZone(const char *name, double value);
+  ~TraceZone();
+ protected:
+  const char *_name;   // NULL if tracing was off at construction
+  std::string _detail;
+  double _start;
+};
+
+/* WorkerPool.cpp: a fixed set of threads that run queued tasks, for
+   getting slow things (like image encoding) off the rendering thread.
+   Tasks must not use GL. A task that throws has its error printed to
+   stderr.  The destructor finishes all queued tasks before returning. */
+class WorkerPool {
+ public:
+  /* threadNum 0 means one less than the number of cores (but at least 1);
+     name is used to name the threads for tracing */
+  explicit WorkerPool(unsigned int threadNum=0, const char *name="worker");
+  ~WorkerPool();
+  unsigned int threadNum() const;
+  void add(std::function<void()> task);
+  /* number of tasks queued or running */
+  size_t pending();
+  /* block until there are no tasks queued or running */
+  void wait();
+  /* calls task(start, stop) on the pool for a few consecutive ranges per
+     thread, covering [0,num), and waits for them; unlike wait(), this
+     doesn't wait for tasks added by others */
+  void parallel(unsigned int num,
+                std::function<void(unsigned int, unsigned int)> task);
+ protected:
+  std::string _name;
+  std::vector<std::thread> _thread;
+  std::deque<std::function<void()> > _queue;
+  std::mutex _mutex;
+  std::condition_variable _wake, _idle;
+  size_t _running;
+  bool _quit;
+  void _work(unsigned int idx);
+};
+
+/* TripleBuffer (all here, being a template): lock-free handoff of the
+   latest value of something from one producer thread to one consumer
+   thread. The producer fills writeSlot() and calls publish(); the consumer
+   calls fetch(), which returns true if something new was published since
+   the last fetch(), and then reads readSlot(). Neither ever waits for the
+   other: values published faster than they are fetched are dropped, and
+   only the latest one is seen. There are three T's, one each owned by
+   producer and consumer, and one in the middle that they swap with */
+template<typename T> class TripleBuffer {
+ public:
+  TripleBuffer() : _middle(1), _write(0), _read(2) {}
+  T &writeSlot() { return _slot[_write]; }
+  void publish() {
+    _write = _middle.exchange(_write | FRESH) & INDEX;
+  }
+  bool fresh() const { return !!(_middle.load() & FRESH); }
+  bool fetch() {
+    if (!fresh()) {
+      return false;
+    }
+    _read = _middle.exchange(_read) & INDEX;
+    return true;
+  }
+  const T &readSlot() const { return _slot[_read]; }
+ protected:
+  static const unsigned int INDEX = 3, FRESH = 4;
+  T _slot[3];
+  std::atomic<unsigned int> _middle; // index of middle slot, | FRESH if new
+  unsigned int _write, _read;        // indices of producer, consumer slots
+};
+
+/* Image.cpp: an 8-bit RGBA image, with rows ordered top to bottom (the
+   opposite of GL). save() does not use Teem, so it is safe to call from
+   any thread. The format is learned from the filename extension if it is
+   imageFormatUnknown; pngLevel is the zlib level for imageFormatPNG. */
+class Image {
+ public:
+  explicit Image(int width, int height);
+  int width() const;
+  int height() const;
+  unsigned char *data();
+  const unsigned char *data() const;
+  void save(const char *fname, int format=imageFormatUnknown,
+            int pngLevel=1) const;
+ protected:
+  int _width, _height;
+  std::vector<unsigned char> _data;
+};
+extern int imageFormatFromName(const char *fname);
+/* also in Image.cpp: for writing an image a few rows at a time, top to
+   bottom, when the whole thing would be too big to have in memory. The
+   file is complete only after finish() */
+class ImageWriter {
+ public:
+  explicit ImageWriter(const char *fname, int width, int height,
+                       int format=imageFormatUnknown, int pngLevel=1);
+  ~ImageWriter();
+  /* write the next num rows of 8-bit RGBA */
+  void rows(const unsigned char *rgba, int num);
+  void finish();
+ protected:
+  std::string _fname;
+  int _width, _height, _format, _rowsDone;
+  FILE *_file;
+  void *_png, *_pngInfo; // png_structp, png_infop
+  std::vector<unsigned char> _rgb;
+};
+
+/* Readback.cpp: asynchronous glReadPixels, via a ring of pixel buffer
+   objects (PBOs) and fences. start() queues the read from the current read
+   framebuffer and returns immediately; poll() (usually called once per
+   frame) finishes the reads the GPU has completed: it maps the PBO,
+   copies into a new Image (flipping rows on the way), and passes that to
+   the done callback, which then owns it. For other formats and types,
+   the mapped callback gets the PBO contents directly (in GL's bottom-up
+   row order, tightly packed), which are valid only during the call. PBOs
+   are allocated on first use. Requires a current GL context for
+   everything, including destruction, which waits for all pending reads. */
+typedef std::function<void(Image *)> ReadbackDone;
+typedef std::function<void(const void *)> ReadbackMapped;
+class Readback {
+ public:
+  explicit Readback(unsigned int slotNum=3);
+  ~Readback();
+  /* returns false, without doing anything, if all slots are pending */
+  bool start(int x0, int y0, int width, int height, ReadbackDone done);
+  /* format is GL_RED, GL_RG, GL_RGB, GL_RGBA, or GL_DEPTH_COMPONENT,
+     and type is GL_UNSIGNED_BYTE or GL_FLOAT */
+  bool start(int x0, int y0, int width, int height,
+             GLenum format, GLenum type, ReadbackMapped mapped);
+  /* returns number of reads finished; with wait, finishes all of them */
+  unsigned int poll(bool wait=false);
+  unsigned int pending() const;
+  unsigned int slotNum() const;
+ protected:
+  typedef struct {
+    GLuint pbo;
+    size_t size;    // current size of PBO data store
+    GLsync fence;   // non-zero iff pending
+    int width, height;
+    ReadbackMapped mapped;
+  } slot;
+  std::vector<slot> _slot;
+  std::deque<unsigned int> _pending; // indices into _slot, oldest first
+};
+
+/* Capture.cpp: saves every frame, for making movies of fly-throughs and
+   parameter sweeps. frame() is called once per frame (by Viewer or
+   Offscreen, once attached) to start an async Readback; finished frames
+   go into a queue of at most queueMax frames, from which WorkerPool
+   threads write them. With captureOutputFiles, target is a printf
+   pattern for one unsigned int (e.g. "frame-%05u.png"), the extension of
+   which sets the image format. Otherwise, target is a command that gets
+   the raw frames on its stdin, e.g.
+     "ffmpeg -f rawvideo -pix_fmt yuv420p -s 640x480 -r 30 -i - out.mp4"
+   (with "-pix_fmt rgb24" for captureOutputRGB), and the frame size has to
+   stay the same; SIGPIPE is ignored (process-wide) while such a Capture
+   exists, so that a command quitting early is an error, not a crash.
+   Requires a current GL context for frame(), finish(), and
+   destruction (which calls finish()). */
+class Capture {
+ public:
+  explicit Capture(int output, const char *target,
+                   int policy=capturePolicyBlock,
+                   unsigned int queueMax=8, unsigned int threadNum=0);
+  ~Capture();
+  void verbose(int);
+  int verbose();
+  /* start reading width x height pixels of current read framebuffer */
+  void frame(int width, int height);
+  /* wait for all frames to be written, close pipe, report counts */
+  void finish();
+  /* frames written, and frames dropped, so far */
+  unsigned int frameNum();
+  unsigned int dropNum();
+ protected:
+  int _output, _policy, _verbose;
+  std::string _target;
+  unsigned int _queueMax;
+  FILE *_pipe;
+  void (*_sigpipe)(int); // SIGPIPE handler before _pipe was opened
+  int _width, _height;  // size of first frame
+  bool _finished;
+  Readback *_readback;
+  WorkerPool *_writer;
+  std::vector<unsigned char> _yuv; // used only on (the one) writer thread
+  unsigned int _frameIdx;  // index of next frame to queue
+  /* these are shared with the writer threads, and guarded by _mutex */
+  std::mutex _mutex;
+  std::condition_variable _dequeued;
+  unsigned int _queueNum, _frameNum, _dropNum;
+  void _enqueue(Image *img);
+  void _dequeue(bool written);
+};
+
+/* Governor.cpp: keeps frame times near a target by adjusting quality
+   "knobs", each with integer levels from 0 (cheapest) to levelNum-1 (best),
+   and a callback to set the level (e.g. render scale, a Polydata level of
+   detail, glyph resolution, or whether to do an optional pass). frame() is
+   given each frame's time (Viewer does this, with Viewer::governor()).
+   When frames are persistently too slow, one knob is lowered by one
+   level; knobs are lowered in the order they were added, so add first
+   what is least missed. When frames are persistently fast enough, the
+   most recently lowered knob is raised one level. For hysteresis, there
+   is a dead band around the target, and raising needs many more frames
+   than lowering; a raise that is quickly undone doubles the wait for
+   the next one. */
+typedef std::function<void(int level)> GovernorSet;
+class Governor {
+ public:
+  explicit Governor(double frameTarget=1.0/60);
+  void verbose(int);
+  int verbose();
+  /* set/get target frame time, in seconds */
+  void frameTarget(double sec);
+  double frameTarget() const;
+  /* add knob with levelNum levels, now at level, set by calling set(),
+     which is called right away */
+  void knob(const std::string &name, int levelNum, int level,
+            GovernorSet set);
+  /* current level of named knob */
+  int level(const std::string &name) const;
+  /* learn time of latest frame; floor is the least possible frame time
+     (e.g. the display refresh period, with vsync), below which the
+     target can't usefully go. Returns true if a knob was changed */
+  bool frame(double sec, double floor=0);
+  /* smoothed frame time */
+  double frameTime() const;
+ protected:
+  typedef struct {
+    std::string name;
+    int levelNum, level;
+    GovernorSet set;
+  } Knob;
+  std::vector<Knob> _knob;
+  /* indices into _knob of the knobs lowered, most recent last */
+  std::vector<unsigned int> _lowered;
+  int _verbose;
+  double _frameTarget, _frameTime;
+  unsigned int _overNum, _underNum,  // consecutive slow, fast frames
+    _raiseWait,                      // fast frames needed before raising
+    _sinceRaise;                     // frames since last raise
+  bool _raised;                      // last change was a raise
+  bool _lower();
+  void _raise();
+};
+
 /* Camera.cpp: like Teem's limnCamera but simpler: the image plane is
    always considered to be containing look-at point, there is no
    control of right-vs-left handed coordinates (it is always
@@ -218,6 +559,8 @@ class Camera {
   glm::mat4 view();
   glm::mat4 viewInv();
   glm::mat4 project();
+  /* projection for just part of the image; see Camera.cpp */
+  glm::mat4 project(double u0, double u1, double v0, double v1);
   const float *viewPtr();
   const float *projectPtr();
 
@@ -246,10 +589,28 @@ class Camera {
 };
 
 class Scene;  // (forward declaration)
+class Framebuffer;  // (forward declaration)
+class Reproject;  // (forward declaration)
+class SceneQueue;  // (forward declaration)
+class Uploader;  // (forward declaration)
+
+/* Viewer.cpp: everything about a Viewer that its drawing depends on (and
+   that can be changed by handling events), which with run(true) is handed
+   as a snapshot from the thread handling events to the render thread */
+typedef struct {
+  Camera camera;
+  glm::vec3 lightDir;
+  int mode, widthBuffer, heightBuffer;
+  bool interactAdapt, reproject;
+  double slvalue; // for the slider() variable
+  int tvalue;     // for the toggle() variable
+} ViewerState;
 
 /* Viewer.cpp: Viewer contains and manages a GLFW window, including the
    camera that defines the view within the viewer.  We intercept all
-   the events in order to handle how the camera is updated */
+   the events in order to handle how the camera is updated. A Viewer has
+   to be destroyed (on the main thread) before done(), which terminates
+   GLFW */
 class Viewer {
  public:
   explicit Viewer(int width,  int height, const char *label, Scene *scene);
@@ -286,15 +647,95 @@ class Viewer {
   void refreshData(void *data);
   void *refreshData();
 
+  /* set/get update callback, and its data, called once per iteration of
+     run(), after events have been handled and before deciding whether to
+     redraw; this is where to respond to the slider, for example */
+  void updateCB(ViewerRefresher cb);
+  ViewerRefresher updateCB();
+  void updateData(void *data);
+  void *updateData();
+
+  /* the main loop, until finishing: handles events and redraws (with the
+     refresh callback, or else draw() and bufferSwap()), but only when
+     something changed (see changed()) or redraw() was called, and at most
+     once per vertical refresh. While nothing changes it sleeps, waiting
+     for events, rather than redrawing continuously.
+     With thread, the calling (main) thread only handles events, and the
+     GL context moves to a render thread that does everything else: the
+     update callback, drawing, and the refresh callback. The render thread
+     gets a ViewerState snapshot (including the camera) from the main
+     thread through a TripleBuffer, so neither waits for the other: slow
+     frames don't delay handling input, and slow event handling (like 'r'
+     finding the scene bounds, which is done on the render thread) doesn't
+     hold up frames. The callbacks then must not use the camera member
+     (which belongs to the main thread), and the scene must only be
+     changed from them */
+  void run(bool thread=false);
+  /* set/get SceneQueue that run() drains at the start of every frame
+     (before the update callback), and that wakes run() up when there is
+     something to drain; NULL for none. The Viewer doesn't own it */
+  void sceneQueue(SceneQueue *queue);
+  SceneQueue *sceneQueue();
+  /* get (creating on first call, which must be from the main thread) an
+     Uploader with a context sharing with this window's, which run()
+     swap()s at the start of every frame. The Viewer owns it */
+  Uploader *uploader();
+  /* ask run() to redraw even if nothing else changed */
+  void redraw();
+  /* whether run() would now redraw */
+  bool dirty() const;
+
+  /* set/get whether to render at reduced resolution while interacting
+     (while a mouse button is down), into an off-screen framebuffer that is
+     then scaled up to the window. The scale adapts to measured frame
+     times, to stay within frameTarget(), and the full resolution is drawn
+     again once the buttons are released */
+  void interactAdapt(bool);
+  bool interactAdapt() const;
+  /* set/get target time (in seconds) per frame while interacting */
+  void frameTarget(double sec);
+  double frameTarget() const;
+  /* set/get scale (in (0,1]) of rendering resolution. With
+     interactAdapt(), this is only used while interacting (and it is set
+     automatically, unless there is a governor()); otherwise it is used
+     for every frame. Fixing the scale at 1 disables the scaling */
+  void renderScale(double scl);
+  double renderScale() const;
+  /* get the time (in seconds) taken to draw and swap the last frame */
+  double frameTime() const;
+  /* set/get Governor to be given the time of every frame; NULL for none.
+     The Viewer doesn't own it. To have it control the render scale, add
+     a knob that calls renderScale() */
+  void governor(Governor *gov);
+  Governor *governor();
+
+  /* set/get whether, while interacting, frames are made by reprojecting
+     the previous frame (see Reproject), which takes precedence over
+     renderScale(). Changes made by the update callback force a full
+     redraw; the full frame is drawn again once the buttons are released */
+  void reproject(bool);
+  bool reproject() const;
+
   /* swap render buffers in window */
   void bufferSwap();
 
   /* makes context of this GLFW window current */
   void current();
 
-  /* save RGBA of current window to file */
+  /* save RGBA of window to file. The pixels are read (asynchronously) in
+     the next bufferSwap(), just before swapping, and the file is written
+     by a worker thread, so this doesn't slow down rendering */
   void snap(const char *fname); // to this filename
-  void snap();                  // to some new file
+  void snap();                  // to new snap-NNNN file, in snapFormat()
+  /* set/get format (imageFormat*) for snap() without filename */
+  void snapFormat(int format);
+  int snapFormat() const;
+  /* block until all requested snaps are saved */
+  void snapFinish();
+  /* set/get Capture to save every frame, from bufferSwap(); NULL to stop.
+     The Viewer doesn't own it */
+  void capture(Capture *cap);
+  Capture *capture();
 
   /* set/get scene */
   const Scene *scene();
@@ -333,23 +774,73 @@ class Viewer {
   int _mode;           // from Hale::viewerMode* enum
   ViewerRefresher _refreshCB;
   void * _refreshData;
+  ViewerRefresher _updateCB;
+  void * _updateData;
+  SceneQueue *_sceneQueue;
+  Uploader *_uploader;
+  void _frameStart();        // drain _sceneQueue, swap _uploader
+  std::atomic<bool> _redraw; // redraw() was called
+  unsigned int _changeDrawn; // _changes() as of last bufferSwap()
+  unsigned int _changes() const;
+  /* what draw() uses: a copy of (in run(true), a snapshot of) the
+     members it came from */
+  ViewerState _state;
+  void _stateSet(ViewerState &st);
+  void _stateUse(const ViewerState &st);
+  /* for run(true) */
+  bool _threaded;
+  TripleBuffer<ViewerState> _stateHandoff; // main thread to render thread
+  ViewerState _statePublished;             // last snapshot published
+  std::atomic<bool> _resetAsk;             // 'r' wants scene bounds
+  TripleBuffer<std::pair<glm::vec3, glm::vec3> > _boundsHandoff; // to main
+  std::mutex _wakeMutex;
+  std::condition_variable _wake;           // for waking render thread
+  void _renderWake();
+  void _renderLoop();
+  void _cameraReset(glm::vec3 wmin, glm::vec3 wmax);
+  /* for interactAdapt(); _fbuffScaled is created on first use */
+  bool _interactAdapt,
+    _drawnApprox;            // last frame was approximate (scaled down or
+                             // reprojected) because of interaction
+  double _frameTarget, _renderScale, _frameTime,
+    _drawStart;              // glfwGetTime() at start of draw()
+  Framebuffer *_fbuffScaled;
+  void _renderScaleUpdate();
+  Governor *_governor;
+  bool _reprojWant;          // reproject()
+  Reproject *_reproj;        // created, deleted by draw() per _reprojWant
+  void _blit(const Framebuffer *fbuff, int width, int height, GLenum filter);
 
   int _pixDensity,
     _widthScreen, _heightScreen,
     _widthBuffer, _heightBuffer;
-  // space to get current windows pixel values
-  unsigned char *_buffRGBA[2];
-  Nrrd *_nbuffRGBA[2];
-  void _buffAlloc(void); // manages previous _buff* and _nbuff*
+  // for snap(); _readback and _encoder are created on first use
+  std::deque<std::string> _snapName; // requested, not yet read
+  std::mutex _snapMutex;             // for _snapName
+  bool _snapPending(void);
+  int _snapFormat;
+  Readback *_readback;
+  WorkerPool *_encoder;
+  void _snapRead(void);
+  Capture *_capture;
   double _lastX, _lastY; // last clicked position, in screen space
-  bool _slidable, // can toggle to using right-click on bottom edge as slider
-    _sliding;     // is now being used as slider
+  /* latest cursor position, not yet applied to the camera: all the cursor
+     events that arrive between frames are handled with one camera update,
+     by _cursorApply() */
+  double _cursorX, _cursorY;
+  bool _cursorMoved;
+  void _cursorApply();
+  bool _slidable; // can toggle to using right-click on bottom edge as slider
+  std::atomic<bool> _sliding; // is now being used as slider
   void _slrevalue(const char *me, double xx);
   double *_slvalue, // value to modify via slider
-    _slmin, _slmax;  // range of possible slider values
-  int *_tvalue; // value to toggle via space bar
+    _slmin, _slmax,  // range of possible slider values
+    _slNow;          // latest slider value (set in *_slvalue by _stateUse)
+  int *_tvalue, // value to toggle via space bar
+    _tNow;      // latest toggle value
 
   GLFWwindow *_window; // the window we manage
+  GLFWwindow *_uploadWindow; // hidden, for _uploader's shared context
   static void cursorPosCB(GLFWwindow *gwin, double xx, double yy);
   static void framebufferSizeCB(GLFWwindow *gwin, int newWidth, int newHeight);
   static void keyCB(GLFWwindow *gwin, int key, int scancode, int action, int mods);
@@ -360,6 +851,210 @@ class Viewer {
   void shapeUpdate();
 };
 
+/* Framebuffer.cpp: a GL framebuffer object, with textures for some number
+   of color attachments (by default, one RGBA8) and (unless depthFormat is
+   0) a depth attachment, for rendering off-screen. Requires a current GL
+   context for construction, resizing, and destruction. */
+class Framebuffer {
+ public:
+  explicit Framebuffer(int width, int height,
+                       const std::vector<GLenum> &colorFormat
+                       = std::vector<GLenum>(1, GL_RGBA8),
+                       GLenum depthFormat = GL_DEPTH_COMPONENT24);
+  ~Framebuffer();
+  /* re-allocates attachments, losing their contents */
+  void resize(int width, int height);
+  int width() const;
+  int height() const;
+  /* bind as current GL_FRAMEBUFFER, and set viewport to cover it */
+  void bind() const;
+  /* go back to drawing to the window; caller should reset viewport */
+  static void unbind();
+  GLuint fboId() const;
+  GLuint colorTex(unsigned int idx=0) const;
+  GLuint depthTex() const;
+ protected:
+  int _width, _height;
+  std::vector<GLenum> _colorFormat;
+  GLenum _depthFormat;
+  GLuint _fbo;
+  std::vector<GLuint> _colorTex;
+  GLuint _depthTex;
+  void _alloc();
+  void _free();
+};
+
+/* Offscreen.cpp: the headless counterpart of Viewer: same Camera and same
+   Scene, but no window and no events. It renders into a Framebuffer of any
+   size, in a GL context created via EGL (so on Linux it works with no X
+   server, e.g. with Mesa's surfaceless platform and llvmpipe), or on Macs
+   via a hidden GLFW window. It should be created before any Polydata, to
+   make the GL context they need. */
+class Offscreen {
+ public:
+  explicit Offscreen(int width, int height, Scene *scene);
+  ~Offscreen();
+
+  /* the camera used for rendering; aspect ratio follows size */
+  Camera camera;
+
+  /* set/get verbosity level */
+  void verbose(int);
+  int verbose();
+
+  /* get/set size of image rendered */
+  int width();
+  int height();
+  void resize(int width, int height);
+
+  /* makes our GL context current */
+  void current();
+
+  /* set/get scene */
+  const Scene *scene();
+  void scene(Scene *scn);
+
+  /* set/get view-space light position */
+  void lightDir(glm::vec3 dir);
+  glm::vec3 lightDir(void) const;
+
+  /* render scene into our framebuffer (and to capture(), if set) */
+  void draw(void);
+
+  /* save RGBA of last draw() to file */
+  void snap(const char *fname); // to this filename
+  void snap();                  // to some new file
+
+  /* set/get Capture to save every draw(); NULL to stop. The Offscreen
+     doesn't own it */
+  void capture(Capture *cap);
+  Capture *capture();
+
+  /* get (creating on first call) an Uploader with a context sharing with
+     ours, which draw() swap()s first. The Offscreen owns it */
+  Uploader *uploader();
+
+ protected:
+  int _verbose;
+  Scene *_scene;
+  Uploader *_uploader;
+  glm::vec3 _lightDir;
+  Framebuffer *_fbuff;
+  Readback *_readback;  // created on first snap()
+  Capture *_capture;
+  /* EGLDisplay, EGLContext, EGLSurface, kept opaque here so that Hale.h
+     users don't need EGL headers */
+  void *_eglDisplay, *_eglContext, *_eglSurface, *_eglConfig;
+  GLFWwindow *_window; // (only on Macs)
+  void _contextNew();
+  void _contextNix();
+};
+
+/* Poster.cpp: renders an image of any size (bigger than any framebuffer
+   could be) as a grid of tiles, each with its own off-center projection
+   (from Camera::project(u0,u1,v0,v1)). Each row of tiles is read back and
+   then streamed to the file with an ImageWriter, so memory use is bounded
+   by one row of tiles, not the whole image. The camera's aspect ratio is
+   temporarily set to that of the poster; lightDir is in view-space, as
+   for Viewer. Requires a current GL context (e.g. from an Offscreen). */
+class Poster {
+ public:
+  explicit Poster(int width, int height, int tileSize=1024);
+  void verbose(int);
+  int verbose();
+  int width() const;
+  int height() const;
+  int tileSize() const;
+  void render(Scene *scene, Camera &camera, glm::vec3 lightDir,
+              const char *fname);
+ protected:
+  int _width, _height, _tileSize, _verbose;
+};
+
+/* Reproject.cpp: for heavy scenes, makes frames during small camera
+   motions mostly by re-using the previous frame: its pixels are moved
+   (according to their depth) to where the new camera sees them. What that
+   leaves uncovered (disoccluded, or newly in view) is filled by drawing the
+   scene, with a stencil test so only those pixels are shaded, and a
+   fraction (refresh()) of square tiles is re-drawn fully each frame, so
+   no pixel is stale for more than 1/refresh() frames. Changes other than
+   camera motion are not seen by reprojection (until the tile is
+   refreshed), so call invalidate() after them. Frames alternate between
+   two framebuffers (RGBA8 color, depth+stencil); framebuffer() is the
+   latest. Requires a current GL context throughout. */
+class Reproject {
+ public:
+  explicit Reproject(int width, int height);
+  ~Reproject();
+  void verbose(int);
+  int verbose();
+  int width() const;
+  int height() const;
+  void resize(int width, int height);
+  /* set/get fraction of tiles fully re-drawn per reprojected frame */
+  void refresh(double frac);
+  double refresh() const;
+  /* set/get largest motion (of points around the look-at point, in
+     normalized device coordinates, which span [-1,1]) for which
+     reprojection is tried; bigger motions just draw the whole scene */
+  void moveMax(double mm);
+  double moveMax() const;
+  /* next draw() will draw the whole scene */
+  void invalidate();
+  /* draw the scene, by reprojecting the previous frame when possible
+     (unless full), or else drawing the whole scene; returns true if
+     reprojection was used. lightDir is in view-space, as for Viewer */
+  bool draw(Scene *scene, Camera &camera, glm::vec3 lightDir,
+            bool full=false);
+  const Framebuffer *framebuffer() const;
+ protected:
+  int _verbose;
+  Framebuffer *_fbuff[2];
+  unsigned int _cur;       // index into _fbuff of latest frame
+  bool _valid;             // _fbuff[_cur] holds a frame for _VP
+  glm::mat4 _VP;           // projection*view of _fbuff[_cur]
+  double _refresh, _moveMax;
+  unsigned int _tileNext;  // next tile to refresh
+  GLuint _vao;             // empty, but needed for drawing points
+};
+
+/* GBuffer.cpp: float render targets holding, per pixel, window-space
+   depth (in [0,1], 1 for background), world-space position, and the
+   per-vertex scalar set with Polydata::scalar() (interpolated across
+   faces), for image-space measurements of what is visible. Background
+   pixels have NaN position and scalar, as do Polydatas without scalars.
+   draw() renders all the Scene's Polydata with preprogramGBuffer; read()
+   starts an asynchronous readback (returning false if two earlier reads
+   are still pending), and a later poll() calls done with three new
+   Nrrds: depth (sx x sy), position (3 x sx x sy), and scalar (sx x sy),
+   with rows top to bottom (as with snapped images), which done then
+   owns. Requires a current GL context throughout. */
+typedef std::function<void(Nrrd *ndepth, Nrrd *nxyz, Nrrd *nval)> GBufferDone;
+class GBuffer {
+ public:
+  explicit GBuffer(int width, int height);
+  ~GBuffer();
+  int width() const;
+  int height() const;
+  void resize(int width, int height);
+  const Framebuffer *framebuffer() const;
+  void draw(Scene *scene, Camera &camera);
+  void draw(Scene *scene, Camera &camera, glm::mat4 project);
+  bool read(GBufferDone done);
+  /* returns number of reads finished; with wait, finishes all of them */
+  unsigned int poll(bool wait=false);
+ protected:
+  Framebuffer *_fbuff;
+  Readback *_readback;
+};
+/* world-space area of the surfaces visible in a position image from
+   GBuffer, summed over pixels: each covered pixel contributes the area
+   spanned by its world-space differences to one neighbor along x and
+   one along y. Of the two neighbors on an axis, the nearer is used, so
+   that depth jumps at silhouettes and occlusions don't count as area
+   (a surface only one pixel wide in view is measured approximately) */
+extern double gbufferArea(const Nrrd *nxyz);
+
 /*
 ** Program.cpp: a GLSL shader program contains shader objects for vertex and
 ** fragment shaders (can easily add a geometry shader when needed)
@@ -371,6 +1066,7 @@ class Program {
   ~Program();
   void compile();
   void bindAttribute(GLuint idx, const GLchar *name);
+  void bindFragData(GLuint idx, const GLchar *name);
   void link();
   GLuint progId() const;
   void use() const;
@@ -388,7 +1084,9 @@ class Program {
   GLchar *_vertCode, *_fragCode;
 };
 /* Extra functions not in Program: ways to communicate (really,
-   broadcast, or shout) uniforms to whatever is current program */
+   broadcast, or shout) uniforms to whatever is current program; the
+   program not having that uniform is not an error (though sticky
+   uniforms are still remembered for other programs) */
 extern void uniform(std::string, float, bool sticky=false);
 extern void uniform(std::string, glm::vec3, bool sticky=false);
 extern void uniform(std::string, glm::vec4, bool sticky=false);
@@ -403,6 +1101,23 @@ extern void stickyUniform(void);
 /* way to access one of the "pre-programs"; will compile as needed */
 extern const Program *ProgramLib(preprogram pp);
 
+/* Polydata.cpp: GL buffers for a limnPolyData, which fill() makes and
+   fills with whatever GL context is current (which can be one sharing
+   objects with the Polydata's context, as in an Uploader), for
+   Polydata::buffers() to take over. The limnPolyData is nix'd by the
+   destructor if own and not taken over; deleting buffers that weren't
+   taken over needs a current (sharing) context */
+class PolydataBuffers {
+ public:
+  explicit PolydataBuffers(limnPolyData *poly, bool own);
+  ~PolydataBuffers();
+  void fill();
+  limnPolyData *lpld;
+  bool own;
+  std::vector<GLuint> buff;  // XYZW, then one per limnPolyDataInfo bit set
+  GLuint elms;               // element array
+};
+
 class Polydata {
  public:
   explicit Polydata(const limnPolyData *poly,  // don't own
@@ -413,6 +1128,13 @@ class Polydata {
   /* if you want to get the underlying limn representation */
   const limnPolyData *lpld() const { return _lpld ? _lpld : _lpldOwn; }
   void rebuffer();            // glBuffer(Sub)Data calls
+  /* for when only some vertices and indices changed, given as (start,
+     num) ranges: just those go to GL (with glBufferSubData). If the
+     limnPolyData was reallocated, this is the same as rebuffer() */
+  void rebuffer(const std::vector<std::pair<unsigned int,
+                                            unsigned int> > &vert,
+                const std::vector<std::pair<unsigned int,
+                                            unsigned int> > &indx);
 
   /* set/get constant color, *if* there is no per-vertex color */
   void colorSolid(float rr, float gg, float bb);
@@ -428,8 +1150,24 @@ class Polydata {
   void program(const Program *);
   const Program *program() const;
 
+  /* set per-vertex scalar values (e.g. data value or curvature), which
+     are copied to GL, for rendering into a GBuffer; num must be the number
+     of vertices. A NULL val removes them. If a rebuffer() changes the
+     number of vertices, the values are dropped and need to be set again */
+  void scalar(const float *val, unsigned int num);
+  bool scalarSet() const;
+
   void bounds(glm::vec3 &min, glm::vec3 &max) const;
-  void draw() const;
+  /* switch to new limnPolyData (which own says whether we own), and
+     rebuffer(); an owned old one is limnPolyDataNix()d. Passing back the
+     limnPolyData we already own keeps it owned by us, whatever own is */
+  void lpld(limnPolyData *poly, bool own);
+  /* switch to the limnPolyData and buffers of pb (after pb->fill()),
+     deleting our old buffers. Unlike rebuffer(), this does no buffer
+     data transfer, so it is quick */
+  void buffers(PolydataBuffers *pb);
+  /* draw with our program, or with the given one (e.g. for a GBuffer) */
+  void draw(const Program *prog=NULL) const;
 
   /* set/get object "name" */
   void name(std::string nm);
@@ -441,6 +1179,8 @@ class Polydata {
   glm::vec4 _colorSolid;      // constant color
   glm::mat4 _model;           // object to world transform
   void _init(std::string);   // main constructor body
+  void _glDelete();          // main destructor body
+  void _attribSet();         // points VAO at _buff and _elms
   void _buffer(bool newaddr); // glBuffer(Sub)Data calls
 
   const limnPolyData *_lpld;  // cannot limnPolyDataNix()
@@ -457,6 +1197,9 @@ class Polydata {
   int _buffIdx[HALE_VERT_ATTR_IDX_NUM];
   /* GL element array buffer */
   GLuint _elms;
+  /* per-vertex scalar: 0 if not set */
+  GLuint _scalarBuff;
+  unsigned int _scalarNum;
   /* the program used for rendering */
   const Program *_program;
 };
@@ -476,6 +1219,10 @@ class Scene {
   ~Scene();
 
   void add(const Polydata *pd);
+  /* remove pd (which isn't deleted); no-op if it isn't in the scene */
+  void remove(const Polydata *pd);
+  /* put newpd where oldpd was, in drawing order */
+  void replace(const Polydata *oldpd, const Polydata *newpd);
 
   /* set/get background color */
   void bgColor(float rr, float gg, float bb);
@@ -488,13 +1235,678 @@ class Scene {
   void bounds(glm::vec3 &min, glm::vec3 &max) const;
 
   void drawInit(void);
-  void draw(void);
+  /* clears, and draws all polydata, with their own programs or with prog */
+  void draw(const Program *prog=NULL);
+  /* same, but without clearing */
+  void drawPolydata(const Program *prog=NULL);
  protected:
   float _bgColor[3];
   glm::vec3 _lightDir;
   std::list<const Polydata *> _polydata;
 };
 
+/* SceneQueue.cpp: changes to a Scene and its Polydata, which can be asked
+   for from any thread (e.g. workers that compute meshes), to be made later
+   by the thread with the GL context, with drain(). Asking doesn't lock:
+   commands are pushed onto a lock-free list. Polydata are named by their
+   name(); those made by the queue (from a limnPolyData) are owned by it,
+   and those given to add(Polydata*) are not. A limnPolyData given to the
+   queue becomes owned by it. Errors found while draining (like an unknown
+   name) are printed to stderr, and the command is dropped */
+class SceneQueue {
+ public:
+  explicit SceneQueue(Scene *scene);
+  /* commands not yet drained are dropped */
+  ~SceneQueue();
+  void verbose(int);
+  int verbose() const;
+
+  /* these can be called from any thread */
+  void add(Polydata *pd);
+  void add(limnPolyData *lpld, const Program *prog, std::string name);
+  void remove(std::string name);
+  void replace(std::string name, limnPolyData *lpld, const Program *prog);
+  void model(std::string name, glm::mat4 mat);
+  void colorSolid(std::string name, glm::vec4 rgba);
+  void upload(std::string name, limnPolyData *lpld);
+  /* number of commands not yet done */
+  unsigned int pending() const;
+  /* set function called (from the pushing thread) when a command is
+     pushed onto an empty queue, to wake up whatever will drain() it */
+  void wake(std::function<void()> wk);
+
+  /* on the GL thread: does queued commands in order, for up to budget()
+     seconds (but at least one command), returning how many are left */
+  unsigned int drain();
+  /* set/get time budget for drain(), in seconds */
+  void budget(double sec);
+  double budget() const;
+  /* on the GL thread: Polydata added via the queue, by name, or NULL */
+  Polydata *polydata(std::string name);
+
+ protected:
+  struct Command;
+  int _verbose;
+  Scene *_scene;
+  double _budget;
+  std::atomic<Command *> _head;     // pushed, newest first
+  std::atomic<unsigned int> _pending;
+  std::function<void()> _wake;
+  std::deque<Command *> _ready;     // popped, oldest first (GL thread only)
+  std::map<std::string, Polydata *> _named; // (GL thread only)
+  std::map<std::string, bool> _owned;       // made by us
+  void _push(Command *cmd);
+  void _do(Command *cmd);
+  void _drop(const std::string &name);
+};
+
+/* PolyPool.cpp: limnPolyData for extraction output (one triangles
+   primitive, with normals) that keep their arrays from one use to the
+   next, so that repeated extractions of about the same size (as when
+   dragging an isovalue slider) settle into doing no allocation at all.
+   size() only re-allocates an array that is too small, and then makes it
+   growth() times bigger than needed; xyzwNum, normNum, and indxNum are
+   how much is in use. Meshes that are done with go back with put(), to be
+   handed out again by get() (the biggest first); past keepNum spare ones,
+   the smallest are freed. Meshes from get() belong to the pool, which
+   frees them when it is deleted, so they mustn't be limnPolyDataNix()ed
+   (or owned by a Polydata). bytes() is what the pool holds in total, in
+   use or not, and bytesPeak() its highest so far. Any thread can use it */
+class PolyPool {
+ public:
+  explicit PolyPool(double growth=1.5, unsigned int keepNum=2);
+  ~PolyPool();
+  double growth() const;
+  unsigned int keepNum() const;
+  /* a spare mesh, or a new empty one */
+  limnPolyData *get();
+  /* sets lpld (from get()) to have vertNum vertices and indxNum indices,
+     in one triangles primitive; values already there may not be kept */
+  void size(limnPolyData *lpld, unsigned int vertNum, unsigned int indxNum);
+  /* whether lpld came from get() (and hasn't been put() back) */
+  bool owns(const limnPolyData *lpld);
+  /* back to the pool. A mesh not from get() is taken over (with the
+     arrays it has) */
+  void put(limnPolyData *lpld);
+  size_t bytes();
+  size_t bytesPeak();
+  /* number of array (re-)allocations so far */
+  unsigned int allocNum();
+ protected:
+  typedef struct {
+    unsigned int vertCap, indxCap;  // sizes of arrays
+    bool spare;                     // in _spare rather than in use
+  } Room;
+  double _growth;
+  unsigned int _keepNum;
+  std::mutex _mutex;
+  std::map<const limnPolyData *, Room> _room;
+  std::vector<limnPolyData *> _spare;
+  size_t _bytes, _bytesPeak;
+  unsigned int _allocNum;
+  size_t _roomBytes(const Room &room) const;
+  void _nix(limnPolyData *lpld);
+};
+
+/* Components.cpp: the connected components of a triangle mesh (such as
+   from Isocontour), for getting rid of the many tiny ones that noisy
+   volumes have. find() labels each vertex with its component, by
+   union-find over the vertices: the triangles are divided among the
+   threads of a WorkerPool, which unite the sets of each triangle's
+   vertices without locks (each link is a compare-and-swap making a root
+   point to a lower-numbered root). Components are numbered biggest
+   (most vertices) first. cull() then removes components from the mesh in
+   place, leaving the arrays allocated (so it works with PolyPool meshes
+   too). Only one thread at a time should use a Components */
+class Components {
+ public:
+  /* threadNum as for WorkerPool */
+  explicit Components(unsigned int threadNum=0);
+  ~Components();
+  /* finds the components of lpld, which has to be all triangles */
+  void find(const limnPolyData *lpld);
+  /* number of components, and the vertices, triangles, and (world-space)
+     area of component ci, for ci < num() */
+  unsigned int num() const;
+  unsigned int vertNum(unsigned int ci) const;
+  unsigned int triNum(unsigned int ci) const;
+  double area(unsigned int ci) const;
+  /* component of each vertex (num() for those in no triangle) */
+  const std::vector<unsigned int> &label() const;
+  /* removes from lpld (as last given to find(), or culled) the components
+     with fewer than vertMin vertices or less than areaMin area, and, if
+     keepNum > 0, all but the keepNum biggest of the rest, as well as
+     vertices in no triangle; returns the number of components removed.
+     Afterwards, num() etc. are of the components that are left. Keeping
+     only the biggest component is cull(lpld, 0, 0, 1) */
+  unsigned int cull(limnPolyData *lpld, unsigned int vertMin,
+                    double areaMin=0, unsigned int keepNum=0);
+ protected:
+  WorkerPool _pool;
+  std::vector<std::atomic<unsigned int> > _parent;  // union-find forest
+  std::vector<unsigned int> _label, _vertNum, _triNum;
+  std::vector<double> _area, _triArea;
+  unsigned int _vertNumIn, _indxNumIn;  // of the mesh described
+};
+
+/* BrickIndex.cpp: finds the parts of a volume that can contain a given
+   isovalue, without looking at every voxel. The cells of the volume (of
+   size[0]*size[1]*size[2] float samples, x fastest) are grouped into
+   bricks of (up to) brickSize^3 cells, and the range of values in each
+   brick, including the samples shared with the next bricks over, is found
+   once, in parallel. The ranges go into an interval tree, which finds the
+   bricks containing a value in time proportional to the log of the number
+   of bricks plus the number found. Bricks of constant value can't contain
+   an isosurface, and aren't in the tree. data is not copied, and is read
+   as it is: of Nrrd type "type" (any of the integral types up to int, or
+   float or double), with the ranges (like all values here) as float */
+class BrickIndex {
+ public:
+  explicit BrickIndex(const void *data, int type, const unsigned int size[3],
+                      unsigned int brickSize=16);
+  explicit BrickIndex(const float *data, const unsigned int size[3],
+                      unsigned int brickSize=16);
+  unsigned int brickSize() const;
+  /* number of bricks, total or along an axis; brick (bx,by,bz) has index
+     bx + brickNum(0)*(by + brickNum(1)*bz) */
+  unsigned int brickNum() const;
+  unsigned int brickNum(unsigned int axis) const;
+  /* range of values in whole volume, or in brick bi */
+  float min() const;
+  float max() const;
+  float min(unsigned int bi) const;
+  float max(unsigned int bi) const;
+  /* the cells of brick bi are [lo[0],hi[0]) x [lo[1],hi[1]) x [lo[2],hi[2]),
+     where cell (x,y,z) has lowest corner at sample (x,y,z) */
+  void cells(unsigned int bi, unsigned int lo[3], unsigned int hi[3]) const;
+  /* appends to bricks the indices of bricks with min <= value <= max */
+  void query(std::vector<unsigned int> &bricks, double value) const;
+ protected:
+  typedef struct {
+    float center;
+    unsigned int start, num;  // bricks _byMin/_byMax[start] through +num-1
+    int left, right;          // child node indices, or -1
+  } Node;
+  const void *_data;
+  int _type;
+  unsigned int _size[3], _brickSize, _brickNum[3];
+  std::vector<float> _min, _max;  // per-brick value ranges
+  float _valMin, _valMax;
+  std::vector<Node> _node;
+  std::vector<unsigned int> _byMin,  // per node: by increasing min
+    _byMax;                          // per node: by decreasing max
+  int _root;
+  void _rangeFind(unsigned int bi);
+  int _build(std::vector<unsigned int> &bricks);
+};
+
+/* Isocontour.cpp: marching cubes isosurfaces of a scalar volume, with
+   world-space positions (from the Nrrd's orientation, as with Teem's seek)
+   and per-vertex normals pointing down the gradient. Unlike seek, only the
+   cells of bricks that a BrickIndex says can contain the isovalue are
+   visited, so extraction time scales with the size of the isosurface
+   rather than of the volume. The bricks are done in parallel, by a
+   WorkerPool of threadNum threads (0 for the WorkerPool default), with
+   the above/below classification of samples done four (float, int, or
+   double) or eight (8- and 16-bit) at a time (with SSE2, where
+   available). Cells share vertices through a per-brick edge cache, and
+   bricks share the vertices on their common faces, so that (as with seek)
+   each crossed edge of the volume has one vertex. The volume is read in
+   place, by kernels templated on its type (switched on once per brick,
+   row, or vertex, not per sample), if it is of any integral type up to
+   int, or float or double; only other types are converted to float. That,
+   and building the index, is done once, at construction. nin has to
+   outlive us. Different threads can extract() at the same time.
+   coarser() makes the next level of a pyramid, for quick previews: the
+   volume downsampled by two along each axis (after a [1,2,1]/4 filter),
+   in the same world space, with the same WorkerPool (so it has to be
+   deleted first) */
+class Isocontour {
+ public:
+  explicit Isocontour(const Nrrd *nin, unsigned int brickSize=16,
+                      unsigned int threadNum=0);
+  ~Isocontour();
+  void verbose(int);
+  int verbose() const;
+  const BrickIndex *index() const;
+  unsigned int threadNum() const;
+  /* set/get PolyPool (not owned, and NULL by default) that sizes the
+     output of extract() when it came from the pool; coarser() gets the
+     same one */
+  void polyPool(PolyPool *pp);
+  PolyPool *polyPool() const;
+  Isocontour *coarser() const;
+  /* sets hist to the numbers of samples in each of binNum equal bins
+     spanning [index()->min(), index()->max()] */
+  void histogram(std::vector<size_t> &hist, unsigned int binNum) const;
+  /* value at world-space position wpos, by trilinear interpolation (NaN
+     outside the volume), and, if grad is non-NULL, the world-space
+     gradient there (interpolated from central differences at samples) */
+  double probe(const double wpos[3], double grad[3]=NULL) const;
+  /* sets lpld to the isosurface at isovalue (as indexed triangles), and
+     returns true, unless abandon (if non-NULL, and called from any thread
+     as bricks are started) returned true first, in which case lpld is
+     untouched and false is returned */
+  bool extract(limnPolyData *lpld, double isovalue,
+               std::function<bool()> abandon=nullptr) const;
+  /* like extract(), but with (naive) Surface Nets rather than marching
+     cubes: one vertex per cell that the isosurface crosses, at the
+     average of where it crosses the cell's edges, and two triangles (a
+     quad) per crossed edge of the volume. Compared to marching cubes,
+     this has about as many vertices and triangles, but hardly any
+     slivers; it can be non-manifold where the isosurface crosses a cell
+     more than once */
+  bool extractNets(limnPolyData *lpld, double isovalue,
+                   std::function<bool()> abandon=nullptr) const;
+  /* like extract(), but of only a "slab": the bricks in layers [zlo,zhi)
+     along the slowest axis (of index()->brickNum(2) layers). The vertices
+     on the boundary with the next slab are in both, so that each slab can
+     be a separate Polydata */
+  bool extractSlab(limnPolyData *lpld, double isovalue, unsigned int zlo,
+                   unsigned int zhi,
+                   std::function<bool()> abandon=nullptr) const;
+  /* several surfaces in one pass over the volume: sets lpld[ii] to the
+     isosurface at isovalue[ii] (in any order), with each cell classified
+     once against all the isovalues, and the bricks done in parallel as
+     with extract(). Returns false (with all lpld untouched) if abandon
+     returned true first */
+  bool extract(const std::vector<limnPolyData*> &lpld,
+               const std::vector<double> &isovalue,
+               std::function<bool()> abandon=nullptr) const;
+  /* like the above, for a label volume (of integers): lpld[ii] is set to
+     the boundary of the samples equal to label[ii], with vertices half-way
+     along the edges between samples in and out, and normals pointing out.
+     labels() gives the distinct values in the volume, in increasing order
+     (throwing if there are too many to all be extracted together) */
+  bool extractLabels(const std::vector<limnPolyData*> &lpld,
+                     const std::vector<double> &label,
+                     std::function<bool()> abandon=nullptr) const;
+  void labels(std::vector<double> &label) const;
+  /* incremental extraction, for small isovalue changes: per-brick state
+     kept by update() between calls, made by incrementalNew() (and freed
+     by incrementalNix()), for use with a single limnPolyData */
+  struct Incremental;
+  Incremental *incrementalNew() const;
+  static void incrementalNix(Incremental *inc);
+  /* sets lpld to the isosurface at isovalue, re-using what the last
+     update() with inc left in it: each brick has its own place in lpld,
+     with some room to grow (unused triangles are degenerate, at one
+     vertex). All vertices are moved to the new isovalue, but triangles
+     are only re-made in cells with a sample that changed sides of it
+     (in bricks entering or leaving the active set, among others). The
+     changed ranges of vertices and of indices are set in vert and indx,
+     as (start, num) pairs, for Polydata::rebuffer(vert, indx). When a
+     brick outgrows its place (or on the first call) lpld is laid out
+     anew, and false is returned (with ranges covering all of it) */
+  bool update(limnPolyData *lpld, double isovalue, Incremental *inc,
+              std::vector<std::pair<unsigned int, unsigned int> > *vert,
+              std::vector<std::pair<unsigned int, unsigned int> > *indx) const;
+ protected:
+  /* what one brick contributes to the output */
+  typedef struct {
+    unsigned int brick;
+    std::vector<float> xyzw, norm;
+    /* triangle vertex indices, into xyzw, or (with the high bit set) into
+       foreign, the edges (3*sample index + axis) owned by other bricks */
+    std::vector<unsigned int> indx;
+    std::vector<uint64_t> foreign;
+    /* owned edges that other bricks may refer to, with vertex indices,
+       sorted by edge */
+    std::vector<std::pair<uint64_t, unsigned int> > face;
+    unsigned int vertStart, indxStart;  // where it all goes in output
+  } BrickOut;
+  /* per-thread working space for one brick */
+  typedef struct {
+    std::vector<uint64_t> row;          // bits of samples above isovalue
+    std::vector<unsigned short> cls,    // labels of samples, and those
+      found;                            //   found, for several at once
+    std::vector<unsigned int> stamp,    // edge cache is valid if == gen
+      vert;                             // edge cache of vertex indices
+    unsigned int gen;
+  } Scratch;
+  int _verbose;
+  Nrrd *_nflt;          // float copy of input, if not of a type read in place
+  const void *_data;
+  int _type;            // Nrrd type of _data
+  unsigned int _size[3];
+  double _ItoW[16], _WtoI[16], _ItoWSubInvTransp[9];
+  BrickIndex *_index;
+  WorkerPool *_pool;
+  bool _poolOwn;
+  PolyPool *_polyPool;
+  /* extract()'s working space, kept between calls (for any thread) so
+     that repeated extractions don't allocate */
+  mutable std::mutex _spareMutex;
+  mutable std::vector<std::vector<BrickOut> > _spareOut;
+  mutable std::vector<Scratch> _spareScratch;
+  explicit Isocontour(const Isocontour *finer);
+  void _halve(float *dst, const void *src, int type,
+              const unsigned int ssz[3], unsigned int axis) const;
+  void _gradient(float grad[3], unsigned int xi, unsigned int yi,
+                 unsigned int zi, const float *label=NULL) const;
+  void _vertex(float xyzw[4], float norm[3], uint64_t edge,
+               float isovalue, bool label=false) const;
+  void _world(float xyzw[4], float norm[3], const double ipos[3],
+              const double igrad[3]) const;
+  void _rows(uint64_t *row, const unsigned int lo[3],
+             const unsigned int hi[3], float isovalue) const;
+  void _scratch(Scratch &scr) const;
+  void _brick(BrickOut &bo, float isovalue, Scratch &scr) const;
+  void _cells(BrickOut &bo, const unsigned int lo[3], const unsigned int hi[3],
+              float value, bool label, Scratch &scr) const;
+  void _netsBrick(BrickOut &bo, float isovalue, Scratch &scr) const;
+  void _netsVertex(float xyzw[4], float norm[3], const unsigned int cell[3],
+                   unsigned int cc, float isovalue) const;
+  void _brickMulti(BrickOut *bo, const std::vector<float> &value, bool label,
+                   Scratch &scr) const;
+  unsigned int _owner(uint64_t edge) const;
+  bool _extract(limnPolyData *lpld, double isovalue, unsigned int zlo,
+                unsigned int zhi, std::function<bool()> abandon,
+                bool nets=false) const;
+  bool _extractMulti(const std::vector<limnPolyData*> &lpld,
+                     const std::vector<double> &value, bool label,
+                     std::function<bool()> abandon) const;
+  void _assemble(limnPolyData *lpld, const std::vector<unsigned int> &bricks,
+                 std::vector<BrickOut> &out) const;
+  void _outPut(std::vector<BrickOut> &out) const;
+  void _scratchGet(Scratch &scr) const;
+  void _scratchPut(Scratch &scr) const;
+};
+
+/* IsoSurface.cpp: an isosurface of a scalar volume, as a Polydata, for
+   which a new isovalue can be asked for from any thread without waiting:
+   extraction (with an Isocontour) happens in a worker thread, while the
+   Polydata shows the last mesh finished. Requests that haven't started
+   when a newer one arrives are dropped, so the isosurface always ends up
+   at the latest isovalue. With levelNum > 1, extraction is coarse to fine
+   over a pyramid of Isocontour::coarser() volumes: the coarsest level is
+   always finished and shown right away, and each finer one replaces it in
+   turn, unless a newer isovalue is asked for, which abandons the
+   refinement. (The coarsest extraction isn't stopped once started; its
+   result is shown, being closer to what was asked for than what was shown
+   before.) A finished mesh replaces the shown one with update(), on
+   the rendering thread: either right away (with Polydata::lpld()), or,
+   with an Uploader, once the uploader has the buffers ready.
+   Finished meshes are kept in a cache of up to cacheBudget() bytes (not
+   counting the meshes shown or about to be), dropping the least recently
+   used first (only full-resolution meshes are cached; coarser ones go as
+   soon as they're replaced), so that going back to an earlier isovalue costs no
+   extraction. With cacheQuantum() > 0, isovalues are rounded to multiples
+   of it (so that nearby isovalues share a mesh), and when nothing else is
+   asked for, the worker prefetches meshes at up to prefetch() quanta on
+   either side of the current isovalue, as long as they fit the budget.
+   With incremental(true), full-resolution extraction instead goes through
+   Isocontour::update() into one "live" mesh, of which update() copies
+   only the changed ranges into the shown copy, and which it passes to
+   Polydata::rebuffer() (not the Uploader) when that copy is shown. The
+   live mesh is cached along with the others, but never dropped. With
+   surfaceNets(true), extraction is with Isocontour::extractNets() (and
+   not incremental). Culling small components (cullVertMin(), etc.)
+   happens on each mesh as it is made (also not incrementally) */
+class IsoSurface {
+ public:
+  /* nin has to outlive us; lpld, if non-NULL, is the isosurface of nin at
+     isovalue (which we now own), saving the first extraction; levelNum is
+     the number of pyramid levels, including nin itself */
+  explicit IsoSurface(const Nrrd *nin, double isovalue, const Program *prog,
+                      limnPolyData *lpld=NULL, unsigned int levelNum=1);
+  ~IsoSurface();
+  void verbose(int);
+  int verbose() const;
+  /* the Polydata, owned by us, to add to a Scene */
+  Polydata *polydata();
+  /* set/get Uploader to get buffers to GL; NULL (the default) for none */
+  void uploader(Uploader *upl);
+  Uploader *uploader();
+  /* set function called (from any thread) when a mesh is waiting for
+     update() to show it */
+  void wake(std::function<void()> wk);
+  unsigned int levelNum() const;
+  /* where the meshes come from (the last ones dropped from the cache are
+     re-used), for its memory use */
+  PolyPool *polyPool();
+  /* set/get whether to extract incrementally (default false) */
+  void incremental(bool inc);
+  bool incremental();
+  /* set/get whether to extract with Surface Nets (default false); on a
+     change, the cached meshes are no longer used, and the current
+     isovalue is extracted again */
+  void surfaceNets(bool nets);
+  bool surfaceNets();
+  /* set/get culling of small connected components (with Components::cull())
+     from each mesh before it's shown: those with fewer than cullVertMin()
+     vertices or less than cullAreaMin() area go, and, if cullKeepNum() > 0,
+     all but that many of the biggest. On a change, as with surfaceNets().
+     All are 0 by default, for no culling. Keeping only the biggest
+     component is cullKeepNum(1) */
+  void cullVertMin(unsigned int vertMin);
+  unsigned int cullVertMin();
+  void cullAreaMin(double areaMin);
+  double cullAreaMin();
+  void cullKeepNum(unsigned int keepNum);
+  unsigned int cullKeepNum();
+
+  /* from any thread: ask for this isovalue */
+  void isovalue(double);
+  /* isovalue, and pyramid level (0 for full resolution), of the mesh now
+     in the Polydata */
+  double isovalue();
+  unsigned int level();
+  /* whether a newer isovalue, or a finer level, is being extracted or
+     waiting to be shown */
+  bool busy();
+  /* on the rendering thread: shows a finished mesh, if there is one;
+     returns true if the Polydata changed */
+  bool update();
+
+  /* set/get cache size limit (default 0: no cache) */
+  void cacheBudget(size_t bytes);
+  size_t cacheBudget();
+  /* set/get isovalue rounding (default 0: none) */
+  void cacheQuantum(double quantum);
+  double cacheQuantum();
+  /* set/get number of quanta on each side to prefetch (default 0) */
+  void prefetch(unsigned int num);
+  unsigned int prefetch();
+  /* isovalues asked for that were already in the cache, or not */
+  unsigned int cacheHitNum();
+  unsigned int cacheMissNum();
+  /* meshes in the cache (including shown ones), and their total size */
+  unsigned int cacheMeshNum();
+  size_t cacheBytes();
+
+ protected:
+  typedef struct {
+    double value;
+    unsigned int level;
+    limnPolyData *lpld;
+    size_t bytes;
+  } Mesh;
+  int _verbose;
+  std::vector<Isocontour *> _level; // finest first
+  Polydata *_hply;
+  Uploader *_uploader;
+  std::function<void()> _wake;
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::list<Mesh> _cache;       // most recently used first
+  PolyPool _polys;              // where meshes come from, and go back to
+  limnPolyData *_front,         // mesh in the Polydata
+    *_next,                     // mesh on its way into the Polydata
+    *_latest;                   // latest extraction, to show (if _want
+                                //   isn't there yet), or NULL
+  double _want,                 // latest isovalue asked for (quantized)
+    _frontValue,                // isovalue of _front
+    _nextValue,                 // isovalue of _next
+    _quantum,
+    _prefetchDone,              // _want for which prefetching gave up
+    _giveUp,                    // isovalue that failed to extract
+    _rangeMin, _rangeMax;       // of values in the volume
+  unsigned int _frontLevel, _nextLevel;
+  /* counts isovalue() requests, so the worker can tell (without the lock)
+     that its refinement is no longer wanted; the others record which
+     request a mesh was for, so that stale ones aren't shown */
+  std::atomic<unsigned int> _wantNum;
+  unsigned int _frontNum, _nextNum, _latestNum;
+  size_t _budget, _bytes;
+  unsigned int _prefetch, _hitNum, _missNum;
+  bool _quit, _nets;
+  unsigned int _cullVertMin, _cullKeepNum;
+  double _cullAreaMin;
+  /* incremented by _restart(), so the worker can tell that a mesh it was
+     making is no longer of the kind wanted */
+  unsigned int _kindNum;
+  Components *_comps;           // for culling (used only by the worker)
+  /* for incremental(): the worker updates _liveWork in place, and then
+     waits (while _livePending) for update() to copy the changed ranges
+     _liveVert and _liveIndx (or all of it, if _liveFull) into _live */
+  bool _incremental, _livePending, _liveFull;
+  Isocontour::Incremental *_liveInc;
+  limnPolyData *_liveWork, *_live;
+  double _liveValue;
+  unsigned int _liveNum;
+  std::vector<std::pair<unsigned int, unsigned int> > _liveVert, _liveIndx;
+  /* these are all called with _mutex locked */
+  void _restart();
+  double _quantize(double val) const;
+  std::list<Mesh>::iterator _find(double val);
+  std::list<Mesh>::iterator _find(const limnPolyData *lpld);
+  bool _keep(const Mesh &mesh) const;
+  size_t _keepBytes();
+  void _evict();
+  bool _prefetchNext(double *val);
+  void _liveUpdate(std::unique_lock<std::mutex> &lock, double val,
+                   unsigned int num);
+  bool _liveTake(std::unique_lock<std::mutex> &lock);
+  void _work();
+};
+
+/* IsoStream.cpp: an isosurface of a volume too big to wait for, shown
+   as it is extracted: a worker thread goes through the volume one slab
+   (some layers of bricks; see Isocontour::extractSlab) at a time, and
+   each finished slab becomes its own Polydata in the Scene, so the
+   Viewer draws a partial isosurface that fills in while the next slabs
+   are extracted. update(), on the rendering thread, adds the finished
+   slabs: the first mesh of a slab is sent to GL right away, and later
+   ones (for later isovalues) go with the Uploader, if there is one.
+   A new isovalue starts again from the first slab, abandoning the slab
+   in progress; until their turn comes, slabs show the previous
+   isovalue's mesh */
+class IsoStream {
+ public:
+  /* nin and scene have to outlive us; slabs are layerNum layers of
+     bricks thick. Extraction at isovalue starts right away */
+  explicit IsoStream(const Nrrd *nin, double isovalue, const Program *prog,
+                     Scene *scene, unsigned int layerNum=1);
+  ~IsoStream();
+  void verbose(int);
+  int verbose() const;
+  /* set/get Uploader to get buffers to GL; NULL (the default) for none */
+  void uploader(Uploader *upl);
+  Uploader *uploader();
+  /* set function called (from any thread) when a slab is waiting for
+     update() to show it */
+  void wake(std::function<void()> wk);
+  unsigned int slabNum() const;
+
+  /* from any thread: ask for this isovalue */
+  void isovalue(double);
+  double isovalue();
+  /* number of slabs finished at isovalue(), whether shown yet or not */
+  unsigned int slabDone();
+  /* whether there are slabs left to extract or to show */
+  bool busy();
+  /* on the rendering thread: shows the finished slabs; returns true if
+     the Scene changed */
+  bool update();
+
+ protected:
+  typedef struct {
+    unsigned int slab;
+    limnPolyData *lpld;
+  } Done;
+  int _verbose;
+  Isocontour *_isoc;
+  const Program *_program;
+  Scene *_scene;
+  Uploader *_uploader;
+  std::function<void()> _wake;
+  unsigned int _layerNum, _slabNum;
+  /* per slab, created (by update()) once it has a non-empty mesh, and in
+     the scene while its mesh isn't empty */
+  std::vector<Polydata *> _hply;
+  std::vector<bool> _shown;
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::deque<Done> _done;        // finished slabs, for update()
+  double _want;                  // isovalue asked for
+  /* counts isovalue() requests, so the worker can tell (without the lock)
+     that its slab is no longer wanted */
+  std::atomic<unsigned int> _wantNum;
+  unsigned int _slabNext,        // next slab to extract for _want
+    _slabDone;                   // slabs done for _want
+  bool _quit;
+  void _work();
+};
+
+/* Uploader.cpp: copies new limnPolyData to GL in a background thread,
+   with its own GL context that shares objects with the rendering one, so
+   that the rendering thread doesn't stall on big glBufferData() calls.
+   Each upload is a PolydataBuffers::fill() followed by a fence; once the
+   fence has signaled, swap() (on the rendering thread) hands the buffers
+   to their Polydata, with Polydata::buffers(). Get one from
+   Viewer::uploader() or Offscreen::uploader(), which call swap() before
+   drawing */
+class Uploader {
+ public:
+  /* current(true) makes the upload context current in the calling thread
+     (the upload thread), and current(false) releases it; nix destroys it,
+     and is called by the destructor, on the thread deleting the Uploader,
+     after the upload thread is joined */
+  explicit Uploader(std::function<void(bool)> current,
+                    std::function<void()> nix);
+  /* uploads not yet swapped in are dropped */
+  ~Uploader();
+  void verbose(int);
+  int verbose() const;
+
+  /* from any thread: start uploading poly for pd (which will own poly if
+     own). An upload for pd that hasn't started yet is dropped in favor of
+     this one */
+  void upload(Polydata *pd, limnPolyData *poly, bool own);
+  /* from any thread: drop all uploads for pd (e.g. before deleting it),
+     waiting for any that is being filled */
+  void cancel(const Polydata *pd);
+  /* number of uploads not yet swapped in, and how many of those are ready
+     to swap (filled and fenced) */
+  unsigned int pending();
+  unsigned int ready();
+  /* set function called (from the upload thread) when an upload becomes
+     ready, to wake up whatever will swap() it */
+  void wake(std::function<void()> wk);
+
+  /* on the rendering thread: hands all uploads that are done to their
+     Polydata, returning how many are still pending */
+  unsigned int swap();
+
+ protected:
+  struct Job;
+  int _verbose;
+  std::function<void(bool)> _current;
+  std::function<void()> _nix, _wake;
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::deque<Job *> _todo,  // not yet started
+    _done,                  // filled and fenced, not yet swapped in
+    _trash;                 // cancelled, for the upload thread to delete
+  Job *_busy;               // being filled
+  bool _quit;
+  void _work();
+};
+
 } // namespace Hale
 
 #endif /* HALE_INCLUDED */
@@ -0,0 +1,275 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <png.h>
+
+namespace Hale {
+
+/*
+** None of the writing here uses Teem, because it is meant to run on
+** WorkerPool threads, and biff (via which nrrdSave reports errors) is not
+** thread-safe. These are simple enough formats anyway.
+*/
+
+/* libpng reports errors with longjmp, so nothing in these png*()
+   functions can have a destructor; they return non-zero on error, after
+   which the png struct has been destroyed */
+static int
+pngStart(png_structp *pngP, png_infop *infoP, FILE *file,
+         int width, int height, int level) {
+  png_structp png;
+  png_infop info;
+
+  *pngP = NULL;
+  *infoP = NULL;
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!png) {
+    return 1;
+  }
+  info = png_create_info_struct(png);
+  if (!info) {
+    png_destroy_write_struct(&png, NULL);
+    return 1;
+  }
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    return 1;
+  }
+  png_init_io(png, file);
+  /* the whole point is to be fast: low zlib level, and no filtering
+     (which would otherwise be tried per row) */
+  png_set_compression_level(png, level);
+  png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+  png_set_IHDR(png, info, width, height, 8,
+               PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  *pngP = png;
+  *infoP = info;
+  return 0;
+}
+
+static int
+pngRows(png_structp png, png_infop info,
+        const unsigned char *rgba, int width, int num) {
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    return 1;
+  }
+  for (int yi=0; yi<num; yi++) {
+    png_write_row(png, const_cast<png_bytep>(rgba + 4*width*yi));
+  }
+  return 0;
+}
+
+static int
+pngEnd(png_structp png, png_infop info) {
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    return 1;
+  }
+  png_write_end(png, NULL);
+  png_destroy_write_struct(&png, &info);
+  return 0;
+}
+
+ImageWriter::ImageWriter(const char *fname, int width, int height,
+                         int format, int pngLevel) {
+  static const std::string me="Hale::ImageWriter::ImageWriter";
+
+  if (!(width > 0 && height > 0)) {
+    throw std::runtime_error(me + ": got non-positive size "
+                             + std::to_string(width) + "x"
+                             + std::to_string(height));
+  }
+  if (imageFormatUnknown == format) {
+    format = imageFormatFromName(fname);
+    if (imageFormatUnknown == format) {
+      throw std::runtime_error(me + ": couldn't learn format from name \""
+                               + fname + "\"");
+    }
+  }
+  if (airEnumValCheck(imageFormat, format)) {
+    throw std::runtime_error(me + ": image format " + std::to_string(format)
+                             + " not valid");
+  }
+  _fname = fname;
+  _width = width;
+  _height = height;
+  _format = format;
+  _rowsDone = 0;
+  _png = _pngInfo = NULL;
+  _file = fopen(fname, "wb");
+  if (!_file) {
+    throw std::runtime_error(me + ": couldn't open \"" + fname
+                             + "\" for writing: " + strerror(errno));
+  }
+  switch (format) {
+  case imageFormatNrrd:
+    fprintf(_file, "NRRD0004\n");
+    fprintf(_file, "# Complete NRRD file format specification at:\n");
+    fprintf(_file, "# http://teem.sourceforge.net/nrrd/format.html\n");
+    fprintf(_file, "type: uchar\n");
+    fprintf(_file, "dimension: 3\n");
+    fprintf(_file, "sizes: 4 %d %d\n", width, height);
+    fprintf(_file, "kinds: RGBA-color space space\n");
+    fprintf(_file, "encoding: raw\n\n");
+    break;
+  case imageFormatPPM:
+    fprintf(_file, "P6\n%d %d\n255\n", width, height);
+    _rgb.resize(3*width);
+    break;
+  case imageFormatPNG:
+    png_structp png;
+    png_infop info;
+    if (pngStart(&png, &info, _file, width, height, pngLevel)) {
+      fclose(_file);
+      _file = NULL;
+      throw std::runtime_error(me + ": couldn't start PNG \"" + fname + "\"");
+    }
+    _png = png;
+    _pngInfo = info;
+    break;
+  }
+}
+
+ImageWriter::~ImageWriter() {
+  if (_png) {
+    png_structp png = static_cast<png_structp>(_png);
+    png_infop info = static_cast<png_infop>(_pngInfo);
+    png_destroy_write_struct(&png, &info);
+  }
+  if (_file) {
+    fclose(_file);
+  }
+}
+
+void
+ImageWriter::rows(const unsigned char *rgba, int num) {
+  static const std::string me="Hale::ImageWriter::rows";
+
+  if (!_file) {
+    throw std::runtime_error(me + ": \"" + _fname + "\" not open");
+  }
+  if (_rowsDone + num > _height) {
+    throw std::runtime_error(me + ": " + std::to_string(num)
+                             + " more rows would be past "
+                             + std::to_string(_height));
+  }
+  int bad = 0;
+  switch (_format) {
+  case imageFormatNrrd:
+    bad = (static_cast<size_t>(num)
+           != fwrite(rgba, 4*static_cast<size_t>(_width), num, _file));
+    break;
+  case imageFormatPPM:
+    for (int yi=0; yi<num; yi++) {
+      const unsigned char *row = rgba + 4*static_cast<size_t>(_width)*yi;
+      for (int xi=0; xi<_width; xi++) {
+        _rgb[0 + 3*xi] = row[0 + 4*xi];
+        _rgb[1 + 3*xi] = row[1 + 4*xi];
+        _rgb[2 + 3*xi] = row[2 + 4*xi];
+      }
+      bad |= (static_cast<size_t>(_width)
+              != fwrite(&(_rgb[0]), 3, _width, _file));
+    }
+    break;
+  case imageFormatPNG:
+    if (pngRows(static_cast<png_structp>(_png),
+                static_cast<png_infop>(_pngInfo), rgba, _width, num)) {
+      _png = _pngInfo = NULL;
+      bad = 1;
+    }
+    break;
+  }
+  if (bad) {
+    throw std::runtime_error(me + ": error writing \"" + _fname + "\"");
+  }
+  _rowsDone += num;
+}
+
+void
+ImageWriter::finish() {
+  static const std::string me="Hale::ImageWriter::finish";
+
+  if (!_file) {
+    return;
+  }
+  if (_rowsDone != _height) {
+    throw std::runtime_error(me + ": only " + std::to_string(_rowsDone)
+                             + " of " + std::to_string(_height)
+                             + " rows written to \"" + _fname + "\"");
+  }
+  int bad = 0;
+  if (_png) {
+    bad = pngEnd(static_cast<png_structp>(_png),
+                 static_cast<png_infop>(_pngInfo));
+    _png = _pngInfo = NULL;
+  }
+  bad |= ferror(_file);
+  bad |= fclose(_file);
+  _file = NULL;
+  if (bad) {
+    throw std::runtime_error(me + ": error writing \"" + _fname + "\"");
+  }
+}
+
+int
+imageFormatFromName(const char *fname) {
+  const char *ext = fname ? strrchr(fname, '.') : NULL;
+  if (!ext) {
+    return imageFormatUnknown;
+  }
+  return airEnumVal(imageFormat, ext + 1);
+}
+
+Image::Image(int width, int height) {
+  static const std::string me="Hale::Image::Image";
+  if (!(width > 0 && height > 0)) {
+    throw std::runtime_error(me + ": got non-positive size "
+                             + std::to_string(width) + "x"
+                             + std::to_string(height));
+  }
+  _width = width;
+  _height = height;
+  _data.resize(4*static_cast<size_t>(width)*height);
+}
+
+int Image::width() const { return _width; }
+int Image::height() const { return _height; }
+unsigned char *Image::data() { return &(_data[0]); }
+const unsigned char *Image::data() const { return &(_data[0]); }
+
+void
+Image::save(const char *fname, int format, int pngLevel) const {
+  TraceZone tzone("Hale::Image::save", fname);
+
+  ImageWriter writer(fname, _width, _height, format, pngLevel);
+  writer.rows(data(), _height);
+  writer.finish();
+}
+
+} // namespace Hale
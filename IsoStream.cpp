@@ -0,0 +1,242 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+IsoStream::IsoStream(const Nrrd *nin, double isovalue, const Program *prog,
+                     Scene *scene, unsigned int layerNum) {
+  static const std::string me="Hale::IsoStream::IsoStream";
+  if (!(nin && prog && scene)) {
+    throw std::runtime_error(me + ": got NULL nin, prog, or scene");
+  }
+  if (!layerNum) {
+    throw std::runtime_error(me + ": need at least one layer per slab");
+  }
+  _verbose = 0;
+  try {
+    _isoc = new Isocontour(nin);
+  } catch (std::exception &ex) {
+    throw std::runtime_error(me + ": trouble setting up:\n" + ex.what());
+  }
+  _program = prog;
+  _scene = scene;
+  _uploader = NULL;
+  _layerNum = layerNum;
+  _slabNum = (_isoc->index()->brickNum(2) + layerNum - 1)/layerNum;
+  _hply.assign(_slabNum, NULL);
+  _shown.assign(_slabNum, false);
+  _want = isovalue;
+  _wantNum = 0;
+  _slabNext = _slabDone = 0;
+  _quit = false;
+  _thread = std::thread(&IsoStream::_work, this);
+}
+
+IsoStream::~IsoStream() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond.notify_all();
+  _thread.join();
+  for (unsigned int si=0; si<_slabNum; si++) {
+    if (!_hply[si]) {
+      continue;
+    }
+    if (_uploader) {
+      _uploader->cancel(_hply[si]);
+    }
+    if (_shown[si]) {
+      _scene->remove(_hply[si]);
+    }
+    delete _hply[si];
+  }
+  for (Done &done : _done) {
+    limnPolyDataNix(done.lpld);
+  }
+  delete _isoc;
+}
+
+void IsoStream::verbose(int vv) {
+  _verbose = vv;
+  _isoc->verbose(vv > 1 ? vv - 1 : 0);
+}
+int IsoStream::verbose() const { return _verbose; }
+void IsoStream::uploader(Uploader *upl) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _uploader = upl;
+}
+Uploader *IsoStream::uploader() { return _uploader; }
+void IsoStream::wake(std::function<void()> wk) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _wake = wk;
+}
+unsigned int IsoStream::slabNum() const { return _slabNum; }
+
+void IsoStream::isovalue(double val) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (val == _want) {
+      return;
+    }
+    _want = val;
+    _wantNum++;
+    _slabNext = _slabDone = 0;
+  }
+  _cond.notify_all();
+}
+
+double IsoStream::isovalue() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _want;
+}
+
+unsigned int IsoStream::slabDone() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _slabDone;
+}
+
+bool IsoStream::busy() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _slabDone < _slabNum || !_done.empty();
+}
+
+void IsoStream::_work() {
+  static const char me[]="Hale::IsoStream::_work";
+  traceThreadName("isostream");
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _cond.wait(lock, [this]() { return _quit || _slabNext < _slabNum; });
+    if (_quit) {
+      break;
+    }
+    double val = _want;
+    unsigned int slab = _slabNext++, num = _wantNum;
+    lock.unlock();
+    limnPolyData *lpld = limnPolyDataNew();
+    bool done = false, bad = false;
+    try {
+      done = _isoc->extractSlab(lpld, val, slab*_layerNum,
+                                std::min((slab + 1)*_layerNum,
+                                         _isoc->index()->brickNum(2)),
+                                [this, num]() { return num != _wantNum; });
+    } catch (std::exception &ex) {
+      fprintf(stderr, "%s: trouble isosurfacing slab %u at %g:\n%s\n", me,
+              slab, val, ex.what());
+      bad = true;
+    }
+    if (done && _verbose) {
+      printf("%s: isovalue %g: slab %u/%u: %u vertices\n", me, val, slab,
+             _slabNum, lpld->xyzwNum);
+    }
+    lock.lock();
+    if (!done || num != _wantNum) {
+      /* something else is wanted now (_slabNext was reset), or, if bad,
+         the rest of this isovalue isn't tried */
+      limnPolyDataNix(lpld);
+      if (bad && num == _wantNum) {
+        _slabNext = _slabDone = _slabNum;
+      }
+      continue;
+    }
+    /* an older mesh of the same slab, not yet shown, is replaced */
+    bool older = false;
+    for (Done &dd : _done) {
+      if (dd.slab == slab) {
+        limnPolyDataNix(dd.lpld);
+        dd.lpld = lpld;
+        older = true;
+        break;
+      }
+    }
+    if (!older) {
+      Done dd = {slab, lpld};
+      _done.push_back(dd);
+    }
+    _slabDone++;
+    if (_wake) {
+      std::function<void()> wake = _wake;
+      lock.unlock();
+      wake();
+      lock.lock();
+    }
+  }
+}
+
+bool IsoStream::update() {
+  static const char me[]="Hale::IsoStream::update";
+  std::deque<Done> done;
+  Uploader *upl;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    done.swap(_done);
+    upl = _uploader;
+  }
+  if (done.empty()) {
+    return false;
+  }
+  TraceZone tzone(me);
+  bool changed = false;
+  for (Done &dd : done) {
+    Polydata *&hply = _hply[dd.slab];
+    if (!dd.lpld->xyzwNum) {
+      /* (an empty Polydata doesn't have bounds, so it leaves the scene) */
+      if (hply && _shown[dd.slab]) {
+        if (upl) {
+          upl->cancel(hply);
+        }
+        _scene->remove(hply);
+        _shown[dd.slab] = false;
+        changed = true;
+      }
+      limnPolyDataNix(dd.lpld);
+      continue;
+    }
+    if (!hply) {
+      hply = new Polydata(dd.lpld, true, _program,
+                          "IsoStream-" + std::to_string(dd.slab));
+    } else if (upl) {
+      /* it will switch in some later Uploader::swap(); meanwhile it shows
+         its previous mesh */
+      upl->upload(hply, dd.lpld, true);
+    } else {
+      hply->lpld(dd.lpld, true);
+    }
+    if (!_shown[dd.slab]) {
+      _scene->add(hply);
+      _shown[dd.slab] = true;
+    }
+    changed = true;
+  }
+  if (_verbose) {
+    printf("%s: %u slab(s) shown\n", me,
+           static_cast<unsigned int>(done.size()));
+  }
+  return changed;
+}
+
+} // namespace Hale
@@ -0,0 +1,743 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+IsoSurface::IsoSurface(const Nrrd *nin, double isovalue, const Program *prog,
+                       limnPolyData *lpld, unsigned int levelNum) {
+  static const std::string me="Hale::IsoSurface::IsoSurface";
+  if (!(nin && prog)) {
+    throw std::runtime_error(me + ": got NULL nin or prog");
+  }
+  if (!levelNum) {
+    throw std::runtime_error(me + ": need at least one level");
+  }
+  _verbose = 0;
+  _front = lpld ? lpld : _polys.get();
+  try {
+    _level.push_back(new Isocontour(nin));
+    _level[0]->polyPool(&_polys);
+    while (_level.size() < levelNum) {
+      _level.push_back(_level.back()->coarser());
+    }
+    if (!lpld) {
+      _level[0]->extract(_front, isovalue);
+    }
+  } catch (std::exception &ex) {
+    /* coarser levels first */
+    for (unsigned int li=_level.size(); li-- > 0; ) {
+      delete _level[li];
+    }
+    /* (freed with _polys) */
+    _polys.put(_front);
+    throw std::runtime_error(me + ": trouble isosurfacing:\n" + ex.what());
+  }
+  _rangeMin = _level[0]->index()->min();
+  _rangeMax = _level[0]->index()->max();
+  _hply = new Polydata(_front, false, prog, "IsoSurface");
+  _uploader = NULL;
+  Mesh mesh = {isovalue, 0, _front, limnPolyDataSize(_front)};
+  _cache.push_front(mesh);
+  _bytes = mesh.bytes;
+  _next = _latest = NULL;
+  _want = _frontValue = _nextValue = isovalue;
+  _frontLevel = _nextLevel = 0;
+  _wantNum = _frontNum = _nextNum = _latestNum = 0;
+  _quantum = 0;
+  _prefetchDone = _giveUp = AIR_NAN;
+  _budget = 0;
+  _prefetch = _hitNum = _missNum = 0;
+  _quit = _nets = false;
+  _cullVertMin = _cullKeepNum = 0;
+  _cullAreaMin = 0;
+  _kindNum = 0;
+  _comps = NULL;
+  _incremental = _livePending = _liveFull = false;
+  _liveInc = NULL;
+  _liveWork = _live = NULL;
+  _liveValue = AIR_NAN;
+  _liveNum = 0;
+  _thread = std::thread(&IsoSurface::_work, this);
+}
+
+IsoSurface::~IsoSurface() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond.notify_all();
+  _thread.join();
+  if (_uploader) {
+    _uploader->cancel(_hply);
+  }
+  delete _hply;
+  /* (freed with _polys) */
+  for (Mesh &mesh : _cache) {
+    _polys.put(mesh.lpld);
+  }
+  /* (_live is in the cache) */
+  if (_liveWork) {
+    limnPolyDataNix(_liveWork);
+  }
+  Isocontour::incrementalNix(_liveInc);
+  delete _comps;
+  for (unsigned int li=_level.size(); li-- > 0; ) {
+    delete _level[li];
+  }
+}
+
+void IsoSurface::verbose(int vv) {
+  _verbose = vv;
+  for (Isocontour *isoc : _level) {
+    isoc->verbose(vv > 1 ? vv - 1 : 0);
+  }
+}
+int IsoSurface::verbose() const { return _verbose; }
+Polydata *IsoSurface::polydata() { return _hply; }
+void IsoSurface::uploader(Uploader *upl) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _uploader = upl;
+}
+Uploader *IsoSurface::uploader() { return _uploader; }
+void IsoSurface::wake(std::function<void()> wk) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _wake = wk;
+}
+unsigned int IsoSurface::levelNum() const { return _level.size(); }
+PolyPool *IsoSurface::polyPool() { return &_polys; }
+void IsoSurface::incremental(bool inc) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _incremental = inc;
+}
+bool IsoSurface::incremental() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _incremental;
+}
+void IsoSurface::surfaceNets(bool nets) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (nets == _nets) {
+      return;
+    }
+    _nets = nets;
+    _restart();
+  }
+  _cond.notify_all();
+}
+bool IsoSurface::surfaceNets() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _nets;
+}
+void IsoSurface::cullVertMin(unsigned int vertMin) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (vertMin == _cullVertMin) {
+      return;
+    }
+    _cullVertMin = vertMin;
+    _restart();
+  }
+  _cond.notify_all();
+}
+unsigned int IsoSurface::cullVertMin() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _cullVertMin;
+}
+void IsoSurface::cullAreaMin(double areaMin) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (areaMin == _cullAreaMin) {
+      return;
+    }
+    _cullAreaMin = areaMin;
+    _restart();
+  }
+  _cond.notify_all();
+}
+double IsoSurface::cullAreaMin() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _cullAreaMin;
+}
+void IsoSurface::cullKeepNum(unsigned int keepNum) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (keepNum == _cullKeepNum) {
+      return;
+    }
+    _cullKeepNum = keepNum;
+    _restart();
+  }
+  _cond.notify_all();
+}
+unsigned int IsoSurface::cullKeepNum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _cullKeepNum;
+}
+
+/* after a change in how meshes are made: the meshes so far are of the
+   other kind, so they aren't found anymore (but are shown until
+   replaced), and are dropped once not needed */
+void IsoSurface::_restart() {
+  for (Mesh &mesh : _cache) {
+    mesh.value = AIR_NAN;
+  }
+  _liveValue = AIR_NAN;
+  _prefetchDone = _giveUp = AIR_NAN;
+  _kindNum++;
+  /* (abandoning any refinement in progress) */
+  _wantNum++;
+  _evict();
+}
+
+double IsoSurface::_quantize(double val) const {
+  return (_quantum > 0 ? _quantum*floor(val/_quantum + 0.5) : val);
+}
+
+/* finds the full-resolution mesh for val */
+std::list<IsoSurface::Mesh>::iterator IsoSurface::_find(double val) {
+  std::list<Mesh>::iterator it;
+  for (it = _cache.begin(); it != _cache.end(); it++) {
+    if (!it->level && it->value == val) {
+      break;
+    }
+  }
+  return it;
+}
+
+std::list<IsoSurface::Mesh>::iterator
+IsoSurface::_find(const limnPolyData *lpld) {
+  std::list<Mesh>::iterator it;
+  for (it = _cache.begin(); it != _cache.end(); it++) {
+    if (it->lpld == lpld) {
+      break;
+    }
+  }
+  return it;
+}
+
+/* whether mesh can't be dropped: it's shown, about to be, or wanted */
+bool IsoSurface::_keep(const Mesh &mesh) const {
+  return (mesh.lpld == _front || mesh.lpld == _next || mesh.lpld == _latest
+          || mesh.lpld == _live || (!mesh.level && mesh.value == _want));
+}
+
+size_t IsoSurface::_keepBytes() {
+  size_t keep = 0;
+  for (const Mesh &mesh : _cache) {
+    if (_keep(mesh)) {
+      keep += mesh.bytes;
+    }
+  }
+  return keep;
+}
+
+/* drops coarse previews no longer needed, and least recently used meshes
+   until the rest fit in the budget; the first one dropped is kept as
+   spare in _polys, for the worker to extract into */
+void IsoSurface::_evict() {
+  size_t keep = _keepBytes();
+  std::list<Mesh>::iterator it = _cache.end();
+  while (it != _cache.begin()) {
+    it--;
+    if (_keep(*it) || (!it->level && _bytes - keep <= _budget)) {
+      continue;
+    }
+    if (_verbose > 1) {
+      printf("Hale::IsoSurface::_evict: dropping isovalue %g (level %u)\n",
+             it->value, it->level);
+    }
+    _bytes -= it->bytes;
+    _polys.put(it->lpld);
+    it = _cache.erase(it);
+  }
+}
+
+/* finds the nearest isovalue to prefetch, if any, and if it's likely to
+   fit in the budget */
+bool IsoSurface::_prefetchNext(double *val) {
+  if (!(_quantum > 0 && _prefetch && _budget) || _want == _prefetchDone) {
+    return false;
+  }
+  std::list<Mesh>::iterator want = _find(_want);
+  if (_cache.end() == want
+      || _bytes - _keepBytes() + want->bytes > _budget) {
+    _prefetchDone = _want;
+    return false;
+  }
+  for (unsigned int ii=1; ii<=_prefetch; ii++) {
+    for (int sgn=1; sgn>=-1; sgn-=2) {
+      double vv = _quantize(_want + sgn*(double)ii*_quantum);
+      if (AIR_IN_CL(_rangeMin, vv, _rangeMax) && _cache.end() == _find(vv)) {
+        *val = vv;
+        return true;
+      }
+    }
+  }
+  _prefetchDone = _want;
+  return false;
+}
+
+void IsoSurface::isovalue(double val) {
+  std::function<void()> wake;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    val = _quantize(val);
+    if (val == _want) {
+      return;
+    }
+    /* (any earlier request not yet started is forgotten, and any
+       refinement in progress is abandoned) */
+    _want = val;
+    _wantNum++;
+    if (_cache.end() != _find(val)) {
+      _hitNum++;
+      /* no extraction needed, so straight to update() */
+      wake = _wake;
+    } else {
+      _missNum++;
+    }
+  }
+  _cond.notify_all();
+  if (wake) {
+    wake();
+  }
+}
+
+double IsoSurface::isovalue() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _frontValue;
+}
+
+unsigned int IsoSurface::level() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _frontLevel;
+}
+
+bool IsoSurface::busy() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return (_want != _giveUp
+          && (_want != _frontValue || _frontLevel || _next));
+}
+
+void IsoSurface::cacheBudget(size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = bytes;
+    _prefetchDone = AIR_NAN;
+    _evict();
+  }
+  _cond.notify_all();
+}
+size_t IsoSurface::cacheBudget() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _budget;
+}
+void IsoSurface::cacheQuantum(double quantum) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quantum = quantum;
+    _prefetchDone = AIR_NAN;
+  }
+  _cond.notify_all();
+}
+double IsoSurface::cacheQuantum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _quantum;
+}
+void IsoSurface::prefetch(unsigned int num) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _prefetch = num;
+    _prefetchDone = AIR_NAN;
+  }
+  _cond.notify_all();
+}
+unsigned int IsoSurface::prefetch() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _prefetch;
+}
+unsigned int IsoSurface::cacheHitNum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _hitNum;
+}
+unsigned int IsoSurface::cacheMissNum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _missNum;
+}
+unsigned int IsoSurface::cacheMeshNum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _cache.size();
+}
+size_t IsoSurface::cacheBytes() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytes;
+}
+
+void IsoSurface::_work() {
+  static const char me[]="Hale::IsoSurface::_work";
+  traceThreadName("isosurface");
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    /* there's work if what's wanted isn't in the cache (which includes
+       what's shown), or else if there's something to prefetch */
+    double val = 0;
+    bool pre = false;
+    _cond.wait(lock, [this, &val, &pre]() {
+        if (_quit) {
+          return true;
+        }
+        if (_want != _giveUp && _cache.end() == _find(_want)
+            && !(_livePending && _liveValue == _want)) {
+          val = _want;
+          pre = false;
+          return true;
+        }
+        return (pre = _prefetchNext(&val));
+      });
+    if (_quit) {
+      break;
+    }
+    /* refinement (or prefetching) is abandoned once something else is
+       wanted; the coarsest level always finishes, to show something */
+    unsigned int num = _wantNum;
+    std::function<bool()> abandon = [this, num]() {
+      return num != _wantNum;
+    };
+    unsigned int lev = pre ? 0 : _level.size() - 1;
+    while (true) {
+      const bool nets = _nets;
+      const unsigned int kind = _kindNum, vertMin = _cullVertMin,
+        keepNum = _cullKeepNum;
+      const double areaMin = _cullAreaMin;
+      const bool cull = vertMin || areaMin > 0 || keepNum;
+      if (!lev && !pre && _incremental && !nets && !cull) {
+        _liveUpdate(lock, val, num);
+        break;
+      }
+      lock.unlock();
+      limnPolyData *lpld = _polys.get();
+      bool done = false, bad = false;
+      try {
+        std::function<bool()> abn = (pre || lev + 1 < _level.size()
+                                     ? abandon : nullptr);
+        done = (nets ? _level[lev]->extractNets(lpld, val, abn)
+                : _level[lev]->extract(lpld, val, abn));
+        if (done && cull) {
+          /* (_comps is only used here) */
+          if (!_comps) {
+            _comps = new Components(_level[0]->threadNum());
+          }
+          _comps->find(lpld);
+          unsigned int gone = _comps->cull(lpld, vertMin, areaMin, keepNum);
+          if (_verbose) {
+            printf("%s: isovalue %g: culled %u components, kept %u\n", me,
+                   val, gone, _comps->num());
+          }
+        }
+      } catch (std::exception &ex) {
+        fprintf(stderr, "%s: trouble isosurfacing at %g:\n%s\n", me, val,
+                ex.what());
+        bad = true;
+      }
+      if (done && _verbose) {
+        printf("%s: isovalue %g%s (level %u): %u vertices\n", me, val,
+               pre ? " (prefetch)" : "", lev, lpld->xyzwNum);
+      }
+      lock.lock();
+      if (kind != _kindNum) {
+        /* surfaceNets() or culling changed meanwhile, so this is of no
+           use */
+        done = false;
+      }
+      if (!done) {
+        _polys.put(lpld);
+        /* don't keep trying the same thing */
+        if (bad && pre) {
+          _prefetchDone = _want;
+        } else if (bad) {
+          _giveUp = val;
+        }
+        break;
+      }
+      Mesh mesh = {val, lev, lpld, limnPolyDataSize(lpld)};
+      _bytes += mesh.bytes;
+      if (pre) {
+        /* a prefetch shouldn't push out what was actually looked at; if it
+           doesn't fit, it goes right back out, and prefetching stops */
+        _cache.push_back(mesh);
+        _evict();
+        if (_cache.end() == _find(val)) {
+          _prefetchDone = _want;
+        }
+        break;
+      }
+      if (num > _frontNum) {
+        /* shown even if no longer wanted, being closer to it than the
+           front, unless update() finds _want itself in the cache */
+        _latest = lpld;
+        _latestNum = num;
+      }
+      _cache.push_front(mesh);
+      _evict();
+      if (_wake) {
+        std::function<void()> wake = _wake;
+        lock.unlock();
+        wake();
+        lock.lock();
+      }
+      if (!lev || num != _wantNum) {
+        break;
+      }
+      lev--;
+    }
+  }
+}
+
+/* on the worker, with lock locked: Isocontour::update() of _liveWork,
+   for update() to pick up */
+void IsoSurface::_liveUpdate(std::unique_lock<std::mutex> &lock, double val,
+                             unsigned int num) {
+  static const char me[]="Hale::IsoSurface::_liveUpdate";
+  _cond.wait(lock, [this]() { return _quit || !_livePending; });
+  if (_quit || num != _wantNum) {
+    return;
+  }
+  const unsigned int kind = _kindNum;
+  lock.unlock();
+  if (!_liveWork) {
+    _liveWork = limnPolyDataNew();
+    _liveInc = _level[0]->incrementalNew();
+  }
+  std::vector<std::pair<unsigned int, unsigned int> > vert, indx;
+  bool part = false, bad = false;
+  try {
+    part = _level[0]->update(_liveWork, val, _liveInc, &vert, &indx);
+  } catch (std::exception &ex) {
+    fprintf(stderr, "%s: trouble isosurfacing at %g:\n%s\n", me, val,
+            ex.what());
+    /* start over next time */
+    Isocontour::incrementalNix(_liveInc);
+    limnPolyDataNix(_liveWork);
+    _liveInc = NULL;
+    _liveWork = NULL;
+    bad = true;
+  }
+  if (!bad && _verbose) {
+    printf("%s: isovalue %g: %u vertices (%s)\n", me, val,
+           _liveWork->xyzwNum, part ? "updated" : "laid out anew");
+  }
+  lock.lock();
+  if (bad) {
+    _giveUp = val;
+    return;
+  }
+  if (kind != _kindNum) {
+    /* surfaceNets() or culling changed meanwhile, so this is of no use;
+       and since _live never got these changes, the next update() has to
+       start over */
+    Isocontour::incrementalNix(_liveInc);
+    limnPolyDataNix(_liveWork);
+    _liveInc = NULL;
+    _liveWork = NULL;
+    return;
+  }
+  _livePending = true;
+  _liveFull = !part;
+  _liveVert.swap(vert);
+  _liveIndx.swap(indx);
+  _liveValue = val;
+  _liveNum = num;
+  if (_wake) {
+    std::function<void()> wake = _wake;
+    lock.unlock();
+    wake();
+    lock.lock();
+  }
+}
+
+/* on the rendering thread, with lock locked: copies what changed in
+   _liveWork to _live, and re-sends that to GL if _live is shown; returns
+   true if it was */
+bool IsoSurface::_liveTake(std::unique_lock<std::mutex> &lock) {
+  static const char me[]="Hale::IsoSurface::_liveTake";
+  bool full = _liveFull || !_live;
+  if (!_live) {
+    _live = limnPolyDataNew();
+    Mesh mesh = {_liveValue, 0, _live, 0};
+    _cache.push_front(mesh);
+  }
+  std::vector<std::pair<unsigned int, unsigned int> > vert, indx;
+  vert.swap(_liveVert);
+  indx.swap(_liveIndx);
+  limnPolyData *live = _live;
+  /* the worker leaves _liveWork alone until _livePending is cleared, and
+     only this thread touches _live and _front; with _next set, the
+     Polydata may already have the Uploader's buffers for it */
+  bool shown = (_front == live && !_next);
+  lock.unlock();
+  {
+    TraceZone tzone(me);
+    const limnPolyData *work = _liveWork;
+    if (full) {
+      if (limnPolyDataCopy(live, work)) {
+        char *err = biffGetDone(LIMN);
+        std::string errS(err);
+        free(err);
+        throw std::runtime_error(std::string(me) + ": trouble copying:\n"
+                                 + errS);
+      }
+    } else {
+      for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+        std::copy(work->xyzw + 4*rr.first,
+                  work->xyzw + 4*(rr.first + rr.second),
+                  live->xyzw + 4*rr.first);
+        if (work->norm) {
+          std::copy(work->norm + 3*rr.first,
+                    work->norm + 3*(rr.first + rr.second),
+                    live->norm + 3*rr.first);
+        }
+        if (work->rgba) {
+          std::copy(work->rgba + 4*rr.first,
+                    work->rgba + 4*(rr.first + rr.second),
+                    live->rgba + 4*rr.first);
+        }
+      }
+      for (const std::pair<unsigned int, unsigned int> &rr : indx) {
+        std::copy(work->indx + rr.first, work->indx + rr.first + rr.second,
+                  live->indx + rr.first);
+      }
+    }
+    if (shown) {
+      _hply->rebuffer(vert, indx);
+    }
+  }
+  lock.lock();
+  std::list<Mesh>::iterator it = _find(live);
+  _bytes -= it->bytes;
+  it->bytes = limnPolyDataSize(live);
+  _bytes += it->bytes;
+  it->value = _liveValue;
+  _livePending = false;
+  if (shown) {
+    _frontValue = _liveValue;
+    _frontLevel = 0;
+    _frontNum = _liveNum;
+  } else if (_liveNum > _frontNum) {
+    /* to be shown (like any other new mesh) if _want isn't in the cache */
+    _latest = live;
+    _latestNum = _liveNum;
+  }
+  if (_verbose) {
+    printf("%s: live isovalue %g (%s)\n", me, _liveValue,
+           shown ? "shown" : "not shown");
+  }
+  return shown;
+}
+
+bool IsoSurface::update() {
+  static const char me[]="Hale::IsoSurface::update";
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  if (_livePending && !(_next && _next == _live)) {
+    bool shown = _liveTake(lock);
+    _evict();
+    lock.unlock();
+    /* the worker can go on */
+    _cond.notify_all();
+    if (shown) {
+      return true;
+    }
+    lock.lock();
+  }
+  if (_next) {
+    if (_hply->lpld() != _next) {
+      /* the uploader isn't done */
+      return false;
+    }
+  } else {
+    /* what's wanted, at full resolution, else the latest extraction */
+    std::list<Mesh>::iterator it = _find(_want);
+    unsigned int num = _wantNum;
+    if (_cache.end() != it && it->lpld == _front) {
+      return false;
+    }
+    if (_cache.end() == it && _latest && _latest != _front) {
+      it = _find(_latest);
+      num = _latestNum;
+    }
+    if (_cache.end() == it) {
+      /* still extracting */
+      return false;
+    }
+    /* now the most recently used */
+    _cache.splice(_cache.begin(), _cache, it);
+    limnPolyData *next = _next = it->lpld;
+    _nextValue = it->value;
+    _nextLevel = it->level;
+    _nextNum = num;
+    Uploader *upl = _uploader;
+    lock.unlock();
+    if (upl) {
+      /* the Polydata will switch to next in some later Uploader::swap() */
+      upl->upload(_hply, next, false);
+      return false;
+    }
+    {
+      TraceZone tzone(me);
+      _hply->lpld(next, false);
+    }
+    lock.lock();
+  }
+  /* the Polydata now shows _next, and the old _front can be dropped */
+  _front = _next;
+  _frontValue = _nextValue;
+  _frontLevel = _nextLevel;
+  _frontNum = _nextNum;
+  _next = NULL;
+  if (_latest && (_latest == _front || _latestNum <= _frontNum)) {
+    _latest = NULL;
+  }
+  _evict();
+  if (_verbose) {
+    printf("%s: now showing isovalue %g (level %u)\n", me, _frontValue,
+           _frontLevel);
+  }
+  std::function<void()> wake;
+  std::list<Mesh>::iterator it = _find(_want);
+  if ((_cache.end() != it && it->lpld != _front) || _latest) {
+    /* something newer is ready meanwhile */
+    wake = _wake;
+  }
+  lock.unlock();
+  _cond.notify_all();
+  if (wake) {
+    wake();
+  }
+  return true;
+}
+
+} // namespace Hale
@@ -0,0 +1,1942 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <set>
+#include <unordered_map>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+namespace Hale {
+
+/* marching cubes cases. Cube corner ci is at (ci & 1, (ci >> 1) & 1,
+   (ci >> 2) & 1); bit ci of a case is set if corner ci is above the
+   isovalue. Edge ei joins corners edgeCorner[ei][0] and [1], which differ
+   along axis ei/4. The triangles (as edge triples) are found rather than
+   typed in: on each cube face, each run of above-isovalue corners (going
+   around the face) is cut off by a segment between the two edges where
+   the run starts and ends. That choice for ambiguous faces depends only
+   on the face itself, so neighboring cubes agree on it and the surface
+   has no holes. The segments are chained into loops, which are
+   triangulated as fans. Triangles are counter-clockwise seen from below
+   the isovalue */
+static const unsigned int mcTriMax = 5;  // most triangles in any case
+typedef struct {
+  unsigned char edgeCorner[12][2];
+  unsigned char triNum[256];
+  unsigned char tri[256][3*mcTriMax];
+} mcTable;
+
+static mcTable
+mcTableBuild() {
+  mcTable tab;
+  for (unsigned int ei=0; ei<12; ei++) {
+    unsigned int axis = ei/4, ci = 0, bit = 0;
+    /* ci is the ei%4-th corner with a 0 in the axis bit */
+    for (unsigned int cnt=0; ; ci++) {
+      if (!(ci & (1 << axis)) && cnt++ == ei % 4) {
+        break;
+      }
+    }
+    bit = 1 << axis;
+    tab.edgeCorner[ei][0] = ci;
+    tab.edgeCorner[ei][1] = ci | bit;
+  }
+  auto edgeOf = [&tab](unsigned int c0, unsigned int c1) {
+    for (unsigned int ei=0; ei<12; ei++) {
+      if ((tab.edgeCorner[ei][0] == c0 && tab.edgeCorner[ei][1] == c1)
+          || (tab.edgeCorner[ei][0] == c1 && tab.edgeCorner[ei][1] == c0)) {
+        return ei;
+      }
+    }
+    return 12u;
+  };
+  /* corners of each face, in order counter-clockwise seen from outside */
+  unsigned int face[6][4];
+  for (unsigned int fi=0; fi<6; fi++) {
+    unsigned int axis = fi/2, side = fi % 2;
+    unsigned int uu = (axis + 1) % 3, vv = (axis + 2) % 3;
+    unsigned int base = side << axis;
+    face[fi][0] = base;
+    face[fi][1] = base | (1 << uu);
+    face[fi][2] = base | (1 << uu) | (1 << vv);
+    face[fi][3] = base | (1 << vv);
+    /* (u, v, axis) is right-handed, so this is counter-clockwise seen
+       from +axis; reverse it for the face at side 0 */
+    if (!side) {
+      std::swap(face[fi][1], face[fi][3]);
+    }
+  }
+  for (unsigned int cc=0; cc<256; cc++) {
+    /* next[ei] is the edge following ei in its loop, if ei is crossed */
+    int next[12];
+    for (unsigned int ei=0; ei<12; ei++) {
+      next[ei] = -1;
+    }
+    for (unsigned int fi=0; fi<6; fi++) {
+      int enter = -1;
+      /* start just after an above corner preceded by a below one, if
+         any, so that each run's start is seen before its end */
+      unsigned int start = 0;
+      for (unsigned int ii=0; ii<4; ii++) {
+        if ((cc >> face[fi][ii] & 1) && !(cc >> face[fi][(ii + 3) % 4] & 1)) {
+          start = ii;
+          enter = edgeOf(face[fi][(ii + 3) % 4], face[fi][ii]);
+          break;
+        }
+      }
+      if (-1 == enter) {
+        continue;
+      }
+      for (unsigned int jj=0; jj<4; jj++) {
+        unsigned int c0 = face[fi][(start + jj) % 4];
+        unsigned int c1 = face[fi][(start + jj + 1) % 4];
+        bool in0 = cc >> c0 & 1, in1 = cc >> c1 & 1;
+        if (in0 && !in1) {
+          next[edgeOf(c0, c1)] = enter;
+        } else if (!in0 && in1) {
+          enter = edgeOf(c0, c1);
+        }
+      }
+    }
+    unsigned int tnum = 0;
+    for (unsigned int ei=0; ei<12; ei++) {
+      std::vector<unsigned int> loop;
+      for (int ej=ei; next[ej] >= 0; ) {
+        int ek = next[ej];
+        loop.push_back(ej);
+        next[ej] = -1;
+        ej = ek;
+      }
+      for (unsigned int li=1; li+1<loop.size(); li++) {
+        tab.tri[cc][3*tnum + 0] = loop[0];
+        tab.tri[cc][3*tnum + 1] = loop[li + 1];
+        tab.tri[cc][3*tnum + 2] = loop[li];
+        tnum++;
+      }
+    }
+    tab.triNum[cc] = tnum;
+  }
+  return tab;
+}
+
+static const mcTable &
+mcTableGet() {
+  /* (initialization of function statics is thread-safe) */
+  static const mcTable tab = mcTableBuild();
+  return tab;
+}
+
+/* in BrickOut::indx, marks an index into BrickOut::foreign */
+static const unsigned int foreignBit = 1u << 31;
+
+/* most surfaces extracted together: a sample's class (for which it
+   is ambiguous, in an unsigned short) can be any of them, or none */
+static const unsigned int surfMax = 65534;
+
+/* The kernels below read the volume in place, and are templated on its
+   C type T; values are compared and interpolated as float (exactly as if
+   the volume had been converted to float first) */
+
+/* bit ii of the return is set if dd[ii] > iso, for ii < num <= 64 */
+template<typename T> static uint64_t
+rowBits(const T *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  for (unsigned int ii=0; ii<num; ii++) {
+    bits |= static_cast<uint64_t>(static_cast<float>(dd[ii]) > iso) << ii;
+  }
+  return bits;
+}
+
+#if defined(__SSE2__)
+/* bits of which of the 8 (16-bit) values in vv are above viso; for
+   unsigned, the high halves of each 32 bits are zero, and for signed,
+   copies of the sign bit */
+static uint64_t
+bitsOf8(__m128i vv, __m128 viso, bool sgnd) {
+  __m128i lo, hi;
+  if (sgnd) {
+    lo = _mm_srai_epi32(_mm_unpacklo_epi16(vv, vv), 16);
+    hi = _mm_srai_epi32(_mm_unpackhi_epi16(vv, vv), 16);
+  } else {
+    lo = _mm_unpacklo_epi16(vv, _mm_setzero_si128());
+    hi = _mm_unpackhi_epi16(vv, _mm_setzero_si128());
+  }
+  return (_mm_movemask_ps(_mm_cmpgt_ps(_mm_cvtepi32_ps(lo), viso))
+          | _mm_movemask_ps(_mm_cmpgt_ps(_mm_cvtepi32_ps(hi), viso)) << 4);
+}
+#endif
+
+/* the types most volumes are, four (float) or eight (8- and 16-bit) at a
+   time with SSE2; 8- and 16-bit values are exact as 32-bit ints and as
+   float */
+static uint64_t
+rowBits(const float *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  unsigned int ii = 0;
+#if defined(__SSE2__)
+  const __m128 viso = _mm_set1_ps(iso);
+  for (; ii + 4 <= num; ii += 4) {
+    uint64_t mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(dd + ii), viso));
+    bits |= mask << ii;
+  }
+#endif
+  for (; ii < num; ii++) {
+    bits |= static_cast<uint64_t>(dd[ii] > iso) << ii;
+  }
+  return bits;
+}
+
+template<typename T> static uint64_t
+rowBitsShort(const T *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  unsigned int ii = 0;
+#if defined(__SSE2__)
+  const __m128 viso = _mm_set1_ps(iso);
+  for (; ii + 8 <= num; ii += 8) {
+    __m128i vv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dd + ii));
+    bits |= bitsOf8(vv, viso, std::numeric_limits<T>::is_signed) << ii;
+  }
+#endif
+  for (; ii < num; ii++) {
+    bits |= static_cast<uint64_t>(static_cast<float>(dd[ii]) > iso) << ii;
+  }
+  return bits;
+}
+static uint64_t
+rowBits(const unsigned short *dd, unsigned int num, float iso) {
+  return rowBitsShort(dd, num, iso);
+}
+static uint64_t
+rowBits(const short *dd, unsigned int num, float iso) {
+  return rowBitsShort(dd, num, iso);
+}
+
+template<typename T> static uint64_t
+rowBitsByte(const T *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  unsigned int ii = 0;
+#if defined(__SSE2__)
+  const __m128 viso = _mm_set1_ps(iso);
+  const bool sgnd = std::numeric_limits<T>::is_signed;
+  for (; ii + 8 <= num; ii += 8) {
+    /* widened to 16 bits, as above */
+    __m128i vv = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(dd + ii));
+    vv = (sgnd
+          ? _mm_srai_epi16(_mm_unpacklo_epi8(vv, vv), 8)
+          : _mm_unpacklo_epi8(vv, _mm_setzero_si128()));
+    bits |= bitsOf8(vv, viso, sgnd) << ii;
+  }
+#endif
+  for (; ii < num; ii++) {
+    bits |= static_cast<uint64_t>(static_cast<float>(dd[ii]) > iso) << ii;
+  }
+  return bits;
+}
+static uint64_t
+rowBits(const unsigned char *dd, unsigned int num, float iso) {
+  return rowBitsByte(dd, num, iso);
+}
+static uint64_t
+rowBits(const signed char *dd, unsigned int num, float iso) {
+  return rowBitsByte(dd, num, iso);
+}
+
+/* int and double, converted to float four at a time with SSE2 (rounding
+   as static_cast<float> does) */
+static uint64_t
+rowBits(const int *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  unsigned int ii = 0;
+#if defined(__SSE2__)
+  const __m128 viso = _mm_set1_ps(iso);
+  for (; ii + 4 <= num; ii += 4) {
+    __m128i vv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dd + ii));
+    uint64_t mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_cvtepi32_ps(vv), viso));
+    bits |= mask << ii;
+  }
+#endif
+  for (; ii < num; ii++) {
+    bits |= static_cast<uint64_t>(static_cast<float>(dd[ii]) > iso) << ii;
+  }
+  return bits;
+}
+static uint64_t
+rowBits(const double *dd, unsigned int num, float iso) {
+  uint64_t bits = 0;
+  unsigned int ii = 0;
+#if defined(__SSE2__)
+  const __m128 viso = _mm_set1_ps(iso);
+  for (; ii + 4 <= num; ii += 4) {
+    __m128 vv = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(dd + ii)),
+                              _mm_cvtpd_ps(_mm_loadu_pd(dd + ii + 2)));
+    uint64_t mask = _mm_movemask_ps(_mm_cmpgt_ps(vv, viso));
+    bits |= mask << ii;
+  }
+#endif
+  for (; ii < num; ii++) {
+    bits |= static_cast<uint64_t>(static_cast<float>(dd[ii]) > iso) << ii;
+  }
+  return bits;
+}
+
+/* sets the bits of which samples are above isovalue, one row (along the
+   fast axis) of the samples of cells [lo,hi) at a time */
+template<typename T> static void
+rowsOf(uint64_t *row, const T *data, const unsigned int size[3],
+       const unsigned int lo[3], const unsigned int hi[3], float isovalue) {
+  const size_t sx = size[0], sxy = sx*size[1];
+  const unsigned int nx = hi[0] - lo[0];
+  const unsigned int ny = hi[1] - lo[1] + 1, nz = hi[2] - lo[2] + 1;
+  for (unsigned int zi=0; zi<nz; zi++) {
+    for (unsigned int yi=0; yi<ny; yi++) {
+      row[yi + ny*zi] = rowBits(data + lo[0] + sx*(lo[1] + yi)
+                                + sxy*(lo[2] + zi), nx + 1, isovalue);
+    }
+  }
+}
+
+/* index-space gradient at sample ii, as for Isocontour::_gradient */
+template<typename T> static void
+gradientOf(float grad[3], const T *data, const unsigned int size[3],
+           const unsigned int ii[3], const float *label) {
+  const size_t stride[3] = {1, size[0], static_cast<size_t>(size[0])*size[1]};
+  const T *dd = data + ii[0] + stride[1]*ii[1] + stride[2]*ii[2];
+  auto val = [label](const T *vv) {
+    const float ff = static_cast<float>(*vv);
+    return label ? static_cast<float>(*label == ff) : ff;
+  };
+  for (unsigned int ai=0; ai<3; ai++) {
+    if (!ii[ai]) {
+      grad[ai] = val(dd + stride[ai]) - val(dd);
+    } else if (ii[ai] == size[ai] - 1) {
+      grad[ai] = val(dd) - val(dd - stride[ai]);
+    } else {
+      grad[ai] = (val(dd + stride[ai]) - val(dd - stride[ai]))/2;
+    }
+  }
+}
+
+/* values at the 8 corners of a cell, corner ci at (ci & 1, (ci >> 1) & 1,
+   (ci >> 2) & 1) */
+template<typename T> static void
+cornersOf(float cv[8], const T *data, const unsigned int size[3],
+          const unsigned int cell[3]) {
+  const size_t sx = size[0], sxy = sx*size[1];
+  const T *dd = data + cell[0] + sx*cell[1] + sxy*cell[2];
+  const size_t coff[8] = {0, 1, sx, 1 + sx, sxy, 1 + sxy, sx + sxy,
+                          1 + sx + sxy};
+  for (unsigned int ci=0; ci<8; ci++) {
+    cv[ci] = static_cast<float>(dd[coff[ci]]);
+  }
+}
+
+/* sets dst rows [start,stop) (along the slowest axis) to src (of size
+   ssz) filtered by [1,2,1]/4 along axis and subsampled by two */
+template<typename T> static void
+halveOf(float *dst, const T *src, const unsigned int ssz[3],
+        const unsigned int dsz[3], unsigned int axis,
+        unsigned int start, unsigned int stop) {
+  const size_t sstr[3] = {1, ssz[0], static_cast<size_t>(ssz[0])*ssz[1]};
+  const size_t step = sstr[axis];
+  for (unsigned int zi=start; zi<stop; zi++) {
+    for (unsigned int yi=0; yi<dsz[1]; yi++) {
+      float *dd = dst + dsz[0]*(yi + static_cast<size_t>(dsz[1])*zi);
+      for (unsigned int xi=0; xi<dsz[0]; xi++) {
+        unsigned int sc[3] = {xi, yi, zi};
+        unsigned int mid = 2*sc[axis];
+        unsigned int lo = mid ? mid - 1 : 0;
+        unsigned int hi = std::min(mid + 1, ssz[axis] - 1);
+        mid = std::min(mid, ssz[axis] - 1);
+        sc[axis] = 0;
+        const T *ss = src + sc[0] + sstr[1]*sc[1] + sstr[2]*sc[2];
+        dd[xi] = (static_cast<float>(ss[lo*step])
+                  + 2*static_cast<float>(ss[mid*step])
+                  + static_cast<float>(ss[hi*step]))/4;
+      }
+    }
+  }
+}
+
+/* adds to found the distinct (existent) values in [dd,end), returning
+   true if there were more than surfMax of them (when it stops looking) */
+template<typename T> static bool
+labelsOf(std::set<float> &found, const T *dd, const T *end) {
+  /* (labels come in runs, so most samples are the last one found) */
+  T last = 0;
+  for (; dd < end; dd++) {
+    if (!AIR_EXISTS(*dd)) {
+      continue;
+    }
+    if (found.empty() || *dd != last) {
+      found.insert(static_cast<float>(*dd));
+      last = *dd;
+      if (found.size() > surfMax) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* sets cls to the classes (indices into sorted value, or snum for none)
+   of the nx*ny*nz samples from lo, and adds those found to found */
+template<typename T> static void
+classesOf(unsigned short *cls, std::vector<unsigned short> &found,
+          const T *data, const unsigned int size[3],
+          const unsigned int lo[3], const unsigned int nn[3],
+          const std::vector<float> &value) {
+  const unsigned int snum = value.size();
+  const size_t sx = size[0], sxy = sx*size[1];
+  /* (labels come in runs, so most samples are the same as the last) */
+  float last = AIR_NAN;
+  unsigned int lastCls = snum;
+  for (unsigned int zi=0; zi<nn[2]; zi++) {
+    for (unsigned int yi=0; yi<nn[1]; yi++) {
+      const T *dd = data + lo[0] + sx*(lo[1] + yi) + sxy*(lo[2] + zi);
+      for (unsigned int xi=0; xi<nn[0]; xi++) {
+        const float vv = static_cast<float>(dd[xi]);
+        if (vv != last) {
+          /* (for a label listed more than once, the class is the first) */
+          last = vv;
+          lastCls = (std::lower_bound(value.begin(), value.end(), last)
+                     - value.begin());
+          if (lastCls == snum || value[lastCls] != last) {
+            lastCls = snum;
+          }
+          found.push_back(lastCls);
+        }
+        *cls++ = lastCls;
+      }
+    }
+  }
+}
+
+/* adds to hist the numbers of (non-NaN) values in [dd,end) in each of its
+   bins, spanning [mn,mx] */
+template<typename T> static void
+histOf(std::vector<size_t> &hist, const T *dd, const T *end, float mn,
+       float mx) {
+  const unsigned int bnum = hist.size();
+  const double scl = mx > mn ? bnum/(static_cast<double>(mx) - mn) : 0;
+  for (; dd < end; dd++) {
+    const float vv = static_cast<float>(*dd);
+    if (vv == vv) {
+      const double bb = scl*(vv - mn);
+      hist[bb < bnum ? static_cast<unsigned int>(bb) : bnum - 1]++;
+    }
+  }
+}
+
+Isocontour::Isocontour(const Nrrd *nin, unsigned int brickSize,
+                       unsigned int threadNum) {
+  static const std::string me="Hale::Isocontour::Isocontour";
+  if (!nin) {
+    throw std::runtime_error(me + ": got NULL nin");
+  }
+  if (3 != nin->dim) {
+    throw std::runtime_error(me + ": need 3-D volume (not "
+                             + std::to_string(nin->dim) + "-D)");
+  }
+  if (!(brickSize && brickSize < 64)) {
+    /* a row of brick samples has to fit in 64 bits */
+    throw std::runtime_error(me + ": need brick size in [1,63] (not "
+                             + std::to_string(brickSize) + ")");
+  }
+  TraceZone tzone("Hale::Isocontour::Isocontour");
+  gageShape *shape = gageShapeNew();
+  if (gageShapeSet(shape, nin, 0)) {
+    char *err = biffGetDone(GAGE);
+    std::string serr(err);
+    free(err);
+    gageShapeNix(shape);
+    throw std::runtime_error(me + ": trouble with volume orientation:\n"
+                             + serr);
+  }
+  memcpy(_ItoW, shape->ItoW, 16*sizeof(double));
+  memcpy(_WtoI, shape->WtoI, 16*sizeof(double));
+  memcpy(_ItoWSubInvTransp, shape->ItoWSubInvTransp, 9*sizeof(double));
+  gageShapeNix(shape);
+  _nflt = NULL;
+  if (_typeInPlace(nin->type)) {
+    _data = nin->data;
+    _type = nin->type;
+  } else {
+    _nflt = nrrdNew();
+    if (nrrdConvert(_nflt, nin, nrrdTypeFloat)) {
+      char *err = biffGetDone(NRRD);
+      std::string serr(err);
+      free(err);
+      nrrdNuke(_nflt);
+      throw std::runtime_error(me + ": trouble converting to float:\n"
+                               + serr);
+    }
+    _data = _nflt->data;
+    _type = nrrdTypeFloat;
+  }
+  for (unsigned int ai=0; ai<3; ai++) {
+    _size[ai] = nin->axis[ai].size;
+  }
+  try {
+    _index = new BrickIndex(_data, _type, _size, brickSize);
+  } catch (std::exception &ex) {
+    if (_nflt) {
+      nrrdNuke(_nflt);
+    }
+    throw std::runtime_error(me + ": " + ex.what());
+  }
+  _pool = new WorkerPool(threadNum, "isocontour");
+  _poolOwn = true;
+  _polyPool = NULL;
+  _verbose = 0;
+  /* so that it's built now rather than in the first extract() */
+  mcTableGet();
+}
+
+/* the next level down of a pyramid: coarse sample i is at fine sample 2i,
+   after a [1,2,1]/4 filter along each axis */
+Isocontour::Isocontour(const Isocontour *finer) {
+  static const std::string me="Hale::Isocontour::Isocontour";
+  const unsigned int *fsz = finer->_size;
+  if (!(fsz[0] >= 3 && fsz[1] >= 3 && fsz[2] >= 3)) {
+    throw std::runtime_error(me + ": volume ("
+                             + std::to_string(fsz[0]) + ","
+                             + std::to_string(fsz[1]) + ","
+                             + std::to_string(fsz[2])
+                             + ") too small to downsample");
+  }
+  TraceZone tzone("Hale::Isocontour::Isocontour", "coarser");
+  for (unsigned int ai=0; ai<3; ai++) {
+    _size[ai] = (fsz[ai] + 1)/2;
+  }
+  for (unsigned int ri=0; ri<4; ri++) {
+    for (unsigned int ci=0; ci<3; ci++) {
+      _ItoW[4*ri + ci] = 2*finer->_ItoW[4*ri + ci];
+    }
+    _ItoW[4*ri + 3] = finer->_ItoW[4*ri + 3];
+  }
+  /* coarse index is fine index/2 */
+  for (unsigned int ii=0; ii<16; ii++) {
+    _WtoI[ii] = finer->_WtoI[ii]/(ii < 12 ? 2 : 1);
+  }
+  for (unsigned int ii=0; ii<9; ii++) {
+    _ItoWSubInvTransp[ii] = finer->_ItoWSubInvTransp[ii]/2;
+  }
+  _pool = finer->_pool;
+  _poolOwn = false;
+  _polyPool = finer->_polyPool;
+  _verbose = finer->_verbose;
+  _nflt = nrrdNew();
+  if (nrrdAlloc_va(_nflt, nrrdTypeFloat, 3, static_cast<size_t>(_size[0]),
+                   static_cast<size_t>(_size[1]),
+                   static_cast<size_t>(_size[2]))) {
+    char *err = biffGetDone(NRRD);
+    std::string serr(err);
+    free(err);
+    nrrdNuke(_nflt);
+    throw std::runtime_error(me + ": couldn't allocate:\n" + serr);
+  }
+  _data = _nflt->data;
+  _type = nrrdTypeFloat;
+  /* one axis at a time */
+  unsigned int sz0[3] = {fsz[0], fsz[1], fsz[2]};
+  unsigned int sz1[3] = {_size[0], fsz[1], fsz[2]};
+  unsigned int sz2[3] = {_size[0], _size[1], fsz[2]};
+  std::vector<float> tmp1(static_cast<size_t>(sz1[0])*sz1[1]*sz1[2]);
+  std::vector<float> tmp2(static_cast<size_t>(sz2[0])*sz2[1]*sz2[2]);
+  _halve(tmp1.data(), finer->_data, finer->_type, sz0, 0);
+  _halve(tmp2.data(), tmp1.data(), nrrdTypeFloat, sz1, 1);
+  _halve(static_cast<float*>(_nflt->data), tmp2.data(), nrrdTypeFloat, sz2, 2);
+  _index = new BrickIndex(_data, _type, _size, finer->_index->brickSize());
+}
+
+Isocontour *Isocontour::coarser() const {
+  return new Isocontour(this);
+}
+
+void Isocontour::histogram(std::vector<size_t> &hist,
+                           unsigned int binNum) const {
+  static const std::string me="Hale::Isocontour::histogram";
+  if (!binNum) {
+    throw std::runtime_error(me + ": need non-zero number of bins");
+  }
+  TraceZone tzone(me.c_str());
+  const size_t sxy = static_cast<size_t>(_size[0])*_size[1];
+  const float mn = _index->min(), mx = _index->max();
+  hist.assign(binNum, 0);
+  std::mutex mutex;
+  _pool->parallel(_size[2], [&](unsigned int start, unsigned int stop) {
+      std::vector<size_t> part(binNum, 0);
+      HALE_TYPE_SWITCH(_type, T,
+                       const T *data = static_cast<const T*>(_data);
+                       histOf(part, data + sxy*start, data + sxy*stop,
+                              mn, mx));
+      std::lock_guard<std::mutex> lock(mutex);
+      for (unsigned int bi=0; bi<binNum; bi++) {
+        hist[bi] += part[bi];
+      }
+    });
+}
+
+double Isocontour::probe(const double wpos[3], double grad[3]) const {
+  double ipos[3];
+  bool inside = true;
+  for (unsigned int ai=0; ai<3; ai++) {
+    ipos[ai] = (_WtoI[4*ai + 0]*wpos[0] + _WtoI[4*ai + 1]*wpos[1]
+                + _WtoI[4*ai + 2]*wpos[2] + _WtoI[4*ai + 3]);
+    inside &= (0 <= ipos[ai] && ipos[ai] <= _size[ai] - 1);
+  }
+  if (!inside) {
+    if (grad) {
+      grad[0] = grad[1] = grad[2] = AIR_NAN;
+    }
+    return AIR_NAN;
+  }
+  /* the cell containing ipos, and where in it */
+  unsigned int cell[3];
+  double ff[3];
+  for (unsigned int ai=0; ai<3; ai++) {
+    cell[ai] = std::min(static_cast<unsigned int>(ipos[ai]), _size[ai] - 2);
+    ff[ai] = ipos[ai] - cell[ai];
+  }
+  float cv[8];
+  HALE_TYPE_SWITCH(_type, T, cornersOf(cv, static_cast<const T*>(_data),
+                                       _size, cell));
+  double val = 0, igrad[3] = {0, 0, 0};
+  for (unsigned int ci=0; ci<8; ci++) {
+    const double ww = ((ci & 1 ? ff[0] : 1 - ff[0])
+                       *(ci >> 1 & 1 ? ff[1] : 1 - ff[1])
+                       *(ci >> 2 ? ff[2] : 1 - ff[2]));
+    val += ww*cv[ci];
+    if (grad) {
+      float gg[3];
+      _gradient(gg, cell[0] + (ci & 1), cell[1] + (ci >> 1 & 1),
+                cell[2] + (ci >> 2));
+      for (unsigned int ai=0; ai<3; ai++) {
+        igrad[ai] += ww*gg[ai];
+      }
+    }
+  }
+  if (grad) {
+    for (unsigned int ai=0; ai<3; ai++) {
+      grad[ai] = (_ItoWSubInvTransp[3*ai + 0]*igrad[0]
+                  + _ItoWSubInvTransp[3*ai + 1]*igrad[1]
+                  + _ItoWSubInvTransp[3*ai + 2]*igrad[2]);
+    }
+  }
+  return val;
+}
+
+/* sets dst to src (of Nrrd type "type", and size ssz) filtered by
+   [1,2,1]/4 along axis and subsampled by two */
+void Isocontour::_halve(float *dst, const void *src, int type,
+                        const unsigned int ssz[3], unsigned int axis) const {
+  unsigned int dsz[3] = {ssz[0], ssz[1], ssz[2]};
+  dsz[axis] = (ssz[axis] + 1)/2;
+  _pool->parallel(dsz[2], [&](unsigned int start, unsigned int stop) {
+      HALE_TYPE_SWITCH(type, T, halveOf(dst, static_cast<const T*>(src), ssz,
+                                        dsz, axis, start, stop));
+    });
+}
+
+Isocontour::~Isocontour() {
+  if (_poolOwn) {
+    delete _pool;
+  }
+  delete _index;
+  if (_nflt) {
+    nrrdNuke(_nflt);
+  }
+}
+
+void Isocontour::verbose(int vv) { _verbose = vv; }
+int Isocontour::verbose() const { return _verbose; }
+const BrickIndex *Isocontour::index() const { return _index; }
+unsigned int Isocontour::threadNum() const { return _pool->threadNum(); }
+void Isocontour::polyPool(PolyPool *pp) { _polyPool = pp; }
+PolyPool *Isocontour::polyPool() const { return _polyPool; }
+
+/* index-space gradient at sample (xi,yi,zi), with central differences, or
+   one-sided ones on the boundary; of the data, or (if label) of the
+   indicator function of *label */
+void Isocontour::_gradient(float grad[3], unsigned int xi, unsigned int yi,
+                           unsigned int zi, const float *label) const {
+  const unsigned int ii[3] = {xi, yi, zi};
+  HALE_TYPE_SWITCH(_type, T, gradientOf(grad, static_cast<const T*>(_data),
+                                        _size, ii, label));
+}
+
+/* sets xyzw and norm to the vertex where the isovalue crosses edge (3*sample
+   index + axis), or with label, where the boundary of that label (taken to
+   be half-way along the edge) does */
+void Isocontour::_vertex(float xyzw[4], float norm[3], uint64_t edge,
+                         float isovalue, bool label) const {
+  const size_t sx = _size[0], sxy = sx*_size[1];
+  const unsigned int axis = edge % 3;
+  const uint64_t sidx = edge/3;
+  const unsigned int ss[3] = {static_cast<unsigned int>(sidx % sx),
+                              static_cast<unsigned int>(sidx % sxy / sx),
+                              static_cast<unsigned int>(sidx / sxy)};
+  const size_t step[3] = {1, sx, sxy};
+  float v0 = 0, v1 = 0;
+  HALE_TYPE_SWITCH(_type, T, const T *dd = static_cast<const T*>(_data) + sidx;
+                   v0 = static_cast<float>(dd[0]);
+                   v1 = static_cast<float>(dd[step[axis]]));
+  double tt = (label ? 0.5 : (isovalue - v0)/(v1 - v0));
+  double ipos[3] = {static_cast<double>(ss[0]), static_cast<double>(ss[1]),
+                    static_cast<double>(ss[2])};
+  ipos[axis] += tt;
+  unsigned int s1[3] = {ss[0], ss[1], ss[2]};
+  s1[axis]++;
+  float g0[3], g1[3];
+  _gradient(g0, ss[0], ss[1], ss[2], label ? &isovalue : NULL);
+  _gradient(g1, s1[0], s1[1], s1[2], label ? &isovalue : NULL);
+  double igrad[3];
+  for (unsigned int ai=0; ai<3; ai++) {
+    igrad[ai] = g0[ai] + tt*(g1[ai] - g0[ai]);
+  }
+  _world(xyzw, norm, ipos, igrad);
+}
+
+/* sets xyzw and norm from index-space position ipos and gradient igrad */
+void Isocontour::_world(float xyzw[4], float norm[3], const double ipos[3],
+                        const double igrad[3]) const {
+  double wgrad[3];
+  for (unsigned int ai=0; ai<3; ai++) {
+    xyzw[ai] = (_ItoW[4*ai + 0]*ipos[0] + _ItoW[4*ai + 1]*ipos[1]
+                + _ItoW[4*ai + 2]*ipos[2] + _ItoW[4*ai + 3]);
+    wgrad[ai] = (_ItoWSubInvTransp[3*ai + 0]*igrad[0]
+                 + _ItoWSubInvTransp[3*ai + 1]*igrad[1]
+                 + _ItoWSubInvTransp[3*ai + 2]*igrad[2]);
+  }
+  xyzw[3] = 1.0f;
+  /* normal points down the gradient */
+  double len = sqrt(wgrad[0]*wgrad[0] + wgrad[1]*wgrad[1]
+                    + wgrad[2]*wgrad[2]);
+  len = len ? -1/len : 0;
+  for (unsigned int ai=0; ai<3; ai++) {
+    norm[ai] = len*wgrad[ai];
+  }
+}
+
+/* sets the bits of which samples are above isovalue, one row (along the
+   fast axis) of the samples of cells [lo,hi) at a time */
+void Isocontour::_rows(uint64_t *row, const unsigned int lo[3],
+                       const unsigned int hi[3], float isovalue) const {
+  HALE_TYPE_SWITCH(_type, T, rowsOf(row, static_cast<const T*>(_data), _size,
+                                    lo, hi, isovalue));
+}
+
+/* the brick that owns edge: the one with the edge's first sample */
+unsigned int Isocontour::_owner(uint64_t edge) const {
+  const size_t sx = _size[0], sxy = sx*_size[1];
+  const uint64_t sidx = edge/3;
+  const unsigned int ss[3] = {static_cast<unsigned int>(sidx % sx),
+                              static_cast<unsigned int>(sidx % sxy / sx),
+                              static_cast<unsigned int>(sidx / sxy)};
+  const unsigned int bs = _index->brickSize();
+  unsigned int owner = 0;
+  for (unsigned int ai=3; ai-- > 0; ) {
+    owner = (owner*_index->brickNum(ai)
+             + std::min(ss[ai]/bs, _index->brickNum(ai) - 1));
+  }
+  return owner;
+}
+
+void Isocontour::_scratch(Scratch &scr) const {
+  const unsigned int bsz = _index->brickSize() + 1;
+  scr.row.resize(bsz*bsz);
+  scr.cls.resize(bsz*bsz*bsz);
+  scr.stamp.assign(3*bsz*bsz*bsz, 0);
+  scr.vert.resize(3*bsz*bsz*bsz);
+  scr.gen = 0;
+}
+
+/* marching cubes on the cells of brick bo.brick */
+void Isocontour::_brick(BrickOut &bo, float isovalue, Scratch &scr) const {
+  unsigned int lo[3], hi[3];
+  _index->cells(bo.brick, lo, hi);
+  _rows(scr.row.data(), lo, hi, isovalue);
+  _cells(bo, lo, hi, isovalue, false, scr);
+}
+
+/* marching cubes on cells [lo,hi) of brick bo.brick, given the sample
+   bits in scr.row (from _rows(), or of which samples have label). Vertices
+   are shared between cells via the edge cache in scr. Each edge of the
+   volume is owned by the brick that has its first sample in [lo,hi) (or
+   [lo,hi] for the last brick along an axis), and only its owner makes its
+   vertex; others refer to it via bo.foreign, and owned vertices that other
+   bricks may want (on the low faces) are listed in bo.face */
+void Isocontour::_cells(BrickOut &bo, const unsigned int lo[3],
+                        const unsigned int hi[3], float value, bool label,
+                        Scratch &scr) const {
+  const mcTable &tab = mcTableGet();
+  const unsigned int bsz = _index->brickSize() + 1;  // samples per brick
+  const size_t sx = _size[0], sxy = sx*_size[1];
+  /* numbers of cells, and of sample rows */
+  const unsigned int nx = hi[0] - lo[0];
+  const unsigned int ny = hi[1] - lo[1] + 1, nz = hi[2] - lo[2] + 1;
+  const uint64_t full = (64 == nx + 1 ? ~static_cast<uint64_t>(0)
+                         : (static_cast<uint64_t>(1) << (nx + 1)) - 1);
+  /* the edge cache is valid where stamp == gen, saving clearing it */
+  if (!++scr.gen) {
+    std::fill(scr.stamp.begin(), scr.stamp.end(), 0);
+    scr.gen = 1;
+  }
+  for (unsigned int zi=0; zi+1<nz; zi++) {
+    for (unsigned int yi=0; yi+1<ny; yi++) {
+      uint64_t r0 = scr.row[yi + ny*zi], r1 = scr.row[yi + 1 + ny*zi],
+        r2 = scr.row[yi + ny*(zi + 1)], r3 = scr.row[yi + 1 + ny*(zi + 1)];
+      if (!(r0 | r1 | r2 | r3) || full == (r0 & r1 & r2 & r3)) {
+        /* no cell in this row is crossed */
+        continue;
+      }
+      for (unsigned int xi=0; xi<nx; xi++) {
+        unsigned int cc = ((r0 >> xi & 3) | (r1 >> xi & 3) << 2
+                           | (r2 >> xi & 3) << 4 | (r3 >> xi & 3) << 6);
+        for (unsigned int ti=0; ti<3u*tab.triNum[cc]; ti++) {
+          unsigned int ei = tab.tri[cc][ti], axis = ei/4;
+          unsigned int c0 = tab.edgeCorner[ei][0];
+          unsigned int ll[3] = {xi + (c0 & 1), yi + (c0 >> 1 & 1),
+                                zi + (c0 >> 2)};
+          unsigned int slot = axis + 3*(ll[0] + bsz*(ll[1] + bsz*ll[2]));
+          if (scr.stamp[slot] != scr.gen) {
+            scr.stamp[slot] = scr.gen;
+            unsigned int ss[3] = {lo[0] + ll[0], lo[1] + ll[1], lo[2] + ll[2]};
+            uint64_t key = 3*(ss[0] + sx*ss[1] + sxy*ss[2]) + axis;
+            bool owned = true, low = false;
+            for (unsigned int ai=0; ai<3; ai++) {
+              owned &= (ss[ai] < hi[ai] || hi[ai] == _size[ai] - 1);
+              low |= (ai != axis && !ll[ai] && lo[ai]);
+            }
+            if (owned) {
+              scr.vert[slot] = bo.xyzw.size()/4;
+              bo.xyzw.resize(bo.xyzw.size() + 4);
+              bo.norm.resize(bo.norm.size() + 3);
+              _vertex(&bo.xyzw[bo.xyzw.size() - 4],
+                      &bo.norm[bo.norm.size() - 3], key, value, label);
+              if (low) {
+                bo.face.push_back(std::make_pair(key, scr.vert[slot]));
+              }
+            } else {
+              scr.vert[slot] = foreignBit | bo.foreign.size();
+              bo.foreign.push_back(key);
+            }
+          }
+          bo.indx.push_back(scr.vert[slot]);
+        }
+      }
+    }
+  }
+  std::sort(bo.face.begin(), bo.face.end());
+}
+
+bool Isocontour::extract(limnPolyData *lpld, double isovalue,
+                         std::function<bool()> abandon) const {
+  static const std::string me="Hale::Isocontour::extract";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL lpld");
+  }
+  TraceZone tzone(me.c_str(), isovalue);
+  return _extract(lpld, isovalue, 0, _index->brickNum(2), abandon);
+}
+
+bool Isocontour::extractNets(limnPolyData *lpld, double isovalue,
+                             std::function<bool()> abandon) const {
+  static const std::string me="Hale::Isocontour::extractNets";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL lpld");
+  }
+  TraceZone tzone(me.c_str(), isovalue);
+  return _extract(lpld, isovalue, 0, _index->brickNum(2), abandon, true);
+}
+
+bool Isocontour::extractSlab(limnPolyData *lpld, double isovalue,
+                             unsigned int zlo, unsigned int zhi,
+                             std::function<bool()> abandon) const {
+  static const std::string me="Hale::Isocontour::extractSlab";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL lpld");
+  }
+  if (!(zlo < zhi && zhi <= _index->brickNum(2))) {
+    throw std::runtime_error(me + ": brick layers [" + std::to_string(zlo)
+                             + "," + std::to_string(zhi) + ") not within [0,"
+                             + std::to_string(_index->brickNum(2)) + ")");
+  }
+  std::string detail;
+  if (traceEnabled()) {
+    detail = (std::to_string(isovalue) + " [" + std::to_string(zlo) + ","
+              + std::to_string(zhi) + ")");
+  }
+  TraceZone tzone(me.c_str(), detail.c_str());
+  return _extract(lpld, isovalue, zlo, zhi, abandon);
+}
+
+/* extract() of the bricks in layers [zlo,zhi), or with nets (of all
+   layers), extractNets() */
+bool Isocontour::_extract(limnPolyData *lpld, double isovalue,
+                          unsigned int zlo, unsigned int zhi,
+                          std::function<bool()> abandon, bool nets) const {
+  static const std::string me="Hale::Isocontour::extract";
+  /* everything is done in float, including finding bricks */
+  const float isof = static_cast<float>(isovalue);
+  const unsigned int bxy = _index->brickNum(0)*_index->brickNum(1);
+  std::vector<unsigned int> bricks;
+  _index->query(bricks, isof);
+  if (zlo || zhi < _index->brickNum(2)) {
+    bricks.erase(std::remove_if(bricks.begin(), bricks.end(),
+                                [bxy, zlo, zhi](unsigned int bi) {
+                                  return bi/bxy < zlo || bi/bxy >= zhi;
+                                }), bricks.end());
+  }
+  /* so that owners can be found by binary search, and so that we go
+     through memory in order */
+  std::sort(bricks.begin(), bricks.end());
+  /* (with the vectors of an earlier extract(), if there was one) */
+  std::vector<BrickOut> out;
+  {
+    std::lock_guard<std::mutex> lock(_spareMutex);
+    if (!_spareOut.empty()) {
+      out.swap(_spareOut.back());
+      _spareOut.pop_back();
+    }
+  }
+  out.resize(bricks.size());
+  std::atomic<bool> abandoned(false);
+  _pool->parallel(out.size(), [&](unsigned int start, unsigned int stop) {
+      Scratch scr;
+      _scratchGet(scr);
+      for (unsigned int ii=start; ii<stop && !abandoned; ii++) {
+        if (abandon && abandon()) {
+          abandoned = true;
+          break;
+        }
+        BrickOut &bo = out[ii];
+        bo.brick = bricks[ii];
+        bo.xyzw.clear();
+        bo.norm.clear();
+        bo.indx.clear();
+        bo.foreign.clear();
+        bo.face.clear();
+        if (nets) {
+          _netsBrick(bo, isof, scr);
+        } else {
+          _brick(bo, isof, scr);
+        }
+        if (bo.brick/bxy + 1 < zhi || zhi == _index->brickNum(2)) {
+          continue;
+        }
+        /* on the top of the slab, the vertices owned by the next slab's
+           bricks are made here as well */
+        std::vector<uint64_t> foreign;
+        std::vector<unsigned int> remap(bo.foreign.size());
+        for (unsigned int fi=0; fi<bo.foreign.size(); fi++) {
+          uint64_t key = bo.foreign[fi];
+          if (_owner(key)/bxy < zhi) {
+            remap[fi] = foreignBit | foreign.size();
+            foreign.push_back(key);
+          } else {
+            remap[fi] = bo.xyzw.size()/4;
+            bo.xyzw.resize(bo.xyzw.size() + 4);
+            bo.norm.resize(bo.norm.size() + 3);
+            _vertex(&bo.xyzw[bo.xyzw.size() - 4],
+                    &bo.norm[bo.norm.size() - 3], key, isof);
+          }
+        }
+        for (unsigned int &vi : bo.indx) {
+          if (vi & foreignBit) {
+            vi = remap[vi & ~foreignBit];
+          }
+        }
+        bo.foreign.swap(foreign);
+      }
+      _scratchPut(scr);
+    });
+  if (abandoned) {
+    if (_verbose) {
+      printf("%s: isovalue %g: abandoned\n", me.c_str(), isovalue);
+    }
+    _outPut(out);
+    return false;
+  }
+
+  _assemble(lpld, bricks, out);
+  if (_verbose) {
+    printf("%s: isovalue %g: %u of %u bricks: %u vertices, %u triangles\n",
+           me.c_str(), isovalue, static_cast<unsigned int>(bricks.size()),
+           _index->brickNum(), lpld->xyzwNum, lpld->indxNum/3);
+  }
+  _outPut(out);
+  return true;
+}
+
+/* sets lpld to the output of bricks (sorted), with out[ii] from
+   bricks[ii]: allocates it, copies each brick's part into place, and
+   stitches the bricks together by finding the vertices of edges owned by
+   other bricks */
+void Isocontour::_assemble(limnPolyData *lpld,
+                           const std::vector<unsigned int> &bricks,
+                           std::vector<BrickOut> &out) const {
+  static const std::string me="Hale::Isocontour::_assemble";
+  /* where each brick's output goes */
+  unsigned int vnum = 0, inum = 0;
+  for (BrickOut &bo : out) {
+    bo.vertStart = vnum;
+    bo.indxStart = inum;
+    vnum += bo.xyzw.size()/4;
+    inum += bo.indx.size();
+  }
+  if (_polyPool && _polyPool->owns(lpld)) {
+    /* (re-using lpld's arrays if they're big enough) */
+    _polyPool->size(lpld, vnum, inum);
+  } else {
+    if (limnPolyDataAlloc(lpld, 1 << limnPolyDataInfoNorm, vnum, inum, 1)) {
+      char *err = biffGetDone(LIMN);
+      std::string serr(err);
+      free(err);
+      throw std::runtime_error(me + ": couldn't allocate output:\n" + serr);
+    }
+    lpld->type[0] = limnPrimitiveTriangles;
+    lpld->icnt[0] = inum;
+  }
+  std::atomic<bool> lost(false);
+  _pool->parallel(out.size(), [&](unsigned int start, unsigned int stop) {
+      for (unsigned int ii=start; ii<stop; ii++) {
+        const BrickOut &bo = out[ii];
+        std::copy(bo.xyzw.begin(), bo.xyzw.end(),
+                  lpld->xyzw + 4*bo.vertStart);
+        std::copy(bo.norm.begin(), bo.norm.end(),
+                  lpld->norm + 3*bo.vertStart);
+        /* global index of each foreign vertex */
+        std::vector<unsigned int> fidx(bo.foreign.size(), 0);
+        for (unsigned int fi=0; fi<bo.foreign.size(); fi++) {
+          uint64_t key = bo.foreign[fi];
+          unsigned int owner = _owner(key);
+          std::vector<unsigned int>::const_iterator bit
+            = std::lower_bound(bricks.begin(), bricks.end(), owner);
+          const BrickOut *ob = (bit != bricks.end() && *bit == owner
+                                ? &out[bit - bricks.begin()] : NULL);
+          std::vector<std::pair<uint64_t, unsigned int> >::const_iterator fit;
+          if (ob) {
+            fit = std::lower_bound(ob->face.begin(), ob->face.end(),
+                                   std::make_pair(key, 0u));
+          }
+          if (!ob || fit == ob->face.end() || fit->first != key) {
+            lost = true;
+            continue;
+          }
+          fidx[fi] = ob->vertStart + fit->second;
+        }
+        unsigned int *indx = lpld->indx + bo.indxStart;
+        for (unsigned int vi : bo.indx) {
+          *indx++ = (vi & foreignBit
+                     ? fidx[vi & ~foreignBit] : bo.vertStart + vi);
+        }
+      }
+    });
+  if (lost) {
+    throw std::runtime_error(me + ": internal error: couldn't stitch bricks");
+  }
+}
+
+/* Surface Nets on the cells of brick bo.brick: each cell crossed by the
+   isosurface has one vertex, at the average of where the isosurface
+   crosses its edges, and each crossed edge of the volume has a quad (as
+   two triangles) joining the vertices of the four cells around it. The
+   cell with the edge's first sample makes the quad; of the others, those
+   in bricks below are referred to via bo.foreign (by 3*index of their
+   first sample, so that _owner() and _assemble() work as with marching
+   cubes), and owned vertices that bricks above may want are listed in
+   bo.face */
+void Isocontour::_netsBrick(BrickOut &bo, float isovalue, Scratch &scr) const {
+  const unsigned int bsz = _index->brickSize() + 1;  // samples per brick
+  unsigned int lo[3], hi[3];
+  _index->cells(bo.brick, lo, hi);
+  const size_t sx = _size[0], sxy = sx*_size[1];
+  /* numbers of cells, and of sample rows */
+  const unsigned int nc[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+  const unsigned int ny = nc[1] + 1, nz = nc[2] + 1;
+  _rows(scr.row.data(), lo, hi, isovalue);
+  const uint64_t full = (64 == nc[0] + 1 ? ~static_cast<uint64_t>(0)
+                         : (static_cast<uint64_t>(1) << (nc[0] + 1)) - 1);
+  if (!++scr.gen) {
+    std::fill(scr.stamp.begin(), scr.stamp.end(), 0);
+    scr.gen = 1;
+  }
+  /* the vertex cache has a slot for each cell in the brick, and for those
+     just below it (at -1 along some axis), which are foreign */
+  auto slotOf = [bsz](const int ll[3]) {
+    return (ll[0] + 1) + bsz*((ll[1] + 1) + bsz*(ll[2] + 1));
+  };
+  auto vertOf = [&](const int ll[3]) {
+    unsigned int slot = slotOf(ll);
+    if (scr.stamp[slot] != scr.gen) {
+      /* (owned cells around a crossed edge all have vertices already) */
+      scr.stamp[slot] = scr.gen;
+      scr.vert[slot] = foreignBit | bo.foreign.size();
+      bo.foreign.push_back(3*(lo[0] + ll[0] + sx*(lo[1] + ll[1])
+                              + sxy*(lo[2] + ll[2])));
+    }
+    return scr.vert[slot];
+  };
+  for (unsigned int zi=0; zi+1<nz; zi++) {
+    for (unsigned int yi=0; yi+1<ny; yi++) {
+      uint64_t r0 = scr.row[yi + ny*zi], r1 = scr.row[yi + 1 + ny*zi],
+        r2 = scr.row[yi + ny*(zi + 1)], r3 = scr.row[yi + 1 + ny*(zi + 1)];
+      if (!(r0 | r1 | r2 | r3) || full == (r0 & r1 & r2 & r3)) {
+        continue;
+      }
+      for (unsigned int xi=0; xi<nc[0]; xi++) {
+        unsigned int cc = ((r0 >> xi & 3) | (r1 >> xi & 3) << 2
+                           | (r2 >> xi & 3) << 4 | (r3 >> xi & 3) << 6);
+        if (!cc || 0xff == cc) {
+          continue;
+        }
+        const int ll[3] = {static_cast<int>(xi), static_cast<int>(yi),
+                           static_cast<int>(zi)};
+        const unsigned int cell[3] = {lo[0] + xi, lo[1] + yi, lo[2] + zi};
+        unsigned int slot = slotOf(ll);
+        scr.stamp[slot] = scr.gen;
+        scr.vert[slot] = bo.xyzw.size()/4;
+        bo.xyzw.resize(bo.xyzw.size() + 4);
+        bo.norm.resize(bo.norm.size() + 3);
+        _netsVertex(&bo.xyzw[bo.xyzw.size() - 4],
+                    &bo.norm[bo.norm.size() - 3], cell, cc, isovalue);
+        if ((xi + 1 == nc[0] && hi[0] < _size[0] - 1)
+            || (yi + 1 == nc[1] && hi[1] < _size[1] - 1)
+            || (zi + 1 == nc[2] && hi[2] < _size[2] - 1)) {
+          bo.face.push_back(std::make_pair(3*(cell[0] + sx*cell[1]
+                                              + sxy*cell[2]),
+                                           scr.vert[slot]));
+        }
+        /* the edges from the cell's first corner (corner 0) along each
+           axis; corner 1 << axis is at the other end */
+        for (unsigned int axis=0; axis<3; axis++) {
+          const unsigned int in0 = cc & 1, in1 = cc >> (1 << axis) & 1;
+          const unsigned int ab = (axis + 1) % 3, ac = (axis + 2) % 3;
+          if (in0 == in1 || !cell[ab] || !cell[ac]) {
+            continue;
+          }
+          int l1[3] = {ll[0], ll[1], ll[2]}, l2[3], l3[3];
+          l1[ab]--;
+          std::copy(l1, l1 + 3, l2);
+          l2[ac]--;
+          std::copy(ll, ll + 3, l3);
+          l3[ac]--;
+          /* going around the edge counter-clockwise, as seen from the far
+             end; triangles are counter-clockwise seen from below */
+          unsigned int quad[4] = {scr.vert[slot], vertOf(l1), vertOf(l2),
+                                  vertOf(l3)};
+          if (!in0) {
+            std::swap(quad[1], quad[3]);
+          }
+          const unsigned int tri[6] = {quad[0], quad[1], quad[2],
+                                       quad[0], quad[2], quad[3]};
+          bo.indx.insert(bo.indx.end(), tri, tri + 6);
+        }
+      }
+    }
+  }
+  std::sort(bo.face.begin(), bo.face.end());
+}
+
+/* sets xyzw and norm to the Surface Nets vertex of cell (with case cc):
+   at the average of the edge crossings, with the gradient there
+   trilinearly interpolated from those at the cell corners */
+void Isocontour::_netsVertex(float xyzw[4], float norm[3],
+                             const unsigned int cell[3], unsigned int cc,
+                             float isovalue) const {
+  const mcTable &tab = mcTableGet();
+  float cv[8];
+  HALE_TYPE_SWITCH(_type, T, cornersOf(cv, static_cast<const T*>(_data),
+                                       _size, cell));
+  double lpos[3] = {0, 0, 0};
+  unsigned int cnum = 0;
+  for (unsigned int ei=0; ei<12; ei++) {
+    const unsigned int c0 = tab.edgeCorner[ei][0], c1 = tab.edgeCorner[ei][1];
+    if ((cc >> c0 & 1) == (cc >> c1 & 1)) {
+      continue;
+    }
+    const double tt = (isovalue - cv[c0])/(cv[c1] - cv[c0]);
+    lpos[0] += (c0 & 1) + (0 == ei/4 ? tt : 0);
+    lpos[1] += (c0 >> 1 & 1) + (1 == ei/4 ? tt : 0);
+    lpos[2] += (c0 >> 2) + (2 == ei/4 ? tt : 0);
+    cnum++;
+  }
+  double ipos[3], igrad[3] = {0, 0, 0};
+  for (unsigned int ai=0; ai<3; ai++) {
+    lpos[ai] /= cnum;
+    ipos[ai] = cell[ai] + lpos[ai];
+  }
+  for (unsigned int ci=0; ci<8; ci++) {
+    float grad[3];
+    _gradient(grad, cell[0] + (ci & 1), cell[1] + (ci >> 1 & 1),
+              cell[2] + (ci >> 2));
+    const double ww = ((ci & 1 ? lpos[0] : 1 - lpos[0])
+                       *(ci >> 1 & 1 ? lpos[1] : 1 - lpos[1])
+                       *(ci >> 2 ? lpos[2] : 1 - lpos[2]));
+    for (unsigned int ai=0; ai<3; ai++) {
+      igrad[ai] += ww*grad[ai];
+    }
+  }
+  _world(xyzw, norm, ipos, igrad);
+}
+
+bool Isocontour::extract(const std::vector<limnPolyData*> &lpld,
+                         const std::vector<double> &isovalue,
+                         std::function<bool()> abandon) const {
+  return _extractMulti(lpld, isovalue, false, abandon);
+}
+
+bool Isocontour::extractLabels(const std::vector<limnPolyData*> &lpld,
+                               const std::vector<double> &label,
+                               std::function<bool()> abandon) const {
+  return _extractMulti(lpld, label, true, abandon);
+}
+
+void Isocontour::labels(std::vector<double> &label) const {
+  static const std::string me="Hale::Isocontour::labels";
+  TraceZone tzone(me.c_str());
+  const size_t sxy = static_cast<size_t>(_size[0])*_size[1];
+  std::set<float> all;
+  std::mutex mutex;
+  std::atomic<bool> many(false);
+  _pool->parallel(_size[2], [&](unsigned int start, unsigned int stop) {
+      std::set<float> found;
+      HALE_TYPE_SWITCH(_type, T,
+                       const T *data = static_cast<const T*>(_data);
+                       if (labelsOf(found, data + sxy*start,
+                                    data + sxy*stop)) {
+                         many = true;
+                       });
+      std::lock_guard<std::mutex> lock(mutex);
+      all.insert(found.begin(), found.end());
+    });
+  if (many || all.size() > surfMax) {
+    throw std::runtime_error(me + ": more than " + std::to_string(surfMax)
+                             + " distinct values; not a label volume?");
+  }
+  label.assign(all.begin(), all.end());
+}
+
+/* marching cubes on the cells of brick bo[0].brick, for all the surfaces
+   at (sorted) value, into bo[0] through bo[value.size() - 1], while its
+   samples are in cache. For isovalues, those within the brick's range are
+   done in turn. For labels, which can be many, each sample is classified
+   once, by which label (if any) it is, and each label found in the brick
+   has its sample bits made from that */
+void Isocontour::_brickMulti(BrickOut *bo, const std::vector<float> &value,
+                             bool label, Scratch &scr) const {
+  const unsigned int snum = value.size();
+  unsigned int lo[3], hi[3];
+  _index->cells(bo[0].brick, lo, hi);
+  if (!label) {
+    /* a brick has samples on both sides of isovalues in [min,max) */
+    const unsigned int ss0 = (std::lower_bound(value.begin(), value.end(),
+                                               _index->min(bo[0].brick))
+                              - value.begin());
+    const unsigned int ss1 = (std::lower_bound(value.begin(), value.end(),
+                                               _index->max(bo[0].brick))
+                              - value.begin());
+    for (unsigned int ss=ss0; ss<ss1; ss++) {
+      _rows(scr.row.data(), lo, hi, value[ss]);
+      _cells(bo[ss], lo, hi, value[ss], false, scr);
+    }
+    return;
+  }
+  /* numbers of samples along each axis */
+  const unsigned int nn[3] = {hi[0] - lo[0] + 1, hi[1] - lo[1] + 1,
+                              hi[2] - lo[2] + 1};
+  scr.found.clear();
+  HALE_TYPE_SWITCH(_type, T, classesOf(scr.cls.data(), scr.found,
+                                       static_cast<const T*>(_data), _size,
+                                       lo, nn, value));
+  std::sort(scr.found.begin(), scr.found.end());
+  scr.found.erase(std::unique(scr.found.begin(), scr.found.end()),
+                  scr.found.end());
+  if (scr.found.size() < 2) {
+    /* the whole brick is one label, or none */
+    return;
+  }
+  const unsigned int rnum = nn[1]*nn[2];
+  const unsigned short *cls = scr.cls.data();
+  for (unsigned int cc : scr.found) {
+    if (cc == snum) {
+      continue;
+    }
+    for (unsigned int ri=0; ri<rnum; ri++) {
+      uint64_t bits = 0;
+      for (unsigned int xi=0; xi<nn[0]; xi++) {
+        bits |= static_cast<uint64_t>(cls[xi + nn[0]*ri] == cc) << xi;
+      }
+      scr.row[ri] = bits;
+    }
+    /* all the surfaces for this label */
+    for (unsigned int ss=cc; ss<snum && value[ss] == value[cc]; ss++) {
+      _cells(bo[ss], lo, hi, value[ss], true, scr);
+    }
+  }
+}
+
+/* extract() of several surfaces, at isovalues or of labels */
+bool Isocontour::_extractMulti(const std::vector<limnPolyData*> &lpld,
+                               const std::vector<double> &value, bool label,
+                               std::function<bool()> abandon) const {
+  const std::string me = (label ? "Hale::Isocontour::extractLabels"
+                          : "Hale::Isocontour::extract");
+  if (lpld.size() != value.size()) {
+    throw std::runtime_error(me + ": got " + std::to_string(lpld.size())
+                             + " limnPolyDatas for "
+                             + std::to_string(value.size()) + " surfaces");
+  }
+  if (value.size() > surfMax) {
+    throw std::runtime_error(me + ": can't do more than "
+                             + std::to_string(surfMax) + " surfaces (not "
+                             + std::to_string(value.size()) + ")");
+  }
+  for (const limnPolyData *lp : lpld) {
+    if (!lp) {
+      throw std::runtime_error(me + ": got NULL lpld");
+    }
+  }
+  const unsigned int snum = value.size();
+  if (!snum) {
+    return true;
+  }
+  std::string detail;
+  if (traceEnabled()) {
+    detail = std::to_string(snum) + " surfaces";
+  }
+  TraceZone tzone(me.c_str(), detail.c_str());
+  /* the surfaces, by increasing value (which converting to float keeps) */
+  std::vector<unsigned int> order(snum);
+  for (unsigned int ss=0; ss<snum; ss++) {
+    order[ss] = ss;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&value](unsigned int aa, unsigned int bb) {
+                     return value[aa] < value[bb];
+                   });
+  std::vector<float> valf(snum);
+  for (unsigned int ss=0; ss<snum; ss++) {
+    valf[ss] = static_cast<float>(value[order[ss]]);
+  }
+  /* every brick that any surface may pass through, once */
+  std::vector<unsigned int> bricks;
+  for (float vv : valf) {
+    _index->query(bricks, vv);
+  }
+  std::sort(bricks.begin(), bricks.end());
+  bricks.erase(std::unique(bricks.begin(), bricks.end()), bricks.end());
+  /* out[ss + snum*ii] is from surface ss in brick bricks[ii] */
+  std::vector<BrickOut> out;
+  {
+    std::lock_guard<std::mutex> lock(_spareMutex);
+    if (!_spareOut.empty()) {
+      out.swap(_spareOut.back());
+      _spareOut.pop_back();
+    }
+  }
+  out.resize(static_cast<size_t>(snum)*bricks.size());
+  std::atomic<bool> abandoned(false);
+  _pool->parallel(bricks.size(), [&](unsigned int start, unsigned int stop) {
+      Scratch scr;
+      _scratchGet(scr);
+      for (unsigned int ii=start; ii<stop && !abandoned; ii++) {
+        if (abandon && abandon()) {
+          abandoned = true;
+          break;
+        }
+        BrickOut *bo = &out[static_cast<size_t>(snum)*ii];
+        for (unsigned int ss=0; ss<snum; ss++) {
+          bo[ss].brick = bricks[ii];
+          bo[ss].xyzw.clear();
+          bo[ss].norm.clear();
+          bo[ss].indx.clear();
+          bo[ss].foreign.clear();
+          bo[ss].face.clear();
+        }
+        _brickMulti(bo, valf, label, scr);
+      }
+      _scratchPut(scr);
+    });
+  if (abandoned) {
+    if (_verbose) {
+      printf("%s: %u surfaces: abandoned\n", me.c_str(), snum);
+    }
+    _outPut(out);
+    return false;
+  }
+
+  /* each surface is put together from its part of every brick */
+  std::vector<BrickOut> sout(bricks.size());
+  for (unsigned int ss=0; ss<snum; ss++) {
+    for (unsigned int ii=0; ii<bricks.size(); ii++) {
+      std::swap(sout[ii], out[ss + static_cast<size_t>(snum)*ii]);
+    }
+    limnPolyData *lp = lpld[order[ss]];
+    _assemble(lp, bricks, sout);
+    for (unsigned int ii=0; ii<bricks.size(); ii++) {
+      std::swap(sout[ii], out[ss + static_cast<size_t>(snum)*ii]);
+    }
+    if (_verbose) {
+      printf("%s: %s %g: %u vertices, %u triangles\n", me.c_str(),
+             label ? "label" : "isovalue", valf[ss], lp->xyzwNum,
+             lp->indxNum/3);
+    }
+  }
+  if (_verbose) {
+    printf("%s: %u surfaces from %u of %u bricks\n", me.c_str(), snum,
+           static_cast<unsigned int>(bricks.size()), _index->brickNum());
+  }
+  _outPut(out);
+  return true;
+}
+
+/* extract()'s working space, kept for the next one */
+void Isocontour::_outPut(std::vector<BrickOut> &out) const {
+  std::lock_guard<std::mutex> lock(_spareMutex);
+  _spareOut.push_back(std::vector<BrickOut>());
+  _spareOut.back().swap(out);
+}
+
+void Isocontour::_scratchGet(Scratch &scr) const {
+  {
+    std::lock_guard<std::mutex> lock(_spareMutex);
+    if (!_spareScratch.empty()) {
+      scr = std::move(_spareScratch.back());
+      _spareScratch.pop_back();
+    }
+  }
+  _scratch(scr);
+}
+
+void Isocontour::_scratchPut(Scratch &scr) const {
+  std::lock_guard<std::mutex> lock(_spareMutex);
+  _spareScratch.push_back(std::move(scr));
+}
+
+/* what update() keeps of each brick, which has its own place in the
+   limnPolyData: vertices and triangles each have a slot there that they
+   keep while they exist, so that what didn't change isn't rewritten */
+struct Isocontour::Incremental {
+  typedef struct {
+    unsigned int brick;
+    std::vector<uint64_t> row;          // sample bits at the last update
+                                        //   (empty if it wasn't active)
+    std::vector<unsigned char> cases;   // per cell, 0 if not active
+    /* vertex slot of each owned crossed edge, by edge within the brick
+       (as in Scratch) */
+    std::unordered_map<unsigned int, unsigned int> vert;
+    std::vector<unsigned int> cellTri,  // first triangle slot of each cell
+      triNext,                          // next one of the same cell
+      vertFree, triFree;                // slots that can be re-used
+    unsigned int vertHigh, triHigh,     // slots ever used
+      vertCap, triCap,                  // size of its place
+      vertStart, triStart;              // where its place starts
+    /* what this update changed: whether the place is new (so it all has
+       to be written), whether all triangles have to be rewritten (as a
+       neighbor moved), triangles that went away, and new ones (with
+       mcTriMax*cell + which triangle of the cell's case) */
+    bool fresh, rewrite;
+    std::vector<unsigned int> triDead;
+    std::vector<std::pair<unsigned int, unsigned int> > triNew;
+  } Slot;
+  const limnPolyData *lpld;             // what slot describes, or NULL
+  std::vector<unsigned int> slotOf;     // per brick: index into slot
+  std::vector<Slot> slot;
+  unsigned int vertUsed, triUsed;       // the rest of lpld is spare room
+};
+
+/* in Incremental::slotOf, for bricks without a place; in cellTri and
+   triNext, for no triangle */
+static const unsigned int slotNone = ~0u;
+
+Isocontour::Incremental *Isocontour::incrementalNew() const {
+  Incremental *inc = new Incremental;
+  inc->lpld = NULL;
+  return inc;
+}
+
+void Isocontour::incrementalNix(Incremental *inc) {
+  delete inc;
+}
+
+bool Isocontour::update(limnPolyData *lpld, double isovalue, Incremental *inc,
+                        std::vector<std::pair<unsigned int,
+                                              unsigned int> > *vert,
+                        std::vector<std::pair<unsigned int,
+                                              unsigned int> > *indx) const {
+  static const std::string me="Hale::Isocontour::update";
+  if (!(lpld && inc && vert && indx)) {
+    throw std::runtime_error(me + ": got NULL pointer");
+  }
+  TraceZone tzone("Hale::Isocontour::update", isovalue);
+  const mcTable &tab = mcTableGet();
+  const float isof = static_cast<float>(isovalue);
+  const unsigned int bsz = _index->brickSize() + 1;  // samples per brick
+  const size_t sx = _size[0], sxy = sx*_size[1];
+  std::vector<unsigned int> bricks;
+  _index->query(bricks, isof);
+  std::sort(bricks.begin(), bricks.end());
+  /* start over if this isn't what inc last saw, or if most places are
+     going unused */
+  bool fresh = (inc->lpld != lpld
+                || inc->slotOf.size() != _index->brickNum()
+                || inc->slot.size() > 2*bricks.size() + 16);
+
+  /* sets up a slot for a brick, without a place yet */
+  auto slotAdd = [&](unsigned int brick) {
+    unsigned int lo[3], hi[3];
+    _index->cells(brick, lo, hi);
+    inc->slotOf[brick] = inc->slot.size();
+    inc->slot.resize(inc->slot.size() + 1);
+    Incremental::Slot &sl = inc->slot.back();
+    sl.brick = brick;
+    sl.cases.assign((hi[0] - lo[0])*(hi[1] - lo[1])*(hi[2] - lo[2]), 0);
+    sl.cellTri.assign(sl.cases.size(), slotNone);
+    sl.vertHigh = sl.triHigh = 0;
+    sl.vertCap = sl.triCap = 0;
+    sl.vertStart = sl.triStart = 0;
+    sl.fresh = true;
+    sl.rewrite = false;
+  };
+  /* the edge of edge ei of cell (xi,yi,zi), relative to lo; sets *owned
+     and *lid (the edge within the brick) */
+  auto cellEdge = [&](const unsigned int lo[3], const unsigned int hi[3],
+                      unsigned int xi, unsigned int yi, unsigned int zi,
+                      unsigned int ei, bool *owned, unsigned int *lid) {
+    unsigned int axis = ei/4, c0 = tab.edgeCorner[ei][0];
+    unsigned int ll[3] = {xi + (c0 & 1), yi + (c0 >> 1 & 1), zi + (c0 >> 2)};
+    unsigned int ss[3] = {lo[0] + ll[0], lo[1] + ll[1], lo[2] + ll[2]};
+    *owned = true;
+    for (unsigned int ai=0; ai<3; ai++) {
+      *owned &= (ss[ai] < hi[ai] || hi[ai] == _size[ai] - 1);
+    }
+    *lid = axis + 3*(ll[0] + bsz*(ll[1] + bsz*ll[2]));
+    return 3*(ss[0] + sx*ss[1] + sxy*ss[2]) + axis;
+  };
+  /* brings the slot's vertices and triangles up to date with the
+     isovalue, noting which triangles went away and which are new */
+  auto advance = [&](Incremental::Slot &sl, Scratch &scr) {
+    unsigned int lo[3], hi[3];
+    _index->cells(sl.brick, lo, hi);
+    const unsigned int nx = hi[0] - lo[0], ny = hi[1] - lo[1],
+      nz = hi[2] - lo[2];
+    const size_t rnum = (ny + 1)*(nz + 1);
+    sl.triDead.clear();
+    sl.triNew.clear();
+    const bool active = std::binary_search(bricks.begin(), bricks.end(),
+                                           sl.brick);
+    if (active) {
+      _rows(scr.row.data(), lo, hi, isof);
+      if (sl.row.size() == rnum
+          && std::equal(sl.row.begin(), sl.row.end(), scr.row.begin())) {
+        /* same cases in every cell: same triangles, moved vertices */
+        return;
+      }
+    } else {
+      if (sl.row.empty()) {
+        return;
+      }
+      std::fill(scr.row.begin(), scr.row.begin() + rnum, 0);
+    }
+    const uint64_t *row = scr.row.data();
+    const uint64_t *old = (sl.row.size() == rnum ? sl.row.data() : NULL);
+    auto above = [&](unsigned int xi, unsigned int yi, unsigned int zi) {
+      return row[yi + (ny + 1)*zi] >> xi & 1;
+    };
+    /* free the vertices of edges no longer crossed */
+    for (auto it = sl.vert.begin(); it != sl.vert.end(); ) {
+      unsigned int axis = it->first % 3, ll = it->first/3;
+      unsigned int l0[3] = {ll % bsz, ll/bsz % bsz, ll/(bsz*bsz)};
+      unsigned int l1[3] = {l0[0], l0[1], l0[2]};
+      l1[axis]++;
+      if (above(l0[0], l0[1], l0[2]) != above(l1[0], l1[1], l1[2])) {
+        ++it;
+      } else {
+        sl.vertFree.push_back(it->second);
+        it = sl.vert.erase(it);
+      }
+    }
+    /* new triangles (and vertices) for the cells whose case changed */
+    for (unsigned int zi=0; zi<nz; zi++) {
+      for (unsigned int yi=0; yi<ny; yi++) {
+        const unsigned int ri[4] = {yi + (ny + 1)*zi, yi + 1 + (ny + 1)*zi,
+                                    yi + (ny + 1)*(zi + 1),
+                                    yi + 1 + (ny + 1)*(zi + 1)};
+        if (old && row[ri[0]] == old[ri[0]] && row[ri[1]] == old[ri[1]]
+            && row[ri[2]] == old[ri[2]] && row[ri[3]] == old[ri[3]]) {
+          continue;
+        }
+        for (unsigned int xi=0; xi<nx; xi++) {
+          unsigned int ci = xi + nx*(yi + ny*zi);
+          unsigned int cc = ((row[ri[0]] >> xi & 3)
+                             | (row[ri[1]] >> xi & 3) << 2
+                             | (row[ri[2]] >> xi & 3) << 4
+                             | (row[ri[3]] >> xi & 3) << 6);
+          if (cc == sl.cases[ci]) {
+            continue;
+          }
+          sl.cases[ci] = cc;
+          for (unsigned int ti=sl.cellTri[ci]; slotNone != ti;
+               ti=sl.triNext[ti]) {
+            sl.triDead.push_back(ti);
+            sl.triFree.push_back(ti);
+          }
+          sl.cellTri[ci] = slotNone;
+          for (unsigned int ti=0; ti<3u*tab.triNum[cc]; ti++) {
+            bool owned;
+            unsigned int lid;
+            cellEdge(lo, hi, xi, yi, zi, tab.tri[cc][ti], &owned, &lid);
+            if (owned && !sl.vert.count(lid)) {
+              unsigned int vs;
+              if (sl.vertFree.empty()) {
+                vs = sl.vertHigh++;
+              } else {
+                vs = sl.vertFree.back();
+                sl.vertFree.pop_back();
+              }
+              sl.vert[lid] = vs;
+            }
+          }
+          /* the cell's triangles are chained last to first */
+          for (unsigned int tt=0; tt<tab.triNum[cc]; tt++) {
+            unsigned int ts;
+            if (sl.triFree.empty()) {
+              ts = sl.triHigh++;
+              sl.triNext.push_back(slotNone);
+            } else {
+              ts = sl.triFree.back();
+              sl.triFree.pop_back();
+            }
+            sl.triNext[ts] = sl.cellTri[ci];
+            sl.cellTri[ci] = ts;
+            sl.triNew.push_back(std::make_pair(ts, mcTriMax*ci + tt));
+          }
+        }
+      }
+    }
+    if (active) {
+      sl.row.assign(row, row + rnum);
+    } else {
+      sl.row.clear();
+    }
+  };
+  auto advanceAll = [&]() {
+    _pool->parallel(inc->slot.size(),
+                    [&](unsigned int start, unsigned int stop) {
+        Scratch scr;
+        _scratch(scr);
+        for (unsigned int si=start; si<stop; si++) {
+          advance(inc->slot[si], scr);
+        }
+      });
+  };
+  /* gives a slot a place in the spare room, with some room to grow (more
+     for one that has already outgrown a place) */
+  auto place = [&](Incremental::Slot &sl, unsigned int grow) {
+    sl.vertCap = sl.vertHigh + sl.vertHigh/grow + 4;
+    sl.triCap = sl.triHigh + sl.triHigh/grow + 4;
+    sl.vertStart = inc->vertUsed;
+    sl.triStart = inc->triUsed;
+    inc->vertUsed += sl.vertCap;
+    inc->triUsed += sl.triCap;
+  };
+
+  /* changed ranges, before sorting and merging */
+  std::vector<std::pair<unsigned int, unsigned int> > vdirty, idirty;
+  if (!fresh) {
+    unsigned int first = inc->slot.size();
+    for (unsigned int bi : bricks) {
+      if (slotNone == inc->slotOf[bi]) {
+        slotAdd(bi);
+      }
+    }
+    for (unsigned int si=0; si<first; si++) {
+      inc->slot[si].fresh = inc->slot[si].rewrite = false;
+    }
+    advanceAll();
+    /* bricks that just became active, or that outgrew their place, get a
+       (new) place in the spare room. Moving a brick's vertices means
+       rewriting the triangles of its neighbors, which may refer to them;
+       the old place is left with degenerate triangles */
+    for (Incremental::Slot &sl : inc->slot) {
+      if (!sl.fresh && sl.vertHigh <= sl.vertCap && sl.triHigh <= sl.triCap) {
+        continue;
+      }
+      if (!sl.fresh) {
+        std::fill(lpld->indx + 3*sl.triStart,
+                  lpld->indx + 3*(sl.triStart + sl.triCap), sl.vertStart);
+        idirty.push_back(std::make_pair(3*sl.triStart, 3*sl.triCap));
+        unsigned int bc[3] = {sl.brick % _index->brickNum(0),
+                              sl.brick / _index->brickNum(0)
+                              % _index->brickNum(1),
+                              sl.brick / (_index->brickNum(0)
+                                          *_index->brickNum(1))};
+        for (int dz=-1; dz<=1; dz++) {
+          for (int dy=-1; dy<=1; dy++) {
+            for (int dx=-1; dx<=1; dx++) {
+              int nc[3] = {static_cast<int>(bc[0]) + dx,
+                           static_cast<int>(bc[1]) + dy,
+                           static_cast<int>(bc[2]) + dz};
+              bool inside = true;
+              for (unsigned int ai=0; ai<3; ai++) {
+                inside &= (nc[ai] >= 0 && nc[ai] < static_cast<int>(
+                             _index->brickNum(ai)));
+              }
+              unsigned int ns = (inside
+                                 ? inc->slotOf[nc[0] + _index->brickNum(0)
+                                               *(nc[1] + _index->brickNum(1)
+                                                 *nc[2])]
+                                 : slotNone);
+              if (slotNone != ns) {
+                inc->slot[ns].rewrite = true;
+              }
+            }
+          }
+        }
+      }
+      place(sl, sl.fresh ? 4 : 2);
+      sl.fresh = true;
+    }
+    /* or start over, if there isn't room */
+    fresh = (inc->vertUsed > lpld->xyzwNum || 3*inc->triUsed > lpld->indxNum);
+  }
+  if (fresh) {
+    inc->lpld = NULL;
+    inc->slot.clear();
+    inc->slotOf.assign(_index->brickNum(), slotNone);
+    for (unsigned int bi : bricks) {
+      slotAdd(bi);
+    }
+    advanceAll();
+    inc->vertUsed = inc->triUsed = 0;
+    for (Incremental::Slot &sl : inc->slot) {
+      place(sl, 4);
+    }
+    /* with spare room for bricks that become active, or grow */
+    unsigned int vnum = inc->vertUsed + inc->vertUsed/4 + 64,
+      tnum = inc->triUsed + inc->triUsed/4 + 64;
+    if (limnPolyDataAlloc(lpld, 1 << limnPolyDataInfoNorm, vnum, 3*tnum, 1)) {
+      char *err = biffGetDone(LIMN);
+      std::string serr(err);
+      free(err);
+      throw std::runtime_error(me + ": couldn't allocate output:\n" + serr);
+    }
+    lpld->type[0] = limnPrimitiveTriangles;
+    lpld->icnt[0] = 3*tnum;
+    inc->lpld = lpld;
+  }
+
+  /* into lpld: all vertices (which all move), and the triangles that
+     changed (unused ones are degenerate); vertices are found by their
+     edge in the place of the brick owning it */
+  std::atomic<bool> lost(false);
+  std::vector<std::vector<unsigned int> > triDirty(inc->slot.size());
+  _pool->parallel(inc->slot.size(),
+                  [&](unsigned int start, unsigned int stop) {
+      auto resolve = [&](uint64_t key) {
+        uint64_t sidx = key/3;
+        unsigned int os = inc->slotOf[_owner(key)];
+        if (slotNone == os) {
+          lost = true;
+          return 0u;
+        }
+        const Incremental::Slot &osl = inc->slot[os];
+        unsigned int olo[3], ohi[3];
+        _index->cells(osl.brick, olo, ohi);
+        unsigned int ll[3] = {
+          static_cast<unsigned int>(sidx % sx) - olo[0],
+          static_cast<unsigned int>(sidx % sxy / sx) - olo[1],
+          static_cast<unsigned int>(sidx / sxy) - olo[2]};
+        std::unordered_map<unsigned int, unsigned int>::const_iterator vit
+          = osl.vert.find(key % 3 + 3*(ll[0] + bsz*(ll[1] + bsz*ll[2])));
+        if (osl.vert.end() == vit) {
+          lost = true;
+          return 0u;
+        }
+        return osl.vertStart + vit->second;
+      };
+      for (unsigned int si=start; si<stop; si++) {
+        Incremental::Slot &sl = inc->slot[si];
+        unsigned int lo[3], hi[3];
+        _index->cells(sl.brick, lo, hi);
+        const unsigned int nx = hi[0] - lo[0], ny = hi[1] - lo[1];
+        float *xyzw = lpld->xyzw + 4*sl.vertStart;
+        float *norm = lpld->norm + 3*sl.vertStart;
+        unsigned int *tidx = lpld->indx + 3*sl.triStart;
+        /* sets the indices of triangle tt of cell ci in slot ts */
+        auto triangle = [&](unsigned int ts, unsigned int ci,
+                            unsigned int tt) {
+          unsigned int cc = sl.cases[ci];
+          for (unsigned int vi=0; vi<3; vi++) {
+            bool owned;
+            unsigned int lid;
+            uint64_t key = cellEdge(lo, hi, ci % nx, ci/nx % ny, ci/(nx*ny),
+                                    tab.tri[cc][3*tt + vi], &owned, &lid);
+            tidx[3*ts + vi] = (owned ? sl.vertStart + sl.vert.find(lid)->second
+                               : resolve(key));
+          }
+        };
+        for (const std::pair<const unsigned int, unsigned int> &vv : sl.vert) {
+          unsigned int ll = vv.first/3;
+          unsigned int ss[3] = {lo[0] + ll % bsz, lo[1] + ll/bsz % bsz,
+                                lo[2] + ll/(bsz*bsz)};
+          _vertex(xyzw + 4*vv.second, norm + 3*vv.second,
+                  3*(ss[0] + sx*ss[1] + sxy*ss[2]) + vv.first % 3, isof);
+        }
+        const unsigned int degen = sl.vertStart;
+        if (sl.fresh) {
+          /* unused vertices repeat a used one (or the first sample) */
+          float pxyzw[4] = {0, 0, 0, 1}, pnorm[3] = {0, 0, 0};
+          if (!sl.vert.empty()) {
+            unsigned int vi = sl.vert.begin()->second;
+            std::copy(xyzw + 4*vi, xyzw + 4*vi + 4, pxyzw);
+            std::copy(norm + 3*vi, norm + 3*vi + 3, pnorm);
+          } else {
+            for (unsigned int ai=0; ai<3; ai++) {
+              pxyzw[ai] = (_ItoW[4*ai + 0]*lo[0] + _ItoW[4*ai + 1]*lo[1]
+                           + _ItoW[4*ai + 2]*lo[2] + _ItoW[4*ai + 3]);
+            }
+          }
+          std::vector<bool> used(sl.vertCap, false);
+          for (const std::pair<const unsigned int, unsigned int> &vv
+                 : sl.vert) {
+            used[vv.second] = true;
+          }
+          for (unsigned int vi=0; vi<sl.vertCap; vi++) {
+            if (!used[vi]) {
+              std::copy(pxyzw, pxyzw + 4, xyzw + 4*vi);
+              std::copy(pnorm, pnorm + 3, norm + 3*vi);
+            }
+          }
+          std::fill(tidx, tidx + 3*sl.triCap, degen);
+        }
+        std::vector<unsigned int> &dirty = triDirty[si];
+        if (sl.fresh || sl.rewrite) {
+          /* all the triangles */
+          for (unsigned int ts : sl.triFree) {
+            std::fill(tidx + 3*ts, tidx + 3*ts + 3, degen);
+          }
+          for (unsigned int ci=0; ci<sl.cases.size(); ci++) {
+            unsigned int tt = tab.triNum[sl.cases[ci]];
+            for (unsigned int ts=sl.cellTri[ci]; slotNone != ts;
+                 ts=sl.triNext[ts]) {
+              triangle(ts, ci, --tt);
+            }
+          }
+          continue;
+        }
+        for (unsigned int ts : sl.triDead) {
+          std::fill(tidx + 3*ts, tidx + 3*ts + 3, degen);
+          dirty.push_back(ts);
+        }
+        for (const std::pair<unsigned int, unsigned int> &tn : sl.triNew) {
+          triangle(tn.first, tn.second/mcTriMax, tn.second % mcTriMax);
+          dirty.push_back(tn.first);
+        }
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+      }
+    });
+  if (lost) {
+    throw std::runtime_error(me + ": internal error: couldn't stitch bricks");
+  }
+  if (fresh) {
+    /* the spare room: more copies of the first vertex, and degenerate
+       triangles */
+    for (unsigned int vi=inc->vertUsed; vi<lpld->xyzwNum; vi++) {
+      std::copy(lpld->xyzw, lpld->xyzw + 4, lpld->xyzw + 4*vi);
+      std::copy(lpld->norm, lpld->norm + 3, lpld->norm + 3*vi);
+    }
+    std::fill(lpld->indx + 3*inc->triUsed, lpld->indx + lpld->indxNum, 0);
+  }
+
+  vert->clear();
+  indx->clear();
+  unsigned int triChanged = 0;
+  if (fresh) {
+    vert->push_back(std::make_pair(0u, lpld->xyzwNum));
+    indx->push_back(std::make_pair(0u, lpld->indxNum));
+  } else {
+    for (unsigned int si=0; si<inc->slot.size(); si++) {
+      const Incremental::Slot &sl = inc->slot[si];
+      if (sl.fresh) {
+        vdirty.push_back(std::make_pair(sl.vertStart, sl.vertCap));
+      } else if (!sl.vert.empty()) {
+        vdirty.push_back(std::make_pair(sl.vertStart, sl.vertHigh));
+      }
+      if (sl.fresh || sl.rewrite) {
+        idirty.push_back(std::make_pair(3*sl.triStart, 3*sl.triCap));
+        triChanged += sl.triCap;
+      }
+      for (unsigned int ts : triDirty[si]) {
+        idirty.push_back(std::make_pair(3*(sl.triStart + ts), 3u));
+      }
+      triChanged += triDirty[si].size();
+    }
+    /* nearby changes are merged into one range, since fewer (slightly
+       bigger) glBufferSubData() calls are cheaper */
+    auto merge = [](std::vector<std::pair<unsigned int, unsigned int> > &in,
+                    std::vector<std::pair<unsigned int, unsigned int> > *out) {
+      const unsigned int gap = 32;
+      std::sort(in.begin(), in.end());
+      for (const std::pair<unsigned int, unsigned int> &rr : in) {
+        if (!out->empty()
+            && out->back().first + out->back().second + gap >= rr.first) {
+          out->back().second = std::max(out->back().second,
+                                        rr.first + rr.second
+                                        - out->back().first);
+        } else {
+          out->push_back(rr);
+        }
+      }
+    };
+    merge(vdirty, vert);
+    merge(idirty, indx);
+  }
+  if (_verbose) {
+    if (fresh) {
+      printf("%s: isovalue %g: laid out %u bricks: %u vertices, "
+             "%u triangles\n", me.c_str(), isovalue,
+             static_cast<unsigned int>(bricks.size()), lpld->xyzwNum,
+             lpld->indxNum/3);
+    } else {
+      printf("%s: isovalue %g: %u of %u triangles rewritten; "
+             "%u vertex and %u index ranges\n", me.c_str(), isovalue,
+             triChanged, lpld->indxNum/3,
+             static_cast<unsigned int>(vert->size()),
+             static_cast<unsigned int>(indx->size()));
+    }
+  }
+  return !fresh;
+}
+
+} // namespace Hale
@@ -0,0 +1,354 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#if !defined(__APPLE_CC__)
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#endif
+
+namespace Hale {
+
+#if !defined(__APPLE_CC__)
+
+static bool
+hasExtension(const char *extList, const char *ext) {
+  if (!extList) {
+    return false;
+  }
+  size_t len = strlen(ext);
+  for (const char *ss = strstr(extList, ext); ss; ss = strstr(ss + 1, ext)) {
+    if ((ss == extList || ' ' == ss[-1]) && (' ' == ss[len] || !ss[len])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+** Creates an OpenGL core context via EGL, without any window system. We
+** prefer Mesa's "surfaceless" platform, which needs no X server or GPU
+** (with LIBGL_ALWAYS_SOFTWARE=1 it uses llvmpipe), and otherwise use the
+** default display. If the display supports surfaceless contexts we don't
+** make any surface, else a 1x1 pbuffer is made current; either way all
+** the real rendering is into our Framebuffer.
+*/
+void
+Offscreen::_contextNew() {
+  static const std::string me="Hale::Offscreen::_contextNew";
+  EGLDisplay dpy = EGL_NO_DISPLAY;
+  EGLint major, minor;
+
+  const char *clientExt = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>
+    (eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (getPlatformDisplay
+      && hasExtension(clientExt, "EGL_MESA_platform_surfaceless")) {
+    dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                             EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if (EGL_NO_DISPLAY == dpy) {
+    dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (EGL_NO_DISPLAY == dpy || !eglInitialize(dpy, &major, &minor)) {
+    throw std::runtime_error(me + ": couldn't get and initialize EGL display");
+  }
+  if (_verbose) {
+    printf("%s: EGL %d.%d (%s)\n", me.c_str(), major, minor,
+           eglQueryString(dpy, EGL_VENDOR));
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    eglTerminate(dpy);
+    throw std::runtime_error(me + ": EGL can't bind OpenGL API");
+  }
+  bool surfaceless = hasExtension(eglQueryString(dpy, EGL_EXTENSIONS),
+                                  "EGL_KHR_surfaceless_context");
+  const EGLint cfgAttr[] = {
+    EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+  };
+  EGLConfig cfg;
+  EGLint cfgNum;
+  if (!eglChooseConfig(dpy, cfgAttr, &cfg, 1, &cfgNum) || !cfgNum) {
+    eglTerminate(dpy);
+    throw std::runtime_error(me + ": no suitable EGL config");
+  }
+  /* same as what Viewer asks of GLFW: OpenGL Core v3.2 */
+  const EGLint ctxAttr[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+    EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+    EGL_NONE
+  };
+  EGLContext ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, ctxAttr);
+  if (EGL_NO_CONTEXT == ctx) {
+    eglTerminate(dpy);
+    throw std::runtime_error(me + ": couldn't create OpenGL 3.2 core context");
+  }
+  EGLSurface surf = EGL_NO_SURFACE;
+  if (!surfaceless) {
+    const EGLint pbAttr[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    surf = eglCreatePbufferSurface(dpy, cfg, pbAttr);
+    if (EGL_NO_SURFACE == surf) {
+      eglDestroyContext(dpy, ctx);
+      eglTerminate(dpy);
+      throw std::runtime_error(me + ": couldn't create pbuffer");
+    }
+  }
+  _eglDisplay = dpy;
+  _eglContext = ctx;
+  _eglSurface = surf;
+  _eglConfig = cfg;
+  try {
+    current();
+  } catch (...) {
+    _contextNix();
+    throw;
+  }
+}
+
+/* another context like ours and sharing objects with it, for the
+   Uploader's thread */
+Uploader *
+Offscreen::uploader() {
+  static const std::string me="Hale::Offscreen::uploader";
+  if (_uploader) {
+    return _uploader;
+  }
+  EGLDisplay dpy = static_cast<EGLDisplay>(_eglDisplay);
+  EGLConfig cfg = static_cast<EGLConfig>(_eglConfig);
+  const EGLint ctxAttr[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+    EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+    EGL_NONE
+  };
+  EGLContext ctx = eglCreateContext(dpy, cfg,
+                                    static_cast<EGLContext>(_eglContext),
+                                    ctxAttr);
+  if (EGL_NO_CONTEXT == ctx) {
+    throw std::runtime_error(me + ": couldn't create shared context");
+  }
+  EGLSurface surf = EGL_NO_SURFACE;
+  if (_eglSurface) {
+    /* no surfaceless contexts */
+    const EGLint pbAttr[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    surf = eglCreatePbufferSurface(dpy, cfg, pbAttr);
+    if (EGL_NO_SURFACE == surf) {
+      eglDestroyContext(dpy, ctx);
+      throw std::runtime_error(me + ": couldn't create pbuffer");
+    }
+  }
+  _uploader = new Uploader([dpy, ctx, surf](bool on) {
+      /* (the bound API is per-thread) */
+      eglBindAPI(EGL_OPENGL_API);
+      if (on) {
+        eglMakeCurrent(dpy, surf, surf, ctx);
+      } else {
+        eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      }
+    }, [dpy, ctx, surf]() {
+      if (surf) {
+        eglDestroySurface(dpy, surf);
+      }
+      eglDestroyContext(dpy, ctx);
+    });
+  return _uploader;
+}
+
+void
+Offscreen::_contextNix() {
+  EGLDisplay dpy = static_cast<EGLDisplay>(_eglDisplay);
+  eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (_eglSurface) {
+    eglDestroySurface(dpy, static_cast<EGLSurface>(_eglSurface));
+  }
+  eglDestroyContext(dpy, static_cast<EGLContext>(_eglContext));
+  eglTerminate(dpy);
+}
+
+void
+Offscreen::current() {
+  static const std::string me="Hale::Offscreen::current";
+  EGLSurface surf = static_cast<EGLSurface>(_eglSurface);
+  if (!eglMakeCurrent(static_cast<EGLDisplay>(_eglDisplay), surf, surf,
+                      static_cast<EGLContext>(_eglContext))) {
+    throw std::runtime_error(me + ": eglMakeCurrent failed");
+  }
+}
+
+#else /* __APPLE_CC__ */
+
+/* There is no EGL on Macs, but there is always a window system; a hidden
+   GLFW window is the least-effort way of getting a GL context */
+void
+Offscreen::_contextNew() {
+  static const std::string me="Hale::Offscreen::_contextNew";
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  _window = glfwCreateWindow(1, 1, "Hale::Offscreen", NULL, NULL);
+  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+  if (!_window) {
+    throw std::runtime_error(me + ": couldn't create hidden GLFW window");
+  }
+  current();
+}
+
+void
+Offscreen::_contextNix() {
+  glfwDestroyWindow(_window);
+}
+
+void
+Offscreen::current() { glfwMakeContextCurrent(_window); }
+
+Uploader *
+Offscreen::uploader() {
+  static const std::string me="Hale::Offscreen::uploader";
+  if (_uploader) {
+    return _uploader;
+  }
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *win = glfwCreateWindow(1, 1, "Hale::Uploader", NULL, _window);
+  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+  if (!win) {
+    throw std::runtime_error(me + ": couldn't create hidden GLFW window "
+                             "with shared context");
+  }
+  _uploader = new Uploader([win](bool on) {
+      glfwMakeContextCurrent(on ? win : NULL);
+    }, [win]() {
+      glfwDestroyWindow(win);
+    });
+  return _uploader;
+}
+
+#endif /* __APPLE_CC__ */
+
+Offscreen::Offscreen(int width, int height, Scene *scene) {
+
+  _verbose = 0;
+  _scene = scene;
+  _lightDir = glm::normalize(glm::vec3(-1.0f, 1.0f, 3.0f));
+  _eglDisplay = _eglContext = _eglSurface = _eglConfig = NULL;
+  _uploader = NULL;
+  _window = NULL;
+  _contextNew();
+  try {
+    _fbuff = new Framebuffer(width, height);
+  } catch (...) {
+    /* the destructor won't be called to clean up the context */
+    _contextNix();
+    throw;
+  }
+  _readback = NULL;
+  _capture = NULL;
+  camera.aspect(static_cast<double>(width)/height);
+}
+
+Offscreen::~Offscreen() {
+  current();
+  delete _uploader;
+  delete _readback;
+  delete _fbuff;
+  _contextNix();
+}
+
+int Offscreen::verbose() { return _verbose; }
+void Offscreen::verbose(int vv) { _verbose = vv; }
+
+int Offscreen::width() { return _fbuff->width(); }
+int Offscreen::height() { return _fbuff->height(); }
+
+void
+Offscreen::resize(int width, int height) {
+  _fbuff->resize(width, height);
+  camera.aspect(static_cast<double>(width)/height);
+}
+
+const Scene *Offscreen::scene() { return _scene; }
+void Offscreen::scene(Scene *scn) { _scene = scn; }
+
+void Offscreen::lightDir(glm::vec3 dir) { _lightDir = glm::normalize(dir); }
+glm::vec3 Offscreen::lightDir() const { return _lightDir; }
+
+void
+Offscreen::draw(void) {
+  static const char me[]="Hale::Offscreen::draw";
+  TraceZone tzone(me);
+
+  if (_uploader) {
+    _uploader->swap();
+  }
+  _fbuff->bind();
+  _drawScene(_scene, camera, camera.project(), _lightDir);
+  if (_capture) {
+    _capture->frame(width(), height());
+  }
+}
+
+void
+Offscreen::snap(const char *fname) {
+  static const char me[]="Hale::Offscreen::snap";
+  if (!fname) {
+    throw std::runtime_error(std::string(me) + ": got NULL fname");
+  }
+  TraceZone tzone(me, fname);
+
+  /* there's no interactivity to preserve, so this waits for the read
+     and saves right here, but still benefits from not needing a
+     separate flip of the image */
+  if (!_readback) {
+    _readback = new Readback(1);
+  }
+  _fbuff->bind();
+  std::string sname(fname);
+  _readback->start(0, 0, width(), height(), [sname](Image *img) {
+      try {
+        img->save(sname.c_str());
+        printf("%s: saved to %s\n", me, sname.c_str());
+      } catch (std::exception &ex) {
+        fprintf(stderr, "%s: %s\n", me, ex.what());
+      }
+      delete img;
+    });
+  _readback->poll(true);
+}
+
+void Offscreen::capture(Capture *cap) { _capture = cap; }
+Capture *Offscreen::capture() { return _capture; }
+
+void
+Offscreen::snap() {
+  snap(_snapFname(imageFormatPNG).c_str());
+}
+
+} // namespace Hale
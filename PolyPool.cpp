@@ -0,0 +1,202 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <algorithm>
+
+namespace Hale {
+
+PolyPool::PolyPool(double growth, unsigned int keepNum) {
+  static const std::string me="Hale::PolyPool::PolyPool";
+  if (!(growth >= 1)) {
+    throw std::runtime_error(me + ": need growth >= 1 (not "
+                             + std::to_string(growth) + ")");
+  }
+  _growth = growth;
+  _keepNum = keepNum;
+  _bytes = _bytesPeak = 0;
+  _allocNum = 0;
+}
+
+PolyPool::~PolyPool() {
+  for (std::pair<const limnPolyData * const, Room> &rr : _room) {
+    limnPolyDataNix(const_cast<limnPolyData *>(rr.first));
+  }
+}
+
+double PolyPool::growth() const { return _growth; }
+unsigned int PolyPool::keepNum() const { return _keepNum; }
+
+size_t PolyPool::_roomBytes(const Room &room) const {
+  return (room.vertCap*(4 + 3)*sizeof(float)
+          + room.indxCap*sizeof(unsigned int));
+}
+
+/* with _mutex locked: frees a spare mesh */
+void PolyPool::_nix(limnPolyData *lpld) {
+  std::map<const limnPolyData *, Room>::iterator it = _room.find(lpld);
+  _bytes -= _roomBytes(it->second);
+  _room.erase(it);
+  limnPolyDataNix(lpld);
+}
+
+limnPolyData *PolyPool::get() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  limnPolyData *lpld;
+  if (_spare.empty()) {
+    lpld = limnPolyDataNew();
+    Room room = {0, 0, false};
+    _room[lpld] = room;
+  } else {
+    /* (_spare is kept sorted by increasing size) */
+    lpld = _spare.back();
+    _spare.pop_back();
+    _room[lpld].spare = false;
+  }
+  return lpld;
+}
+
+void PolyPool::size(limnPolyData *lpld, unsigned int vertNum,
+                    unsigned int indxNum) {
+  static const std::string me="Hale::PolyPool::size";
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<const limnPolyData *, Room>::iterator it = _room.find(lpld);
+  if (_room.end() == it || it->second.spare) {
+    throw std::runtime_error(me + ": got limnPolyData not from get()");
+  }
+  Room &room = it->second;
+  _bytes -= _roomBytes(room);
+  if (vertNum > room.vertCap) {
+    /* the old values needn't be copied, so free first */
+    room.vertCap = std::max(vertNum, static_cast<unsigned int>
+                            (std::min(_growth*room.vertCap, 4294967295.0)));
+    free(lpld->xyzw);
+    free(lpld->norm);
+    lpld->xyzw = AIR_MALLOC(4*static_cast<size_t>(room.vertCap), float);
+    lpld->norm = AIR_MALLOC(3*static_cast<size_t>(room.vertCap), float);
+    _allocNum++;
+  }
+  if (indxNum > room.indxCap) {
+    room.indxCap = std::max(indxNum, static_cast<unsigned int>
+                            (std::min(_growth*room.indxCap, 4294967295.0)));
+    free(lpld->indx);
+    lpld->indx = AIR_MALLOC(room.indxCap, unsigned int);
+    _allocNum++;
+  }
+  if (!lpld->primNum) {
+    lpld->type = AIR_CALLOC(1, unsigned char);
+    lpld->icnt = AIR_CALLOC(1, unsigned int);
+    lpld->primNum = 1;
+    _allocNum++;
+  }
+  _bytes += _roomBytes(room);
+  _bytesPeak = std::max(_bytesPeak, _bytes);
+  if ((vertNum && !(lpld->xyzw && lpld->norm))
+      || (indxNum && !lpld->indx) || !(lpld->type && lpld->icnt)) {
+    throw std::runtime_error(me + ": couldn't allocate "
+                             + std::to_string(vertNum) + " vertices and "
+                             + std::to_string(indxNum) + " indices");
+  }
+  lpld->xyzwNum = lpld->normNum = vertNum;
+  lpld->indxNum = indxNum;
+  lpld->type[0] = limnPrimitiveTriangles;
+  lpld->icnt[0] = indxNum;
+}
+
+bool PolyPool::owns(const limnPolyData *lpld) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<const limnPolyData *, Room>::iterator it = _room.find(lpld);
+  return (_room.end() != it && !it->second.spare);
+}
+
+void PolyPool::put(limnPolyData *lpld) {
+  static const std::string me="Hale::PolyPool::put";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL lpld");
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<const limnPolyData *, Room>::iterator it = _room.find(lpld);
+  if (_room.end() == it) {
+    /* taking over someone else's: only what size() uses is kept */
+    free(lpld->rgba);
+    free(lpld->tex2);
+    free(lpld->tang);
+    lpld->rgba = NULL;
+    lpld->tex2 = NULL;
+    lpld->tang = NULL;
+    lpld->rgbaNum = lpld->tex2Num = lpld->tangNum = 0;
+    Room room = {(lpld->norm && lpld->normNum == lpld->xyzwNum
+                  ? lpld->xyzwNum : 0), lpld->indxNum, false};
+    if (!room.vertCap) {
+      free(lpld->xyzw);
+      free(lpld->norm);
+      lpld->xyzw = lpld->norm = NULL;
+      lpld->xyzwNum = lpld->normNum = 0;
+    }
+    if (1 != lpld->primNum) {
+      free(lpld->type);
+      free(lpld->icnt);
+      lpld->type = NULL;
+      lpld->icnt = NULL;
+      lpld->primNum = 0;
+    }
+    it = _room.insert(std::make_pair(lpld, room)).first;
+    _bytes += _roomBytes(room);
+    _bytesPeak = std::max(_bytesPeak, _bytes);
+  } else if (it->second.spare) {
+    throw std::runtime_error(me + ": limnPolyData already put back");
+  }
+  it->second.spare = true;
+  /* sorted by increasing size, so that get() hands out the biggest (most
+     likely to have room already) and the smallest are freed */
+  size_t bytes = _roomBytes(it->second);
+  std::vector<limnPolyData *>::iterator si = _spare.begin();
+  while (si != _spare.end() && _roomBytes(_room[*si]) < bytes) {
+    si++;
+  }
+  _spare.insert(si, lpld);
+  while (_spare.size() > _keepNum) {
+    limnPolyData *small = _spare.front();
+    _spare.erase(_spare.begin());
+    _nix(small);
+  }
+}
+
+size_t PolyPool::bytes() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytes;
+}
+
+size_t PolyPool::bytesPeak() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytesPeak;
+}
+
+unsigned int PolyPool::allocNum() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _allocNum;
+}
+
+} // namespace Hale
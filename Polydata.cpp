@@ -28,6 +28,7 @@ namespace Hale {
 void
 Polydata::_buffer(bool newaddr) {
   static const char me[]="Hale::Polydata::_buffer";
+  TraceZone tzone(me, _name.c_str());
   const limnPolyData *lpd = this->lpld();
   unsigned int ibits = limnPolyDataInfoBitFlag(lpd);
 
@@ -84,6 +85,16 @@ Polydata::_buffer(bool newaddr) {
 
   /* HEY: tang and tex2 */
 
+  if (_scalarBuff && _scalarNum != lpd->xyzwNum) {
+    /* the scalar values no longer correspond to the vertices */
+    if (debugging)
+      printf("!%s(%s): dropping %u scalar values now that there "
+             "are %u vertices\n", me, _name.c_str(), _scalarNum,
+             lpd->xyzwNum);
+    scalar(NULL, 0);
+    glBindVertexArray(_vao);
+  }
+
 
   if (!_elms || newaddr) {
     if (_elms) {
@@ -103,10 +114,14 @@ Polydata::_buffer(bool newaddr) {
     if (debugging)
       printf("# glBufferData(GL_ELEMENT_ARRAY_BUFFER, %u, lpd->indx, GL_DYNAMIC_DRAW);\n", (unsigned int)(lpd->indxNum * sizeof(unsigned int)));
   }
+  changed();
   return;
 }
 
-void Polydata::model(glm::mat4 mat) { _model = mat; }
+void Polydata::model(glm::mat4 mat) {
+  _model = mat;
+  changed();
+}
 glm::mat4 Polydata::model() const { return _model; }
 
 void
@@ -166,6 +181,9 @@ Polydata::_init(std::string name) {
     }
   }
   _elms = 0;
+  _buffIdx[Hale::vertAttrIdxValue] = -1; // see _scalarBuff
+  _scalarBuff = 0;
+  _scalarNum = 0;
   memcpy(&_lpldCopy, lpld, sizeof(limnPolyData));
   _buffer(true);
   return;
@@ -222,26 +240,289 @@ void Polydata::rebuffer() {
   return;
 }
 
+void Polydata::rebuffer(const std::vector<std::pair<unsigned int,
+                                                   unsigned int> > &vert,
+                        const std::vector<std::pair<unsigned int,
+                                                   unsigned int> > &indx) {
+  static const char me[]="Hale::Polydata::rebuffer";
+  const limnPolyData *lpd = this->lpld();
+  unsigned int ibits = limnPolyDataInfoBitFlag(lpd);
+  if (limnPolyDataInfoBitFlag(&_lpldCopy) != ibits
+      || _lpldCopy.xyzw != lpd->xyzw
+      || _lpldCopy.xyzwNum != lpd->xyzwNum
+      || _lpldCopy.rgba != lpd->rgba
+      || _lpldCopy.rgbaNum != lpd->rgbaNum
+      || _lpldCopy.norm != lpd->norm
+      || _lpldCopy.normNum != lpd->normNum
+      || _lpldCopy.tex2 != lpd->tex2
+      || _lpldCopy.tex2Num != lpd->tex2Num
+      || _lpldCopy.tang != lpd->tang
+      || _lpldCopy.tangNum != lpd->tangNum
+      || _lpldCopy.indx != lpd->indx
+      || _lpldCopy.indxNum != lpd->indxNum) {
+    /* not just new values; (with newaddr, _buffer also re-sends indx) */
+    if (debugging)
+      printf("!%s: calling _buffer(newaddr=true)\n", me);
+    _buffer(true);
+    memcpy(&_lpldCopy, lpd, sizeof(limnPolyData));
+    return;
+  }
+  TraceZone tzone(me, _name.c_str());
+  glBindVertexArray(_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, _buff[_buffIdx[vertAttrIdxXYZW]]);
+  for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+    glBufferSubData(GL_ARRAY_BUFFER, rr.first*sizeof(float)*4,
+                    rr.second*sizeof(float)*4, lpd->xyzw + 4*rr.first);
+  }
+  if (ibits & (1 << limnPolyDataInfoNorm)) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buff[_buffIdx[vertAttrIdxNorm]]);
+    for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+      glBufferSubData(GL_ARRAY_BUFFER, rr.first*sizeof(float)*3,
+                      rr.second*sizeof(float)*3, lpd->norm + 3*rr.first);
+    }
+  }
+  if (ibits & (1 << limnPolyDataInfoRGBA)) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buff[_buffIdx[vertAttrIdxRGBA]]);
+    for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+      glBufferSubData(GL_ARRAY_BUFFER, rr.first*sizeof(char)*4,
+                      rr.second*sizeof(char)*4, lpd->rgba + 4*rr.first);
+    }
+  }
+  if (ibits & (1 << limnPolyDataInfoTex2)) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buff[_buffIdx[vertAttrIdxTex2]]);
+    for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+      glBufferSubData(GL_ARRAY_BUFFER, rr.first*sizeof(float)*2,
+                      rr.second*sizeof(float)*2, lpd->tex2 + 2*rr.first);
+    }
+  }
+  if (ibits & (1 << limnPolyDataInfoTang)) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buff[_buffIdx[vertAttrIdxTang]]);
+    for (const std::pair<unsigned int, unsigned int> &rr : vert) {
+      glBufferSubData(GL_ARRAY_BUFFER, rr.first*sizeof(float)*3,
+                      rr.second*sizeof(float)*3, lpd->tang + 3*rr.first);
+    }
+  }
+  /* (the element array binding is part of the VAO state) */
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elms);
+  for (const std::pair<unsigned int, unsigned int> &rr : indx) {
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, rr.first*sizeof(unsigned int),
+                    rr.second*sizeof(unsigned int), lpd->indx + rr.first);
+  }
+  if (debugging)
+    printf("!%s(%s): %u vertex and %u index ranges\n", me, _name.c_str(),
+           static_cast<unsigned int>(vert.size()),
+           static_cast<unsigned int>(indx.size()));
+  changed();
+}
+
+void Polydata::_glDelete() {
+  glDeleteVertexArrays(1, &_vao);
+  glDeleteBuffers(1, &_elms);
+  glDeleteBuffers(1, &_scalarBuff);
+  glDeleteBuffers(_buffNum, _buff);
+  free(_buff);
+}
+
 Polydata::~Polydata() {
   // static const char me[]="Hale::Polydata::~Polydata";
 
   if (_lpldOwn) {
     limnPolyDataNix(_lpldOwn);
   }
-  glDeleteVertexArrays(1, &_vao);
-  glDeleteBuffers(1, &_elms);
+  _glDelete();
+}
+
+void Polydata::lpld(limnPolyData *poly, bool own) {
+  static const std::string me="Hale::Polydata::lpld";
+  if (!poly) {
+    throw std::runtime_error(me + ": got NULL poly");
+  }
+  if (poly == _lpldOwn) {
+    /* we already own it; we keep owning it, regardless of own */
+    own = true;
+  } else if (_lpldOwn) {
+    limnPolyDataNix(_lpldOwn);
+  }
+  if (own) {
+    _lpld = NULL;
+    _lpldOwn = poly;
+  } else {
+    _lpld = poly;
+    _lpldOwn = NULL;
+  }
+  if (limnPolyDataInfoBitFlag(&_lpldCopy) == limnPolyDataInfoBitFlag(poly)) {
+    rebuffer();
+  } else {
+    /* different vertex attributes, so different GL buffers; simplest to
+       start over, keeping what isn't about the vertices */
+    glm::vec4 color = _colorSolid;
+    glm::mat4 model = _model;
+    _glDelete();
+    _init(_name);
+    _colorSolid = color;
+    _model = model;
+  }
+}
+
+PolydataBuffers::PolydataBuffers(limnPolyData *poly, bool own) {
+  static const std::string me="Hale::PolydataBuffers::PolydataBuffers";
+  if (!poly) {
+    throw std::runtime_error(me + ": got NULL poly");
+  }
+  lpld = poly;
+  this->own = own;
+  elms = 0;
+}
+
+PolydataBuffers::~PolydataBuffers() {
+  if (buff.size()) {
+    glDeleteBuffers(buff.size(), buff.data());
+  }
+  if (elms) {
+    glDeleteBuffers(1, &elms);
+  }
+  if (lpld && own) {
+    limnPolyDataNix(lpld);
+  }
+}
+
+/* a new GL buffer holding the given bytes of data */
+static GLuint
+bufferNew(GLenum target, const void *data, size_t bytes) {
+  GLuint buf;
+  glGenBuffers(1, &buf);
+  glBindBuffer(target, buf);
+  glBufferData(target, bytes, data, GL_DYNAMIC_DRAW);
+  if (debugging)
+    printf("# glGenBuffers(1, &); -> %u; glBindBuffer(%u, %u); "
+           "glBufferData(%u, %u, data, GL_DYNAMIC_DRAW);\n", buf, target, buf,
+           target, static_cast<unsigned int>(bytes));
+  return buf;
+}
+
+void
+PolydataBuffers::fill() {
+  static const char me[]="Hale::PolydataBuffers::fill";
+  TraceZone tzone(me);
+  unsigned int ibits = limnPolyDataInfoBitFlag(lpld);
+
+  buff.push_back(bufferNew(GL_ARRAY_BUFFER, lpld->xyzw,
+                           lpld->xyzwNum*sizeof(float)*4));
+  for (int ii=limnPolyDataInfoUnknown+1; ii<limnPolyDataInfoLast; ii++) {
+    if (!(ibits & (1 << ii))) {
+      continue;
+    }
+    switch (ii) {
+    case limnPolyDataInfoRGBA:
+      buff.push_back(bufferNew(GL_ARRAY_BUFFER, lpld->rgba,
+                               lpld->rgbaNum*sizeof(char)*4));
+      break;
+    case limnPolyDataInfoNorm:
+      buff.push_back(bufferNew(GL_ARRAY_BUFFER, lpld->norm,
+                               lpld->normNum*sizeof(float)*3));
+      break;
+    case limnPolyDataInfoTex2:
+      buff.push_back(bufferNew(GL_ARRAY_BUFFER, lpld->tex2,
+                               lpld->tex2Num*sizeof(float)*2));
+      break;
+    case limnPolyDataInfoTang:
+      buff.push_back(bufferNew(GL_ARRAY_BUFFER, lpld->tang,
+                               lpld->tangNum*sizeof(float)*3));
+      break;
+    }
+  }
+  elms = bufferNew(GL_ELEMENT_ARRAY_BUFFER, lpld->indx,
+                   lpld->indxNum*sizeof(unsigned int));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glErrorCheck(me, "glBufferData");
+}
+
+void
+Polydata::_attribSet() {
+  const limnPolyData *lpd = this->lpld();
+  unsigned int aa, ibits = limnPolyDataInfoBitFlag(lpd);
+
+  glBindVertexArray(_vao);
+  if (debugging)
+    printf("# glBindVertexArray(%u);\n", _vao);
+  aa = 0;
+  glBindBuffer(GL_ARRAY_BUFFER, _buff[aa]);
+  glVertexAttribPointer(Hale::vertAttrIdxXYZW, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(Hale::vertAttrIdxXYZW);
+  _buffIdx[Hale::vertAttrIdxXYZW] = aa++;
+  for (int ii=limnPolyDataInfoUnknown+1; ii<limnPolyDataInfoLast; ii++) {
+    /* HEY assumption of limnPolyDataInfo, Hale::vertAttrIdx mirroring */
+    int hva = ii - limnPolyDataInfoRGBA + Hale::vertAttrIdxRGBA;
+    if (!(ibits & (1 << ii))) {
+      glDisableVertexAttribArray(hva);
+      _buffIdx[hva] = -1;
+      continue;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, _buff[aa]);
+    if (limnPolyDataInfoRGBA == ii) {
+      glVertexAttribPointer(hva, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+    } else {
+      glVertexAttribPointer(hva, limnPolyDataInfoTex2 == ii ? 2 : 3,
+                            GL_FLOAT, GL_FALSE, 0, 0);
+    }
+    glEnableVertexAttribArray(hva);
+    if (debugging)
+      printf("# glBindBuffer(GL_ARRAY_BUFFER, %u); glVertexAttribPointer(%d, ...); "
+             "glEnableVertexAttribArray(%d);\n", _buff[aa], hva, hva);
+    _buffIdx[hva] = aa++;
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elms);
+  if (debugging)
+    printf("# glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, %u);\n", _elms);
+}
+
+void Polydata::buffers(PolydataBuffers *pb) {
+  static const std::string me="Hale::Polydata::buffers";
+  TraceZone tzone(me.c_str(), _name.c_str());
+  if (!(pb && pb->lpld && pb->buff.size() && pb->elms)) {
+    throw std::runtime_error(me + ": got NULL or unfilled buffers");
+  }
+  if (_lpldOwn && _lpldOwn != pb->lpld) {
+    limnPolyDataNix(_lpldOwn);
+  }
+  if (pb->own) {
+    _lpld = NULL;
+    _lpldOwn = pb->lpld;
+  } else {
+    _lpld = pb->lpld;
+    _lpldOwn = NULL;
+  }
+  pb->lpld = NULL;
   glDeleteBuffers(_buffNum, _buff);
+  glDeleteBuffers(1, &_elms);
   free(_buff);
+  _buffNum = pb->buff.size();
+  _buff = AIR_CALLOC(_buffNum, GLuint);
+  memcpy(_buff, pb->buff.data(), _buffNum*sizeof(GLuint));
+  _elms = pb->elms;
+  pb->buff.clear();
+  pb->elms = 0;
+  _attribSet();
+  const limnPolyData *lpd = this->lpld();
+  if (_scalarBuff && _scalarNum != lpd->xyzwNum) {
+    scalar(NULL, 0);
+  }
+  memcpy(&_lpldCopy, lpd, sizeof(limnPolyData));
+  changed();
 }
 
 void Polydata::colorSolid(float rr, float gg, float bb) {
   _colorSolid = glm::vec4(rr, gg, bb, 1.0f);
+  changed();
 }
 void Polydata::colorSolid(glm::vec3 rgb) {
   _colorSolid = glm::vec4(rgb, 1.0f);
+  changed();
 }
 void Polydata::colorSolid(glm::vec4 rgba) {
   _colorSolid = rgba;
+  changed();
 }
 glm::vec4 Polydata::colorSolid() const {
   return _colorSolid;
@@ -253,11 +534,53 @@ void Polydata::program(const Program *prog) {
     throw std::runtime_error(me + ": got NULL program");
   }
   _program = prog;
+  changed();
 }
 const Program *Polydata::program() const {
   return _program;
 }
 
+void
+Polydata::scalar(const float *val, unsigned int num) {
+  static const std::string me="Hale::Polydata::scalar";
+
+  glBindVertexArray(_vao);
+  if (debugging)
+    printf("# glBindVertexArray(%u);\n", _vao);
+  if (!val) {
+    glDisableVertexAttribArray(Hale::vertAttrIdxValue);
+    glDeleteBuffers(1, &_scalarBuff);
+    if (debugging)
+      printf("# glDisableVertexAttribArray(%u); glDeleteBuffers(1, %u);\n",
+             Hale::vertAttrIdxValue, _scalarBuff);
+    _scalarBuff = 0;
+    _scalarNum = 0;
+    return;
+  }
+  if (num != lpld()->xyzwNum) {
+    throw std::runtime_error(me + ": got " + std::to_string(num)
+                             + " values but have "
+                             + std::to_string(lpld()->xyzwNum) + " vertices");
+  }
+  if (!_scalarBuff) {
+    glGenBuffers(1, &_scalarBuff);
+    if (debugging)
+      printf("# glGenBuffers(1, &); -> %u\n", _scalarBuff);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, _scalarBuff);
+  glBufferData(GL_ARRAY_BUFFER, num*sizeof(float), val, GL_DYNAMIC_DRAW);
+  glVertexAttribPointer(Hale::vertAttrIdxValue, 1, GL_FLOAT, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(Hale::vertAttrIdxValue);
+  if (debugging)
+    printf("# glBindBuffer(GL_ARRAY_BUFFER, %u); glBufferData(GL_ARRAY_BUFFER, %u, val, GL_DYNAMIC_DRAW); "
+           "glVertexAttribPointer(%u, 1, GL_FLOAT, GL_FALSE, 0, 0); glEnableVertexAttribArray(%u);\n",
+           _scalarBuff, (unsigned int)(num*sizeof(float)),
+           Hale::vertAttrIdxValue, Hale::vertAttrIdxValue);
+  _scalarNum = num;
+}
+
+bool Polydata::scalarSet() const { return !!_scalarBuff; }
+
 void Polydata::bounds(glm::vec3& finalmin, glm::vec3& finalmax) const {
   const limnPolyData *lpd = lpld();
   glm::vec4 wmin, wmax, wpos;
@@ -282,24 +605,36 @@ std::string Polydata::name() const {
 }
 
 void
-Polydata::draw() const {
+Polydata::draw(const Program *prog) const {
   static const char me[]="Hale::Polydata::draw";
+  TraceZone tzone(me, _name.c_str());
 
   if (debugging)
     printf("!%s(%s): ____________________________________________ \n", me, _name.c_str());
-  _program->use();
-
   const limnPolyData *lpld = this->lpld();
-  int ibits = limnPolyDataInfoBitFlag(lpld);
-  if (!(ibits & (1 << limnPolyDataInfoRGBA))) {
-    _program->uniform("colorSolid", _colorSolid);
-  }
-  _program->uniform("modelMat", _model);
-  /* would be nice to call this only if the values have changed;
-     but the Program pointer is to a const Program, so we can't easily
-     make this into a stateful/conditional call to uniform() */
-  _program->uniform("phongKa", 0.2);
-  _program->uniform("phongKd", 0.8);
+  if (prog) {
+    /* some other program (like preprogramGBuffer), which isn't about
+       color or lighting */
+    prog->use();
+    prog->uniform("modelMat", _model);
+  } else {
+    _program->use();
+
+    int ibits = limnPolyDataInfoBitFlag(lpld);
+    if (!(ibits & (1 << limnPolyDataInfoRGBA))) {
+      _program->uniform("colorSolid", _colorSolid);
+    }
+    _program->uniform("modelMat", _model);
+    /* would be nice to call this only if the values have changed;
+       but the Program pointer is to a const Program, so we can't easily
+       make this into a stateful/conditional call to uniform() */
+    _program->uniform("phongKa", 0.2);
+    _program->uniform("phongKd", 0.8);
+  }
+  if (!_scalarBuff) {
+    /* attribute array not enabled; this is what valueVA will be */
+    glVertexAttrib1f(Hale::vertAttrIdxValue, AIR_NAN);
+  }
   if (debugging)
     printf("!%s: (done setting uniforms)\n", me);
 
@@ -0,0 +1,141 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+Poster::Poster(int width, int height, int tileSize) {
+  static const std::string me="Hale::Poster::Poster";
+
+  if (!(width > 0 && height > 0 && tileSize > 0)) {
+    throw std::runtime_error(me + ": need positive size and tile size");
+  }
+  /* a tile has to fit in a texture and a viewport */
+  GLint maxTex, maxView[2];
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxView);
+  int maxTile = AIR_MIN(maxTex, AIR_MIN(maxView[0], maxView[1]));
+  if (tileSize > maxTile) {
+    fprintf(stderr, "%s: reducing tile size %d to GL maximum %d\n",
+            me.c_str(), tileSize, maxTile);
+    tileSize = maxTile;
+  }
+  _width = width;
+  _height = height;
+  _tileSize = tileSize;
+  _verbose = 0;
+}
+
+int Poster::verbose() { return _verbose; }
+void Poster::verbose(int vv) { _verbose = vv; }
+int Poster::width() const { return _width; }
+int Poster::height() const { return _height; }
+int Poster::tileSize() const { return _tileSize; }
+
+void
+Poster::render(Scene *scene, Camera &camera, glm::vec3 lightDir,
+               const char *fname) {
+  static const char me[]="Hale::Poster::render";
+  TraceZone tzone(me, fname);
+  int tsz = _tileSize;
+  int tileNumX = (_width + tsz - 1)/tsz;
+  int tileNumY = (_height + tsz - 1)/tsz;
+
+  /* the whole poster has its own aspect ratio */
+  double aspectSave = camera.aspect();
+  camera.aspect(static_cast<double>(_width)/_height);
+  /* all the memory used is for one tile, and one row of tiles, which is
+     filled by reading back tiles, then streamed to the file */
+  Framebuffer fbuff(AIR_MIN(tsz, _width), AIR_MIN(tsz, _height));
+  std::vector<unsigned char> band(4*static_cast<size_t>(_width)
+                                  *AIR_MIN(tsz, _height));
+  /* (declared after band, so that pending reads finish before band goes
+     away, if there's an exception) */
+  Readback readback(2);
+  ImageWriter writer(fname, _width, _height);
+  /* so we can put things back as they were */
+  GLint fboSave, viewSave[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fboSave);
+  glGetIntegerv(GL_VIEWPORT, viewSave);
+  if (_verbose) {
+    printf("%s: %d x %d tiles of size %d for %d x %d image %s "
+           "(%g MB for tile row)\n", me, tileNumX, tileNumY, tsz,
+           _width, _height, fname, band.size()/(1024.0*1024.0));
+  }
+  unsigned char *bdata = &(band[0]);
+  size_t bandRowSize = 4*static_cast<size_t>(_width);
+  try {
+    /* image rows go top to bottom, so start with top row of tiles */
+    for (int ty=0; ty<tileNumY; ty++) {
+      int r0 = ty*tsz, r1 = AIR_MIN(_height, r0 + tsz);
+      int th = r1 - r0;
+      for (int tx=0; tx<tileNumX; tx++) {
+        TraceZone tzone2("Hale::Poster::render(tile)");
+        int c0 = tx*tsz, c1 = AIR_MIN(_width, c0 + tsz);
+        int tw = c1 - c0;
+        /* in the projection (like GL) v increases upwards */
+        glm::mat4 proj = camera.project(static_cast<double>(c0)/_width,
+                                        static_cast<double>(c1)/_width,
+                                        1 - static_cast<double>(r1)/_height,
+                                        1 - static_cast<double>(r0)/_height);
+        fbuff.bind();
+        glViewport(0, 0, tw, th);
+        _drawScene(scene, camera, proj, lightDir);
+        ReadbackMapped mapped = [bdata, bandRowSize, c0, tw, th]
+          (const void *data) {
+          /* copy into place in band, flipping rows */
+          const unsigned char *src = static_cast<const unsigned char *>(data);
+          size_t rowSize = 4*static_cast<size_t>(tw);
+          for (int yi=0; yi<th; yi++) {
+            memcpy(bdata + bandRowSize*(th - 1 - yi) + 4*c0,
+                   src + rowSize*yi, rowSize);
+          }
+        };
+        if (!readback.start(0, 0, tw, th, GL_RGBA, GL_UNSIGNED_BYTE,
+                            mapped)) {
+          /* previous two tiles still pending; finish one */
+          readback.poll(true);
+          readback.start(0, 0, tw, th, GL_RGBA, GL_UNSIGNED_BYTE, mapped);
+        }
+      }
+      readback.poll(true);
+      writer.rows(bdata, th);
+    }
+    writer.finish();
+  } catch (...) {
+    camera.aspect(aspectSave);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboSave);
+    glViewport(viewSave[0], viewSave[1], viewSave[2], viewSave[3]);
+    throw;
+  }
+  camera.aspect(aspectSave);
+  glBindFramebuffer(GL_FRAMEBUFFER, fboSave);
+  glViewport(viewSave[0], viewSave[1], viewSave[2], viewSave[3]);
+  if (_verbose) {
+    printf("%s: saved to %s\n", me, fname);
+  }
+}
+
+} // namespace Hale
@@ -95,6 +95,70 @@ static const char *AmbDiff2Side_frag =
    "  fcol.a = color_frag.a;\n "
    "}\n");
 
+/* for GBuffer: no lighting, just world-space position (with w=1 to
+   indicate coverage) and the scalar value, to separate float targets */
+static const char *GBuffer_vert =
+  (VERSION
+   "uniform mat4 projectMat;\n "
+   "uniform mat4 viewMat;\n "
+   "uniform mat4 modelMat;\n "
+   "in vec4 positionVA;\n "
+   "in float valueVA;\n "
+   "out vec4 wpos_frag;\n "
+   "out float value_frag;\n "
+   "void main(void) {\n "
+   "  wpos_frag = modelMat * positionVA;\n "
+   "  gl_Position = projectMat * viewMat * wpos_frag;\n "
+   "  value_frag = valueVA;\n "
+   "}\n ");
+
+static const char *GBuffer_frag =
+  (VERSION
+   "in vec4 wpos_frag;\n "
+   "in float value_frag;\n "
+   "out vec4 gbPosition;\n "
+   "out float gbValue;\n "
+   "void main(void) {\n "
+   "  gbPosition = vec4(wpos_frag.xyz/wpos_frag.w, 1.0);\n "
+   "  gbValue = value_frag;\n "
+   "}\n");
+
+/* for Reproject: one point per pixel of the previous frame, which is
+   un-projected (with its depth) and re-projected by reprojMat, all in
+   homogeneous coordinates. There are no vertex attributes; the pixel is
+   known from gl_VertexID. Background pixels (depth 1) are not re-used:
+   they are sent outside the clip volume, so that where they would have
+   landed, the newly visible surface is drawn instead */
+static const char *Reproject_vert =
+  (VERSION
+   "uniform mat4 reprojMat;\n "
+   "uniform float pointSize;\n "
+   "uniform sampler2D colorTex;\n "
+   "uniform sampler2D depthTex;\n "
+   "out vec4 color_frag;\n "
+   "void main(void) {\n "
+   "  ivec2 size = textureSize(depthTex, 0);\n "
+   "  ivec2 ij = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);\n "
+   "  float depth = texelFetch(depthTex, ij, 0).r;\n "
+   "  if (depth >= 1) {\n "
+   "    gl_Position = vec4(2, 2, 2, 1);\n "
+   "    color_frag = vec4(0);\n "
+   "    return;\n "
+   "  }\n "
+   "  vec4 ndc = vec4(2*(vec2(ij) + 0.5)/vec2(size) - 1, 2*depth - 1, 1);\n "
+   "  gl_Position = reprojMat * ndc;\n "
+   "  gl_PointSize = pointSize;\n "
+   "  color_frag = texelFetch(colorTex, ij, 0);\n "
+   "}\n ");
+
+static const char *Reproject_frag =
+  (VERSION
+   "in vec4 color_frag;\n "
+   "out vec4 fcol;\n "
+   "void main(void) {\n "
+   "  fcol = color_frag;\n "
+   "}\n");
+
 static GLchar * // HEY what's the right way to do this
 strdupe(const char *str) {
   GLchar *ret;
@@ -179,6 +243,10 @@ Program::Program(preprogram prog) {
   } else if (preprogramAmbDiffSolid == prog
              || preprogramAmbDiff2SideSolid == prog) {
     _vertCode = strdupe(AmbDiffSolid_vert);
+  } else if (preprogramGBuffer == prog) {
+    _vertCode = strdupe(GBuffer_vert);
+  } else if (preprogramReproject == prog) {
+    _vertCode = strdupe(Reproject_vert);
   } else {
     throw std::runtime_error(me + ": prog " + std::to_string(prog)
                              + " not recognized");
@@ -186,6 +254,10 @@ Program::Program(preprogram prog) {
   if (preprogramAmbDiff2Side == prog
       || preprogramAmbDiff2SideSolid == prog) {
     _fragCode = strdupe(AmbDiff2Side_frag);
+  } else if (preprogramGBuffer == prog) {
+    _fragCode = strdupe(GBuffer_frag);
+  } else if (preprogramReproject == prog) {
+    _fragCode = strdupe(Reproject_frag);
   } else {
     _fragCode = strdupe(AmbDiff_frag);
   }
@@ -217,6 +289,7 @@ Program::~Program() {
 void
 Program::compile() {
   static const std::string me="Hale::Program::compile";
+  TraceZone tzone(me.c_str());
 
   /* would need these if you can re-use a Hale::Program
      with different shader sources
@@ -252,9 +325,20 @@ Program::bindAttribute(GLuint idx, const GLchar *name) {
   glErrorCheck(me, std::string("glBindAttribLocation(") + name + ")");
 }
 
+/* for programs with more than one fragment shader output */
+void
+Program::bindFragData(GLuint idx, const GLchar *name) {
+  static const std::string me="Hale::Program::bindFragData";
+  glBindFragDataLocation(_progId, idx, name);
+  if (debugging)
+    printf("# glBindFragDataLocation(%u, %u, %s)\n", _progId, idx, name);
+  glErrorCheck(me, std::string("glBindFragDataLocation(") + name + ")");
+}
+
 void
 Program::link() {
-  static const std::string me="Hale::Program::use";
+  static const std::string me="Hale::Program::link";
+  TraceZone tzone(me.c_str());
   GLint status;
 
   glLinkProgram(_progId);
@@ -343,10 +427,27 @@ Program::progId() const {
 
 /* ------------------------------------------------------------ */
 
+/* sticky uniforms are seen by every program, so a new value for one is a
+   change to what is drawn (non-sticky uniforms only last until the next
+   program use(), so they don't count) */
+template<typename T> static void
+stickyChanged(const std::map<std::string, T> &smap,
+              const std::string &name, const T &vv) {
+  auto si = smap.find(name);
+  if (smap.end() == si || !(si->second == vv)) {
+    changed();
+  }
+}
+
 // HEY: what's right way to avoid copy+paste?
 void uniform(std::string name, float vv, bool sticky) {
-  if (_programCurrent) {
+  if (sticky) {
+    stickyChanged(stickyUniformFloat, name, vv);
+  }
+  if (_programCurrent && _programCurrent->uniformType.count(name)) {
     _programCurrent->uniform(name, vv, sticky);
+  } else if (sticky) {
+    stickyUniformFloat[name] = vv;
   }
 }
 void
@@ -372,8 +473,13 @@ Program::uniform(std::string name, float vv, bool sticky) const {
 
 // HEY: what's right way to avoid copy+paste?
 void uniform(std::string name, glm::vec3 vv, bool sticky) {
-  if (_programCurrent) {
+  if (sticky) {
+    stickyChanged(stickyUniformVec3, name, vv);
+  }
+  if (_programCurrent && _programCurrent->uniformType.count(name)) {
     _programCurrent->uniform(name, vv, sticky);
+  } else if (sticky) {
+    stickyUniformVec3[name] = vv;
   }
 }
 void
@@ -399,8 +505,13 @@ Program::uniform(std::string name, glm::vec3 vv, bool sticky) const {
 
 // HEY: what's right way to avoid copy+paste?
 void uniform(std::string name, glm::vec4 vv, bool sticky) {
-  if (_programCurrent) {
+  if (sticky) {
+    stickyChanged(stickyUniformVec4, name, vv);
+  }
+  if (_programCurrent && _programCurrent->uniformType.count(name)) {
     _programCurrent->uniform(name, vv, sticky);
+  } else if (sticky) {
+    stickyUniformVec4[name] = vv;
   }
 }
 void
@@ -426,8 +537,13 @@ Program::uniform(std::string name, glm::vec4 vv, bool sticky) const {
 
 // HEY: what's right way to avoid copy+paste?
 void uniform(std::string name, glm::mat4 vv, bool sticky) {
-  if (_programCurrent) {
+  if (sticky) {
+    stickyChanged(stickyUniformMat4, name, vv);
+  }
+  if (_programCurrent && _programCurrent->uniformType.count(name)) {
     _programCurrent->uniform(name, vv, sticky);
+  } else if (sticky) {
+    stickyUniformMat4[name] = vv;
   }
 }
 void
@@ -457,17 +573,23 @@ Program::uniform(std::string name, glm::mat4 vv, bool sticky) const {
    needs to be a new "unstick" argument to the uniform() calls, or the
    "sticky" argument can have 1 of 3 values: "true", "false", or "unstick" */
 void stickyUniform(void) {
+  if (!_programCurrent) {
+    return;
+  }
+  /* not every program uses every sticky uniform (preprogramGBuffer has
+     no lighting), so skip the ones this program doesn't have */
+  const std::map<std::string,glEnumItem> &utype = _programCurrent->uniformType;
   for (auto si = stickyUniformFloat.begin(); si != stickyUniformFloat.end(); si++) {
-    Hale::uniform(si->first, si->second);
+    if (utype.count(si->first)) Hale::uniform(si->first, si->second);
   }
   for (auto si = stickyUniformVec3.begin(); si != stickyUniformVec3.end(); si++) {
-    Hale::uniform(si->first, si->second);
+    if (utype.count(si->first)) Hale::uniform(si->first, si->second);
   }
   for (auto si = stickyUniformVec4.begin(); si != stickyUniformVec4.end(); si++) {
-    Hale::uniform(si->first, si->second);
+    if (utype.count(si->first)) Hale::uniform(si->first, si->second);
   }
   for (auto si = stickyUniformMat4.begin(); si != stickyUniformMat4.end(); si++) {
-    Hale::uniform(si->first, si->second);
+    if (utype.count(si->first)) Hale::uniform(si->first, si->second);
   }
 }
 
@@ -502,6 +624,15 @@ ProgramLib(preprogram pp) {
     prog->bindAttribute(Hale::vertAttrIdxXYZW, "positionVA");
     prog->bindAttribute(Hale::vertAttrIdxNorm, "normalVA"); // HEY Tex2, Tang
     break;
+  case preprogramGBuffer:
+    prog->bindAttribute(Hale::vertAttrIdxXYZW, "positionVA");
+    prog->bindAttribute(Hale::vertAttrIdxValue, "valueVA");
+    prog->bindFragData(0, "gbPosition");
+    prog->bindFragData(1, "gbValue");
+    break;
+  case preprogramReproject:
+    /* no attributes to bind */
+    break;
   default:
     throw std::runtime_error(me + ": sorry, prog " + std::to_string(pp)
                              + " not implemented");
@@ -0,0 +1,180 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+/* bytes per pixel for the format and type combinations we support */
+static size_t
+pixelSize(GLenum format, GLenum type) {
+  static const std::string me="Hale::Readback::pixelSize";
+  size_t comp, bytes;
+  switch (format) {
+  case GL_RED: case GL_DEPTH_COMPONENT: comp = 1; break;
+  case GL_RG: comp = 2; break;
+  case GL_RGB: comp = 3; break;
+  case GL_RGBA: comp = 4; break;
+  default:
+    throw std::runtime_error(me + ": format " + std::to_string(format)
+                             + " not handled");
+  }
+  switch (type) {
+  case GL_UNSIGNED_BYTE: bytes = 1; break;
+  case GL_FLOAT: bytes = 4; break;
+  default:
+    throw std::runtime_error(me + ": type " + std::to_string(type)
+                             + " not handled");
+  }
+  return comp*bytes;
+}
+
+Readback::Readback(unsigned int slotNum) {
+  static const std::string me="Hale::Readback::Readback";
+  if (!slotNum) {
+    throw std::runtime_error(me + ": need at least one slot");
+  }
+  /* nothing GL is allocated until there is something to read */
+  _slot.resize(slotNum);
+  for (unsigned int si=0; si<slotNum; si++) {
+    _slot[si].pbo = 0;
+    _slot[si].size = 0;
+    _slot[si].fence = 0;
+    _slot[si].width = _slot[si].height = 0;
+  }
+}
+
+Readback::~Readback() {
+  poll(true);
+  for (unsigned int si=0; si<_slot.size(); si++) {
+    if (_slot[si].pbo) {
+      glDeleteBuffers(1, &(_slot[si].pbo));
+    }
+  }
+}
+
+unsigned int Readback::slotNum() const { return _slot.size(); }
+unsigned int Readback::pending() const { return _pending.size(); }
+
+bool
+Readback::start(int x0, int y0, int width, int height, ReadbackDone done) {
+  /* GL rows go bottom-up; flip while copying out, so there's no separate
+     pass over the image to do that */
+  ReadbackMapped mapped = [width, height, done](const void *data) {
+    Image *img = new Image(width, height);
+    size_t rowSize = 4*static_cast<size_t>(width);
+    const unsigned char *src = static_cast<const unsigned char *>(data);
+    unsigned char *dst = img->data();
+    for (int yi=0; yi<height; yi++) {
+      memcpy(dst + rowSize*yi, src + rowSize*(height - 1 - yi), rowSize);
+    }
+    done(img);
+  };
+  return start(x0, y0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, mapped);
+}
+
+bool
+Readback::start(int x0, int y0, int width, int height,
+                GLenum format, GLenum type, ReadbackMapped mapped) {
+  static const char me[]="Hale::Readback::start";
+  TraceZone tzone(me);
+
+  if (_pending.size() == _slot.size()) {
+    return false;
+  }
+  /* find a slot not in _pending */
+  unsigned int si;
+  for (si=0; si<_slot.size(); si++) {
+    if (!_slot[si].fence) break;
+  }
+  slot &sl = _slot[si];
+  size_t size = pixelSize(format, type)*width*height;
+  if (!sl.pbo) {
+    glGenBuffers(1, &(sl.pbo));
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, sl.pbo);
+  if (sl.size != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    sl.size = size;
+    if (debugging)
+      printf("# glBufferData(GL_PIXEL_PACK_BUFFER, %u, NULL, GL_STREAM_READ) (pbo %u)\n",
+             static_cast<unsigned int>(size), sl.pbo);
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  /* with a PACK buffer bound, this only queues the copy; the data
+     pointer is an offset into the buffer */
+  glReadPixels(x0, y0, width, height, format, type, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  sl.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  sl.width = width;
+  sl.height = height;
+  sl.mapped = mapped;
+  _pending.push_back(si);
+  glErrorCheck(me, "reading " + std::to_string(width) + "x"
+               + std::to_string(height) + " pixels to PBO");
+  return true;
+}
+
+unsigned int
+Readback::poll(bool wait) {
+  static const char me[]="Hale::Readback::poll";
+  unsigned int finished = 0;
+
+  /* fences signal in the order they were issued, so we can stop
+     at the first one that hasn't */
+  while (_pending.size()) {
+    slot &sl = _slot[_pending.front()];
+    GLenum ret = glClientWaitSync(sl.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  wait ? 1000000000 : 0);
+    if (GL_TIMEOUT_EXPIRED == ret && wait) {
+      continue;
+    }
+    if (!(GL_ALREADY_SIGNALED == ret || GL_CONDITION_SATISFIED == ret)) {
+      if (GL_WAIT_FAILED == ret) {
+        fprintf(stderr, "%s: glClientWaitSync failed\n", me);
+      }
+      break;
+    }
+    TraceZone tzone(me);
+    glDeleteSync(sl.fence);
+    sl.fence = 0;
+    _pending.pop_front();
+    ReadbackMapped mapped = sl.mapped;
+    sl.mapped = NULL;
+    finished++;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, sl.pbo);
+    const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sl.size,
+                                        GL_MAP_READ_BIT);
+    if (data) {
+      mapped(data);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+      fprintf(stderr, "%s: couldn't map PBO %u\n", me, sl.pbo);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+  return finished;
+}
+
+} // namespace Hale
@@ -0,0 +1,189 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+/* size, in pixels, of the square tiles that are refreshed */
+#define TILE_SIZE 64
+/* size of the points that previous pixels are drawn as; >1 so that a
+   little magnification doesn't leave cracks between them */
+#define POINT_SIZE 2.0f
+
+namespace Hale {
+
+Reproject::Reproject(int width, int height) {
+  _verbose = 0;
+  for (unsigned int fi=0; fi<2; fi++) {
+    _fbuff[fi] = new Framebuffer(width, height,
+                                 std::vector<GLenum>(1, GL_RGBA8),
+                                 GL_DEPTH24_STENCIL8);
+  }
+  _cur = 0;
+  _valid = false;
+  _VP = glm::mat4(1.0f);
+  _refresh = 0.125;
+  _moveMax = 0.2;
+  _tileNext = 0;
+  glGenVertexArrays(1, &_vao);
+  if (debugging)
+    printf("# glGenVertexArrays(1, &); -> %u\n", _vao);
+}
+
+Reproject::~Reproject() {
+  glDeleteVertexArrays(1, &_vao);
+  delete _fbuff[0];
+  delete _fbuff[1];
+}
+
+int Reproject::verbose() { return _verbose; }
+void Reproject::verbose(int vv) { _verbose = vv; }
+int Reproject::width() const { return _fbuff[0]->width(); }
+int Reproject::height() const { return _fbuff[0]->height(); }
+
+void Reproject::resize(int width, int height) {
+  _fbuff[0]->resize(width, height);
+  _fbuff[1]->resize(width, height);
+  _valid = false;
+}
+
+void Reproject::refresh(double frac) {
+  static const std::string me="Hale::Reproject::refresh";
+  if (!(0 < frac && frac <= 1)) {
+    throw std::runtime_error(me + ": need fraction in (0,1] (not "
+                             + std::to_string(frac) + ")");
+  }
+  _refresh = frac;
+}
+double Reproject::refresh() const { return _refresh; }
+
+void Reproject::moveMax(double mm) { _moveMax = mm; }
+double Reproject::moveMax() const { return _moveMax; }
+
+void Reproject::invalidate() { _valid = false; }
+
+const Framebuffer *Reproject::framebuffer() const { return _fbuff[_cur]; }
+
+/* how far (in NDC) points near the look-at point move under reproj,
+   or infinity if any of them goes behind the eye */
+static double
+moveSize(const glm::mat4 &reproj) {
+  static const float pnt[5][2] = {{0, 0},
+                                  {-0.5f, -0.5f}, {0.5f, -0.5f},
+                                  {-0.5f, 0.5f}, {0.5f, 0.5f}};
+  double ret = 0;
+  for (unsigned int pi=0; pi<5; pi++) {
+    glm::vec4 pp = reproj*glm::vec4(pnt[pi][0], pnt[pi][1], 0.0f, 1.0f);
+    if (!(pp.w > 0)) {
+      return AIR_POS_INF;
+    }
+    double dx = pp.x/pp.w - pnt[pi][0];
+    double dy = pp.y/pp.w - pnt[pi][1];
+    ret = AIR_MAX(ret, sqrt(dx*dx + dy*dy));
+  }
+  return ret;
+}
+
+bool Reproject::draw(Scene *scene, Camera &camera, glm::vec3 lightDir,
+                     bool full) {
+  static const char me[]="Hale::Reproject::draw";
+  TraceZone tzone(me);
+  glm::mat4 proj = camera.project();
+  glm::mat4 VP = proj*camera.view();
+  /* from previous NDC to current clip coordinates, if there is a
+     previous frame */
+  glm::mat4 reproj(1.0f);
+  bool doit = (!full && _valid);
+  if (doit) {
+    reproj = VP*glm::inverse(_VP);
+    doit = moveSize(reproj) <= _moveMax;
+  }
+  unsigned int prev = _cur;
+  _cur = 1 - _cur;
+  const Framebuffer *fbuff = _fbuff[_cur];
+  fbuff->bind();
+  _VP = VP;
+  if (!doit) {
+    _drawScene(scene, camera, proj, lightDir);
+    _valid = true;
+    _tileNext = 0;
+    return false;
+  }
+  int sx = fbuff->width(), sy = fbuff->height();
+
+  /* draw the previous pixels as points, setting stencil where they land */
+  glClearStencil(0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  glEnable(GL_STENCIL_TEST);
+  glStencilFunc(GL_ALWAYS, 1, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  glEnable(GL_PROGRAM_POINT_SIZE);
+  const Program *prog = ProgramLib(preprogramReproject);
+  prog->use();
+  prog->uniform("reprojMat", reproj);
+  prog->uniform("pointSize", POINT_SIZE);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, _fbuff[prev]->colorTex());
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, _fbuff[prev]->depthTex());
+  glUniform1i(glGetUniformLocation(prog->progId(), "colorTex"), 0);
+  glUniform1i(glGetUniformLocation(prog->progId(), "depthTex"), 1);
+  glBindVertexArray(_vao);
+  glDrawArrays(GL_POINTS, 0, sx*sy);
+  if (debugging)
+    printf("# (reproject) glDrawArrays(GL_POINTS, 0, %d);\n", sx*sy);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_PROGRAM_POINT_SIZE);
+  glErrorCheck(me, "reprojecting");
+
+  /* draw the scene where no previous pixel landed */
+  glStencilFunc(GL_EQUAL, 0, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  _drawScene(scene, camera, proj, lightDir, false);
+  glDisable(GL_STENCIL_TEST);
+
+  /* re-draw the next few tiles in full */
+  int tnx = (sx + TILE_SIZE - 1)/TILE_SIZE;
+  int tny = (sy + TILE_SIZE - 1)/TILE_SIZE;
+  unsigned int tnum = tnx*tny;
+  unsigned int tdo = static_cast<unsigned int>(ceil(_refresh*tnum));
+  glEnable(GL_SCISSOR_TEST);
+  for (unsigned int ti=0; ti<tdo; ti++) {
+    unsigned int tidx = (_tileNext + ti) % tnum;
+    /* scissor affects glClear() too */
+    glScissor(TILE_SIZE*(tidx % tnx), TILE_SIZE*(tidx / tnx),
+              TILE_SIZE, TILE_SIZE);
+    _drawScene(scene, camera, proj, lightDir);
+  }
+  glDisable(GL_SCISSOR_TEST);
+  _tileNext = (_tileNext + tdo) % tnum;
+  glErrorCheck(me, "filling");
+  if (_verbose > 1) {
+    printf("%s: reprojected, and refreshed %u of %u tiles\n", me, tdo, tnum);
+  }
+  return true;
+}
+
+} // namespace Hale
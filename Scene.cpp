@@ -23,6 +23,8 @@
 #include "Hale.h"
 #include "privateHale.h"
 
+#include <algorithm>
+
 namespace Hale {
 
 Scene::Scene() {
@@ -35,15 +37,42 @@ Scene::~Scene() {
   /* anything to clean up? */
 }
 
-void Scene::add(const Polydata *pd) { _polydata.push_back(pd); }
+void Scene::add(const Polydata *pd) {
+  _polydata.push_back(pd);
+  changed();
+}
 
-void Scene::bgColor(float rr, float gg, float bb) { ELL_3V_SET(_bgColor, rr, gg, bb); }
+void Scene::remove(const Polydata *pd) {
+  size_t num = _polydata.size();
+  _polydata.remove(pd);
+  if (num != _polydata.size()) {
+    changed();
+  }
+}
+
+void Scene::replace(const Polydata *oldpd, const Polydata *newpd) {
+  static const std::string me="Hale::Scene::replace";
+  auto pi = std::find(_polydata.begin(), _polydata.end(), oldpd);
+  if (pi == _polydata.end()) {
+    throw std::runtime_error(me + ": old Polydata not in scene");
+  }
+  *pi = newpd;
+  changed();
+}
+
+void Scene::bgColor(float rr, float gg, float bb) {
+  ELL_3V_SET(_bgColor, rr, gg, bb);
+  changed();
+}
 
 glm::vec3 Scene::bgColor() const {
   return glm::vec3(_bgColor[0], _bgColor[1], _bgColor[2]);
 }
 
-void Scene::lightDir(glm::vec3 dir) { _lightDir = glm::normalize(dir); }
+void Scene::lightDir(glm::vec3 dir) {
+  _lightDir = glm::normalize(dir);
+  changed();
+}
 glm::vec3 Scene::lightDir() const { return _lightDir; }
 
 void Scene::drawInit() {
@@ -58,7 +87,9 @@ void Scene::drawInit() {
 void Scene::bounds(glm::vec3& finalmin, glm::vec3& finalmax) const {
   glm::vec3 min, max;
   auto pi = _polydata.begin();
-  if (*pi) {
+  /* (the scene may be empty, as with an IsoStream that hasn't finished
+     any slabs yet) */
+  if (pi != _polydata.end() && *pi) {
     (*pi)->bounds(min, max);
     pi++;
     for (; pi != _polydata.end(); pi++) {
@@ -74,7 +105,9 @@ void Scene::bounds(glm::vec3& finalmin, glm::vec3& finalmax) const {
   }
 }
 
-void Scene::draw() {
+void Scene::draw(const Program *prog) {
+  static const char me[]="Hale::Scene::draw";
+  TraceZone tzone(me);
 
   glClear(GL_DEPTH_BUFFER_BIT);
   if (debugging)
@@ -83,10 +116,13 @@ void Scene::draw() {
   if (debugging)
     printf("# glClear(GL_COLOR_BUFFER_BIT);\n");
 
+  drawPolydata(prog);
+}
+
+void Scene::drawPolydata(const Program *prog) {
   for (auto pi = _polydata.begin(); pi != _polydata.end(); pi++) {
-    (*pi)->draw();
+    (*pi)->draw(prog);
   }
-
 }
 
 
@@ -0,0 +1,283 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <chrono>
+
+namespace Hale {
+
+enum {
+  commandAdd,        /* add existing Polydata */
+  commandAddMake,    /* make Polydata from limnPolyData, and add it */
+  commandRemove,
+  commandReplace,
+  commandModel,
+  commandColorSolid,
+  commandUpload
+};
+
+struct SceneQueue::Command {
+  int kind;
+  std::string name;
+  Polydata *pd;
+  limnPolyData *lpld;
+  const Program *prog;
+  glm::mat4 mat;
+  glm::vec4 rgba;
+  Command *next;
+  explicit Command(int kk, std::string nm)
+    : kind(kk), name(nm), pd(NULL), lpld(NULL), prog(NULL), next(NULL) {}
+  ~Command() {
+    /* still set if the command wasn't done */
+    if (lpld) {
+      limnPolyDataNix(lpld);
+    }
+  }
+};
+
+SceneQueue::SceneQueue(Scene *scene) : _head(NULL), _pending(0) {
+  static const std::string me="Hale::SceneQueue::SceneQueue";
+  if (!scene) {
+    throw std::runtime_error(me + ": got NULL scene");
+  }
+  _verbose = 0;
+  _scene = scene;
+  _budget = 0.004;
+}
+
+SceneQueue::~SceneQueue() {
+  Command *cmd = _head.exchange(NULL);
+  while (cmd) {
+    Command *next = cmd->next;
+    delete cmd;
+    cmd = next;
+  }
+  for (auto ci = _ready.begin(); ci != _ready.end(); ci++) {
+    delete *ci;
+  }
+  for (auto ni = _named.begin(); ni != _named.end(); ni++) {
+    _scene->remove(ni->second);
+    if (_owned[ni->first]) {
+      delete ni->second;
+    }
+  }
+}
+
+void SceneQueue::verbose(int vv) { _verbose = vv; }
+int SceneQueue::verbose() const { return _verbose; }
+void SceneQueue::budget(double sec) { _budget = sec; }
+double SceneQueue::budget() const { return _budget; }
+void SceneQueue::wake(std::function<void()> wk) { _wake = wk; }
+unsigned int SceneQueue::pending() const { return _pending; }
+
+/* the usual lock-free (Treiber) stack push; drain() takes the whole stack
+   at once, so there is no ABA problem */
+void SceneQueue::_push(Command *cmd) {
+  _pending++;
+  Command *head = _head.load(std::memory_order_relaxed);
+  do {
+    cmd->next = head;
+  } while (!_head.compare_exchange_weak(head, cmd,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed));
+  /* (cmd may already be drained and deleted, so only look at head) */
+  if (!head && _wake) {
+    _wake();
+  }
+}
+
+void SceneQueue::add(Polydata *pd) {
+  static const std::string me="Hale::SceneQueue::add";
+  if (!pd) {
+    throw std::runtime_error(me + ": got NULL Polydata");
+  }
+  Command *cmd = new Command(commandAdd, pd->name());
+  cmd->pd = pd;
+  _push(cmd);
+}
+
+void SceneQueue::add(limnPolyData *lpld, const Program *prog,
+                     std::string name) {
+  static const std::string me="Hale::SceneQueue::add";
+  if (!(lpld && prog)) {
+    throw std::runtime_error(me + ": got NULL lpld or prog");
+  }
+  if (name.empty()) {
+    throw std::runtime_error(me + ": need non-empty name");
+  }
+  Command *cmd = new Command(commandAddMake, name);
+  cmd->lpld = lpld;
+  cmd->prog = prog;
+  _push(cmd);
+}
+
+void SceneQueue::remove(std::string name) {
+  _push(new Command(commandRemove, name));
+}
+
+void SceneQueue::replace(std::string name, limnPolyData *lpld,
+                         const Program *prog) {
+  static const std::string me="Hale::SceneQueue::replace";
+  if (!(lpld && prog)) {
+    throw std::runtime_error(me + ": got NULL lpld or prog");
+  }
+  Command *cmd = new Command(commandReplace, name);
+  cmd->lpld = lpld;
+  cmd->prog = prog;
+  _push(cmd);
+}
+
+void SceneQueue::model(std::string name, glm::mat4 mat) {
+  Command *cmd = new Command(commandModel, name);
+  cmd->mat = mat;
+  _push(cmd);
+}
+
+void SceneQueue::colorSolid(std::string name, glm::vec4 rgba) {
+  Command *cmd = new Command(commandColorSolid, name);
+  cmd->rgba = rgba;
+  _push(cmd);
+}
+
+void SceneQueue::upload(std::string name, limnPolyData *lpld) {
+  static const std::string me="Hale::SceneQueue::upload";
+  if (!lpld) {
+    throw std::runtime_error(me + ": got NULL lpld");
+  }
+  Command *cmd = new Command(commandUpload, name);
+  cmd->lpld = lpld;
+  _push(cmd);
+}
+
+Polydata *SceneQueue::polydata(std::string name) {
+  auto ni = _named.find(name);
+  return ni == _named.end() ? NULL : ni->second;
+}
+
+/* removes named Polydata from the scene, deleting it if we made it */
+void SceneQueue::_drop(const std::string &name) {
+  Polydata *pd = _named[name];
+  _scene->remove(pd);
+  if (_owned[name]) {
+    delete pd;
+  }
+  _named.erase(name);
+  _owned.erase(name);
+}
+
+void SceneQueue::_do(Command *cmd) {
+  static const char me[]="Hale::SceneQueue::_do";
+  Polydata *pd = NULL;
+
+  if (commandAdd == cmd->kind || commandAddMake == cmd->kind) {
+    if (_named.count(cmd->name)) {
+      fprintf(stderr, "%s: already have Polydata \"%s\"; not adding\n",
+              me, cmd->name.c_str());
+      return;
+    }
+    if (commandAdd == cmd->kind) {
+      pd = cmd->pd;
+    } else {
+      pd = new Polydata(cmd->lpld, true, cmd->prog, cmd->name);
+      cmd->lpld = NULL; // now pd's
+    }
+    _named[cmd->name] = pd;
+    _owned[cmd->name] = (commandAddMake == cmd->kind);
+    _scene->add(pd);
+    return;
+  }
+  /* else the command is about an existing Polydata */
+  pd = polydata(cmd->name);
+  if (!pd) {
+    fprintf(stderr, "%s: no Polydata \"%s\"; dropping command %d\n",
+            me, cmd->name.c_str(), cmd->kind);
+    return;
+  }
+  switch (cmd->kind) {
+  case commandRemove:
+    _drop(cmd->name);
+    break;
+  case commandReplace:
+    {
+      Polydata *npd = new Polydata(cmd->lpld, true, cmd->prog, cmd->name);
+      cmd->lpld = NULL;
+      npd->model(pd->model());
+      npd->colorSolid(pd->colorSolid());
+      _scene->replace(pd, npd);
+      if (_owned[cmd->name]) {
+        delete pd;
+      }
+      _named[cmd->name] = npd;
+      _owned[cmd->name] = true;
+    }
+    break;
+  case commandModel:
+    pd->model(cmd->mat);
+    break;
+  case commandColorSolid:
+    pd->colorSolid(cmd->rgba);
+    break;
+  case commandUpload:
+    pd->lpld(cmd->lpld, true);
+    cmd->lpld = NULL;
+    break;
+  }
+}
+
+unsigned int SceneQueue::drain() {
+  static const char me[]="Hale::SceneQueue::drain";
+  TraceZone tzone(me);
+
+  /* take everything pushed so far, and put it after what's left from last
+     time, in the order it was pushed */
+  Command *cmd = _head.exchange(NULL, std::memory_order_acquire);
+  std::vector<Command *> pushed;
+  for (; cmd; cmd = cmd->next) {
+    pushed.push_back(cmd);
+  }
+  _ready.insert(_ready.end(), pushed.rbegin(), pushed.rend());
+  auto start = std::chrono::steady_clock::now();
+  unsigned int done = 0;
+  while (_ready.size()) {
+    if (done && (std::chrono::duration<double>
+                 (std::chrono::steady_clock::now() - start).count()
+                 > _budget)) {
+      break;
+    }
+    cmd = _ready.front();
+    _ready.pop_front();
+    _do(cmd);
+    delete cmd;
+    _pending--;
+    done++;
+  }
+  if (_verbose && done) {
+    printf("%s: did %u commands; %u left\n", me, done,
+           static_cast<unsigned int>(_ready.size()));
+  }
+  return _pending;
+}
+
+} // namespace Hale
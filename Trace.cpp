@@ -0,0 +1,211 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "Hale.h"
+#include "privateHale.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace Hale {
+
+/*
+** Each thread that records a zone gets its own buffer, so that recording
+** only ever takes the (uncontended) per-buffer lock; the global lock is
+** only taken when a thread records its first zone, and when saving.
+*/
+typedef struct {
+  const char *name;  // not owned: string literal or static "me[]"
+  std::string detail; // optional, e.g. Polydata name
+  double ts, dur;    // microseconds since _traceOrigin
+} traceEvent;
+
+typedef struct {
+  unsigned int tid;
+  std::string threadName;
+  std::mutex lock;
+  std::vector<traceEvent> event;
+} traceBuffer;
+
+static std::atomic<bool> _traceOn(false);
+static std::mutex _traceLock;
+static std::vector<traceBuffer *> _traceBuffer;
+static std::string _traceFname;
+static const std::chrono::steady_clock::time_point
+  _traceOrigin = std::chrono::steady_clock::now();
+static thread_local traceBuffer *_traceBufferMine = NULL;
+
+static double
+traceNow() {
+  return std::chrono::duration<double, std::micro>
+    (std::chrono::steady_clock::now() - _traceOrigin).count();
+}
+
+static traceBuffer *
+traceBufferMine() {
+  if (!_traceBufferMine) {
+    traceBuffer *tbuf = new traceBuffer;
+    std::lock_guard<std::mutex> guard(_traceLock);
+    tbuf->tid = static_cast<unsigned int>(_traceBuffer.size()) + 1;
+    _traceBuffer.push_back(tbuf);
+    _traceBufferMine = tbuf;
+  }
+  return _traceBufferMine;
+}
+
+void traceEnable(bool on) { _traceOn.store(on); }
+bool traceEnabled() { return _traceOn.load(std::memory_order_relaxed); }
+
+void traceFile(const char *fname) { _traceFname = fname ? fname : ""; }
+std::string traceFile() { return _traceFname; }
+
+void
+traceThreadName(const char *name) {
+  traceBuffer *tbuf = traceBufferMine();
+  std::lock_guard<std::mutex> guard(tbuf->lock);
+  tbuf->threadName = name ? name : "";
+}
+
+void
+traceClear() {
+  std::lock_guard<std::mutex> guard(_traceLock);
+  for (auto bi = _traceBuffer.begin(); bi != _traceBuffer.end(); bi++) {
+    std::lock_guard<std::mutex> bguard((*bi)->lock);
+    (*bi)->event.clear();
+  }
+}
+
+/* the strings we write are names of functions and Polydata, but they
+   still have to be valid JSON */
+static void
+jsonString(FILE *file, const char *str) {
+  fputc('"', file);
+  for (const char *cc = str; *cc; cc++) {
+    if ('"' == *cc || '\\' == *cc) {
+      fprintf(file, "\\%c", *cc);
+    } else if (static_cast<unsigned char>(*cc) < 0x20) {
+      fprintf(file, "\\u%04x", static_cast<unsigned char>(*cc));
+    } else {
+      fputc(*cc, file);
+    }
+  }
+  fputc('"', file);
+}
+
+void
+traceSave(const char *fname) {
+  static const std::string me="Hale::traceSave";
+  FILE *file;
+  bool first = true;
+
+  if (!fname) {
+    throw std::runtime_error(me + ": got NULL fname");
+  }
+  if (!(file = fopen(fname, "w"))) {
+    throw std::runtime_error(me + ": unable to open \"" + fname + "\" for writing: "
+                             + std::strerror(errno));
+  }
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> guard(_traceLock);
+  unsigned int evtNum = 0;
+  for (auto bi = _traceBuffer.begin(); bi != _traceBuffer.end(); bi++) {
+    traceBuffer *tbuf = *bi;
+    std::lock_guard<std::mutex> bguard(tbuf->lock);
+    if (!tbuf->threadName.empty()) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", tbuf->tid);
+      jsonString(file, tbuf->threadName.c_str());
+      fprintf(file, "}}");
+      first = false;
+    }
+    for (auto ei = tbuf->event.begin(); ei != tbuf->event.end(); ei++) {
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      jsonString(file, ei->name);
+      fprintf(file, ",\"cat\":\"hale\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f", tbuf->tid, ei->ts, ei->dur);
+      if (!ei->detail.empty()) {
+        fprintf(file, ",\"args\":{\"detail\":");
+        jsonString(file, ei->detail.c_str());
+        fprintf(file, "}");
+      }
+      fprintf(file, "}");
+      first = false;
+    }
+    evtNum += static_cast<unsigned int>(tbuf->event.size());
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  printf("%s: saved %u events to %s\n", me.c_str(), evtNum, fname);
+}
+
+TraceZone::TraceZone(const char *name) {
+  if (_traceOn.load(std::memory_order_relaxed)) {
+    _name = name;
+    _start = traceNow();
+  } else {
+    _name = NULL;
+  }
+}
+
+TraceZone::TraceZone(const char *name, const char *detail) {
+  if (_traceOn.load(std::memory_order_relaxed)) {
+    _name = name;
+    if (detail) {
+      _detail = detail;
+    }
+    _start = traceNow();
+  } else {
+    _name = NULL;
+  }
+}
+
+TraceZone::TraceZone(const char *name, double value) {
+  if (_traceOn.load(std::memory_order_relaxed)) {
+    char buff[64];
+    snprintf(buff, sizeof(buff), "%g", value);
+    _name = name;
+    _detail = buff;
+    _start = traceNow();
+  } else {
+    _name = NULL;
+  }
+}
+
+TraceZone::~TraceZone() {
+  if (!_name) {
+    /* tracing was off when we started; nothing to record */
+    return;
+  }
+  double now = traceNow();
+  traceBuffer *tbuf = traceBufferMine();
+  std::lock_guard<std::mutex> guard(tbuf->lock);
+  tbuf->event.push_back(traceEvent());
+  traceEvent &evt = tbuf->event.back();
+  evt.name = _name;
+  evt.detail.swap(_detail);
+  evt.ts = _start;
+  evt.dur = now - _start;
+}
+
+} // namespace Hale
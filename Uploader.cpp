@@ -0,0 +1,250 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+struct Uploader::Job {
+  Polydata *pd;
+  PolydataBuffers *pb;
+  GLsync fence;
+  bool cancelled;
+  explicit Job(Polydata *pp, limnPolyData *poly, bool own)
+    : pd(pp), pb(new PolydataBuffers(poly, own)), fence(0),
+      cancelled(false) {}
+  /* needs a current context if the buffers have been filled */
+  ~Job() {
+    delete pb;
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+};
+
+Uploader::Uploader(std::function<void(bool)> current,
+                   std::function<void()> nix) {
+  _verbose = 0;
+  _current = current;
+  _nix = nix;
+  _busy = NULL;
+  _quit = false;
+  _thread = std::thread(&Uploader::_work, this);
+}
+
+Uploader::~Uploader() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _cond.notify_all();
+  /* the upload thread deletes all jobs before it finishes */
+  _thread.join();
+  _nix();
+}
+
+void Uploader::verbose(int vv) { _verbose = vv; }
+int Uploader::verbose() const { return _verbose; }
+
+void Uploader::wake(std::function<void()> wk) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _wake = wk;
+}
+
+void Uploader::upload(Polydata *pd, limnPolyData *poly, bool own) {
+  static const std::string me="Hale::Uploader::upload";
+  if (!(pd && poly)) {
+    throw std::runtime_error(me + ": got NULL pd or poly");
+  }
+  Job *job = new Job(pd, poly, own);
+  std::deque<Job *> stale;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto ji = _todo.begin(); ji != _todo.end(); ) {
+      if ((*ji)->pd == pd) {
+        stale.push_back(*ji);
+        ji = _todo.erase(ji);
+      } else {
+        ji++;
+      }
+    }
+    _todo.push_back(job);
+  }
+  _cond.notify_all();
+  /* (nothing was filled, so no GL needed) */
+  for (auto ji = stale.begin(); ji != stale.end(); ji++) {
+    delete *ji;
+  }
+  if (_verbose && stale.size()) {
+    printf("%s: %u older upload(s) for %s dropped\n", me.c_str(),
+           static_cast<unsigned int>(stale.size()), pd->name().c_str());
+  }
+}
+
+void Uploader::cancel(const Polydata *pd) {
+  std::deque<Job *> stale;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto ji = _todo.begin(); ji != _todo.end(); ) {
+      if ((*ji)->pd == pd) {
+        stale.push_back(*ji);
+        ji = _todo.erase(ji);
+      } else {
+        ji++;
+      }
+    }
+    for (auto ji = _done.begin(); ji != _done.end(); ) {
+      if ((*ji)->pd == pd) {
+        /* these have buffers, so need a context to be deleted */
+        _trash.push_back(*ji);
+        ji = _done.erase(ji);
+      } else {
+        ji++;
+      }
+    }
+    _cond.notify_all();
+    if (_busy && _busy->pd == pd) {
+      /* its limnPolyData may be about to go away */
+      _busy->cancelled = true;
+      _cond.wait(lock, [this, pd]() { return !(_busy && _busy->pd == pd); });
+    }
+  }
+  for (auto ji = stale.begin(); ji != stale.end(); ji++) {
+    delete *ji;
+  }
+}
+
+unsigned int Uploader::pending() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _todo.size() + _done.size() + (_busy && !_busy->cancelled ? 1 : 0);
+}
+
+unsigned int Uploader::ready() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _done.size();
+}
+
+void Uploader::_work() {
+  static const char me[]="Hale::Uploader::_work";
+  traceThreadName("upload");
+
+  _current(true);
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _cond.wait(lock, [this]() {
+        return _quit || _todo.size() || _trash.size();
+      });
+    while (_trash.size()) {
+      delete _trash.front();
+      _trash.pop_front();
+    }
+    if (_quit) {
+      break;
+    }
+    if (!_todo.size()) {
+      continue;
+    }
+    _busy = _todo.front();
+    _todo.pop_front();
+    lock.unlock();
+    {
+      TraceZone tzone(me, (traceEnabled()
+                           ? _busy->pd->name().c_str() : NULL));
+      _busy->pb->fill();
+      _busy->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      /* so that the fence (and the buffer data before it) gets to the GPU
+         without waiting for more commands from this context */
+      glFlush();
+      if (debugging)
+        printf("# glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); glFlush();\n");
+    }
+    lock.lock();
+    bool cancelled = _busy->cancelled;
+    if (cancelled) {
+      delete _busy;
+    } else {
+      _done.push_back(_busy);
+    }
+    _busy = NULL;
+    /* (cancel() may be waiting for this) */
+    _cond.notify_all();
+    if (!cancelled && _wake) {
+      /* not holding our lock, since whoever we wake may be calling
+         ready() while holding theirs */
+      std::function<void()> wake = _wake;
+      lock.unlock();
+      wake();
+      lock.lock();
+    }
+  }
+  /* quitting: nothing else will swap() these, and only here is there a
+     context for deleting their buffers */
+  while (_todo.size()) {
+    delete _todo.front();
+    _todo.pop_front();
+  }
+  while (_done.size()) {
+    delete _done.front();
+    _done.pop_front();
+  }
+  lock.unlock();
+  _current(false);
+}
+
+unsigned int Uploader::swap() {
+  static const char me[]="Hale::Uploader::swap";
+  std::deque<Job *> done;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    /* the fences signal in order, so stop at the first that hasn't */
+    while (_done.size()) {
+      GLenum ret = glClientWaitSync(_done.front()->fence, 0, 0);
+      if (GL_ALREADY_SIGNALED != ret && GL_CONDITION_SATISFIED != ret) {
+        break;
+      }
+      done.push_back(_done.front());
+      _done.pop_front();
+    }
+  }
+  if (done.size()) {
+    TraceZone tzone(me);
+    for (auto ji = done.begin(); ji != done.end(); ji++) {
+      Polydata *pd = (*ji)->pd;
+      bool newer = false;
+      for (auto ki = ji + 1; ki != done.end(); ki++) {
+        newer |= ((*ki)->pd == pd);
+      }
+      if (!newer) {
+        pd->buffers((*ji)->pb);
+        if (_verbose) {
+          printf("%s: new buffers for %s\n", me, pd->name().c_str());
+        }
+      }
+      delete *ji;
+    }
+  }
+  return pending();
+}
+
+} // namespace Hale
@@ -28,6 +28,9 @@
    triggered there */
 #define MARG 0.18
 
+/* with interactAdapt(), the smallest render scale we'll go to */
+#define SCALE_MIN 0.2
+
 namespace Hale {
 
 /* The idea is that FOV itself is not really a quantity that makes sense
@@ -110,22 +113,6 @@ Viewer::mode() const {
   return _mode;
 }
 
-void
-Viewer::_buffAlloc(void) {
-  static const char me[]="Hale::Viewer::_buffAlloc";
-  for (unsigned int ii=0; ii<=1; ii++) {
-    if (nrrdMaybeAlloc_va(_nbuffRGBA[ii], nrrdTypeUChar, 3, (size_t)4,
-                          (size_t)_widthBuffer, (size_t)_heightBuffer)) {
-      char *err = biffGetDone(NRRD);
-      fprintf(stderr, "%s: error allocating %u x %u RGBA buffer:\n%s", me,
-              _widthBuffer, _heightBuffer, err);
-      free(err);
-    }
-    _buffRGBA[ii] = (unsigned char *)(_nbuffRGBA[ii]->data);
-  }
-  return;
-}
-
 void
 Viewer::framebufferSizeCB(GLFWwindow *gwin, int newWidth, int newHeight) {
   static const char me[]="framebufferSizeCB";
@@ -136,10 +123,10 @@ Viewer::framebufferSizeCB(GLFWwindow *gwin, int newWidth, int newHeight) {
   }
   vwr->_widthBuffer = newWidth;
   vwr->_heightBuffer = newHeight;
-  vwr->_buffAlloc();
   glfwGetWindowSize(gwin, &(vwr->_widthScreen), &(vwr->_heightScreen));
   vwr->shapeUpdate();
   vwr->title();
+  vwr->redraw();
   return;
 }
 
@@ -206,17 +193,28 @@ Viewer::keyCB(GLFWwindow *gwin, int key, int scancode, int action, int mods) {
   } else if (GLFW_KEY_S == key && GLFW_PRESS == action) {
     vwr->snap();
   } else if (GLFW_KEY_R == key && GLFW_PRESS == action) {
-    glm::vec3 wmin, wmax, wmed;
-    vwr->_scene->bounds(wmin, wmax);
-    wmed = (wmin + wmax)/2.0f;
-    vwr->camera.at(wmed);
-    vwr->camera.up(glm::vec3(0.0f,0.0f,1.0f));
-    float diff = glm::length(wmax - wmin);
-    float dist = (diff/2)/tanf((fovBest/2)*M_PI/180);
-    vwr->camera.from(vwr->camera.at() - glm::vec3(dist, 0.0f, 0.0f));
-    vwr->camera.clipNear(-diff/2);
-    vwr->camera.clipFar(diff/2);
-    // leave aspect and orthographic as is
+    if (vwr->_threaded) {
+      /* the scene belongs to the render thread, which finds the bounds
+         and hands them back for _cameraReset() */
+      vwr->_resetAsk = true;
+      vwr->_renderWake();
+    } else {
+      glm::vec3 wmin, wmax;
+      vwr->_scene->bounds(wmin, wmax);
+      vwr->_cameraReset(wmin, wmax);
+    }
+  } else if (GLFW_KEY_A == key && GLFW_PRESS == action) {
+    vwr->interactAdapt(!vwr->interactAdapt());
+    if (vwr->verbose()) {
+      printf("%s: adaptive resolution while interacting is now %s\n", me,
+             vwr->interactAdapt() ? "on" : "off");
+    }
+  } else if (GLFW_KEY_P == key && GLFW_PRESS == action) {
+    vwr->reproject(!vwr->reproject());
+    if (vwr->verbose()) {
+      printf("%s: reprojection while interacting is now %s\n", me,
+             vwr->reproject() ? "on" : "off");
+    }
   } else if (GLFW_KEY_V == key && GLFW_PRESS == action) {
     int vv = vwr->verbose();
     vv += mods ? -1 : 1;
@@ -230,7 +228,11 @@ Viewer::keyCB(GLFWwindow *gwin, int key, int scancode, int action, int mods) {
     }
   } else if (GLFW_KEY_SPACE  == key && GLFW_PRESS == action) {
     if (vwr->_tvalue) {
-      *(vwr->_tvalue) = !(*(vwr->_tvalue));
+      vwr->_tNow = !vwr->_tNow;
+      if (!vwr->_threaded) {
+        *(vwr->_tvalue) = vwr->_tNow;
+      }
+      vwr->redraw();
       //printf("%s: toggle is now %d\n", me, *(vwr->_tvalue));
     }
   }
@@ -238,6 +240,19 @@ Viewer::keyCB(GLFWwindow *gwin, int key, int scancode, int action, int mods) {
   return;
 }
 
+void
+Viewer::_cameraReset(glm::vec3 wmin, glm::vec3 wmax) {
+  glm::vec3 wmed = (wmin + wmax)/2.0f;
+  camera.at(wmed);
+  camera.up(glm::vec3(0.0f,0.0f,1.0f));
+  float diff = glm::length(wmax - wmin);
+  float dist = (diff/2)/tanf((fovBest/2)*M_PI/180);
+  camera.from(camera.at() - glm::vec3(dist, 0.0f, 0.0f));
+  camera.clipNear(-diff/2);
+  camera.clipFar(diff/2);
+  // leave aspect and orthographic as is
+}
+
 void Viewer::helpPrint(FILE *file) const {
   fprintf(file, "\n");
   fprintf(file, "Clicking and dragging in different parts of the window does different\n");
@@ -275,6 +290,8 @@ void Viewer::helpPrint(FILE *file) const {
   fprintf(file, "Q or shift-q or command-q or cntl-q: quit\n");
   fprintf(file, "r: reset camera to make everything visible\n");
   fprintf(file, "u: fix up vector\n");
+  fprintf(file, "a: toggle lower resolution (for speed) while interacting\n");
+  fprintf(file, "p: toggle re-using previous frame (for speed) while interacting\n");
   fprintf(file, "v,V: for debugging: increase,decrease verbosity\n");
 }
 
@@ -283,6 +300,7 @@ void Viewer::slider(double *slvalue, double min, double max) {
     _slvalue = slvalue;
     _slmin = min;
     _slmax = max;
+    _slNow = *slvalue;
     _slidable = true;
   } else {
     _slvalue = NULL;
@@ -304,6 +322,7 @@ void Viewer::sliding(bool sld) {
 
 void Viewer::toggle(int *tvalue) {
   _tvalue = tvalue;
+  _tNow = tvalue ? *tvalue : 0;
   return;
 }
 
@@ -328,8 +347,10 @@ Viewer::windowRefreshCB(GLFWwindow *gwin) {
   if (vwr->verbose() > 1) {
     printf("%s()\n", me);
   }
-  if (vwr->_refreshCB) {
+  if (vwr->_refreshCB && !vwr->_threaded) {
     vwr->_refreshCB(vwr->_refreshData);
+  } else {
+    vwr->redraw();
   }
 
   return;
@@ -356,9 +377,12 @@ modemap(bool butt0, double xf, double yf) {
 
 void
 Viewer::_slrevalue(const char *me, double xx) {
-  *(_slvalue) = AIR_AFFINE(0, xx, width(), _slmin, _slmax);
+  _slNow = AIR_AFFINE(0, xx, width(), _slmin, _slmax);
+  if (!_threaded) {
+    *(_slvalue) = _slNow;
+  }
   if (_verbose > 1) {
-    printf("%s(%g): slvalue = %g\n", me, xx, *(_slvalue));
+    printf("%s(%g): slvalue = %g\n", me, xx, _slNow);
   }
 }
 
@@ -368,6 +392,8 @@ Viewer::mouseButtonCB(GLFWwindow *gwin, int button, int action, int mods) {
   Viewer *vwr = static_cast<Viewer*>(glfwGetWindowUserPointer(gwin));
   double xpos, ypos, xf, yf;
 
+  /* finish any motion in the current mode before changing modes */
+  vwr->_cursorApply();
   /* on Macs you can "right-click" downwards, via modifier keys, but then
      release the modifier keys before releasing the button, so tracking the
      logic of releasing the "right-click" get get messy.  Hence *any*
@@ -434,6 +460,11 @@ Viewer::mouseButtonCB(GLFWwindow *gwin, int button, int action, int mods) {
       vwr->_mode = modemap(vwr->_button[0], xf, yf);
     }
   }
+  if (viewerModeNone == vwr->_mode && !vwr->_threaded && vwr->_drawnApprox) {
+    /* done interacting; now we can take the time for full resolution.
+       (With run(true), the render thread sees the mode change) */
+    vwr->redraw();
+  }
   if (viewerModeNone != vwr->_mode) {
     /* reset the information about last position */
     vwr->_lastX = vwr->_lastY = AIR_NAN;
@@ -448,14 +479,36 @@ Viewer::mouseButtonCB(GLFWwindow *gwin, int button, int action, int mods) {
   return;
 }
 
+/* Many cursor events can arrive between frames; rather than updating the
+   camera for each one, we just remember the latest position, and the
+   camera is updated once, with _cursorApply(), before the next draw */
 void
 Viewer::cursorPosCB(GLFWwindow *gwin, double xx, double yy) {
-  static const char me[]="cursorPosCB";
   Viewer *vwr = static_cast<Viewer*>(glfwGetWindowUserPointer(gwin));
+
+  if (viewerModeNone == vwr->_mode) {
+    /* nothing to do here (and nothing to redraw) */
+    return;
+  }
+  vwr->_cursorX = xx;
+  vwr->_cursorY = yy;
+  vwr->_cursorMoved = true;
+  return;
+}
+
+void
+Viewer::_cursorApply() {
+  static const char me[]="Hale::Viewer::_cursorApply";
+  Viewer *vwr = this;
+  double xx = _cursorX, yy = _cursorY;
   float vsize, ssize, frcX, frcY, rotX, rotY, trnX, trnY;
   glm::vec3 nfrom; // new from; used in various cases
   double fff; // tmp var
 
+  if (!_cursorMoved) {
+    return;
+  }
+  _cursorMoved = false;
   if (viewerModeNone == vwr->_mode) {
     /* nothing to do here */
     return;
@@ -634,12 +687,33 @@ Viewer::Viewer(int width, int height, const char *label, Scene *scene) {
   _mode = viewerModeNone;
   _refreshCB = NULL;
   _refreshData = NULL;
+  _updateCB = NULL;
+  _updateData = NULL;
+  _sceneQueue = NULL;
+  _uploader = NULL;
+  _uploadWindow = NULL;
+  _redraw = true;
+  _changeDrawn = 0;
+  _cursorX = _cursorY = AIR_NAN;
+  _cursorMoved = false;
+  _interactAdapt = false;
+  _drawnApprox = false;
+  _frameTarget = 1.0/60;
+  _renderScale = 1.0;
+  _frameTime = _drawStart = AIR_NAN;
+  _fbuffScaled = NULL;
+  _governor = NULL;
+  _reprojWant = false;
+  _reproj = NULL;
+  _threaded = false;
+  _resetAsk = false;
   _widthScreen = width;
   _heightScreen = height;
   _lastX = _lastY = AIR_NAN;
   _slvalue = NULL;
   _tvalue = NULL;
-  _slmin = _slmax = AIR_NAN;
+  _slmin = _slmax = _slNow = AIR_NAN;
+  _tNow = 0;
   _slidable = false;
   _sliding = false;
 
@@ -661,9 +735,10 @@ Viewer::Viewer(int width, int height, const char *label, Scene *scene) {
   }
 
   glfwGetFramebufferSize(_window, &_widthBuffer, &_heightBuffer);
-  _nbuffRGBA[0] = nrrdNew();
-  _nbuffRGBA[1] = nrrdNew();
-  _buffAlloc();
+  _snapFormat = imageFormatPNG;
+  _readback = NULL;
+  _encoder = NULL;
+  _capture = NULL;
   glfwSetWindowUserPointer(_window, static_cast<void*>(this));
   glfwSetCursorPosCallback(_window, cursorPosCB);
   glfwSetMouseButtonCallback(_window, mouseButtonCB);
@@ -675,13 +750,25 @@ Viewer::Viewer(int width, int height, const char *label, Scene *scene) {
 
   shapeUpdate();
   title();
+  _stateSet(_state);
   printf("\nType 'r' to reset view, 'h' for help using keyboard and viewer\n");
 }
 
 Viewer::~Viewer() {
   //static const char me[]="Viewer::~Viewer";
-  nrrdNuke(_nbuffRGBA[0]);
-  nrrdNuke(_nbuffRGBA[1]);
+  if (_sceneQueue) {
+    _sceneQueue->wake(NULL);
+  }
+  current();
+  delete _uploader;  // joins the upload thread
+  /* GLFW windows have to be destroyed on the main thread, as here */
+  if (_uploadWindow) {
+    glfwDestroyWindow(_uploadWindow);
+  }
+  delete _readback;  // finishes pending reads
+  delete _encoder;   // finishes pending saves
+  delete _fbuffScaled;
+  delete _reproj;
   glfwDestroyWindow(_window);
 }
 
@@ -713,73 +800,591 @@ void Viewer::refreshCB(ViewerRefresher cb) { _refreshCB = cb; }
 ViewerRefresher Viewer::refreshCB() { return _refreshCB; }
 void Viewer::refreshData(void *data) { _refreshData = data; }
 void *Viewer::refreshData() { return _refreshData; }
+void Viewer::updateCB(ViewerRefresher cb) { _updateCB = cb; }
+ViewerRefresher Viewer::updateCB() { return _updateCB; }
+void Viewer::updateData(void *data) { _updateData = data; }
+void *Viewer::updateData() { return _updateData; }
+
+void Viewer::interactAdapt(bool adapt) {
+  /* _renderScale is reset (when turning this off) by _stateUse() */
+  _interactAdapt = adapt;
+}
+bool Viewer::interactAdapt() const { return _interactAdapt; }
+void Viewer::frameTarget(double sec) {
+  static const std::string me="Hale::Viewer::frameTarget";
+  if (!(sec > 0)) {
+    throw std::runtime_error(me + ": need positive time (not "
+                             + std::to_string(sec) + ")");
+  }
+  _frameTarget = sec;
+}
+double Viewer::frameTarget() const { return _frameTarget; }
+void Viewer::renderScale(double scl) {
+  static const std::string me="Hale::Viewer::renderScale";
+  if (!(0 < scl && scl <= 1)) {
+    throw std::runtime_error(me + ": need scale in (0,1] (not "
+                             + std::to_string(scl) + ")");
+  }
+  if (scl != _renderScale) {
+    _renderScale = scl;
+    redraw();
+  }
+}
+double Viewer::renderScale() const { return _renderScale; }
+double Viewer::frameTime() const { return _frameTime; }
+void Viewer::governor(Governor *gov) { _governor = gov; }
+Governor *Viewer::governor() { return _governor; }
+
+void Viewer::reproject(bool repr) {
+  /* the Reproject is created or deleted by the next draw() */
+  _reprojWant = repr;
+  redraw();
+}
+bool Viewer::reproject() const { return _reprojWant; }
+
+/* the display refresh period, or 0 if not known */
+static double
+refreshPeriod() {
+  GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+  const GLFWvidmode *vmode = monitor ? glfwGetVideoMode(monitor) : NULL;
+  return (vmode && vmode->refreshRate > 0 ? 1.0/vmode->refreshRate : 0);
+}
+
+/* Adapts _renderScale according to the time of the last frame (while
+   interacting). The time to draw is taken to be proportional to the number
+   of pixels, i.e. to the square of the scale, so scaling down is by the
+   square root of the time ratio; scaling up is more cautious. Nothing can
+   be faster than the display refresh (with glfwSwapInterval(1)), so a
+   frame that took one refresh period counts as fast enough */
+void Viewer::_renderScaleUpdate() {
+  static const char me[]="Hale::Viewer::_renderScaleUpdate";
+  double budget = AIR_MAX(_frameTarget, refreshPeriod());
+  double scl = _renderScale;
+  if (_frameTime > 1.15*budget) {
+    scl *= AIR_MAX(0.5, sqrt(budget/_frameTime));
+  } else if (_frameTime < 1.05*budget) {
+    scl *= 1.1;
+  }
+  scl = AIR_CLAMP(SCALE_MIN, scl, 1.0);
+  if (_verbose > 1 && scl != _renderScale) {
+    printf("%s: frame time %g (budget %g) --> scale %g\n", me,
+           _frameTime, budget, scl);
+  }
+  _renderScale = scl;
+}
+
+void Viewer::sceneQueue(SceneQueue *queue) {
+  if (_sceneQueue) {
+    _sceneQueue->wake(NULL);
+  }
+  _sceneQueue = queue;
+  if (queue) {
+    /* (either run() might be waiting) */
+    queue->wake([this]() {
+        glfwPostEmptyEvent();
+        _renderWake();
+      });
+  }
+}
+SceneQueue *Viewer::sceneQueue() { return _sceneQueue; }
+
+Uploader *Viewer::uploader() {
+  static const std::string me="Hale::Viewer::uploader";
+  if (!_uploader) {
+    /* a shared context has to be like ours (see constructor) */
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow *win = glfwCreateWindow(1, 1, "Hale::Uploader", NULL, _window);
+    glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+    if (!win) {
+      throw std::runtime_error(me + ": couldn't create hidden GLFW window "
+                               "with shared context");
+    }
+    /* the destructor destroys win (after the Uploader) */
+    _uploadWindow = win;
+    _uploader = new Uploader([win](bool on) {
+        glfwMakeContextCurrent(on ? win : NULL);
+      }, []() {});
+    _uploader->wake([this]() {
+        glfwPostEmptyEvent();
+        _renderWake();
+      });
+  }
+  return _uploader;
+}
+
+/* in run(true), camera changes are noticed in the snapshot, so the render
+   thread goes only by the other changes (which the main thread doesn't
+   make) */
+unsigned int Viewer::_changes() const {
+  return _threaded ? _sceneChangeCount : _changeCount;
+}
+
+/* Reproject re-uses the last frame for a new camera, but not after any
+   other change */
+void Viewer::_frameStart() {
+  unsigned int ccount = _sceneChangeCount;
+  if (_sceneQueue && _sceneQueue->pending()) {
+    _sceneQueue->drain();
+  }
+  if (_uploader && _uploader->ready()) {
+    _uploader->swap();
+  }
+  if (_reproj && ccount != _sceneChangeCount) {
+    _reproj->invalidate();
+  }
+}
+
+void Viewer::redraw() { _redraw = true; }
+bool Viewer::dirty() const {
+  return (_redraw || _cursorMoved || _changeDrawn != _changes()
+          || (_sceneQueue && _sceneQueue->pending())
+          || (_uploader && _uploader->ready()));
+}
+
+/* copies into st everything that draw() depends on */
+void Viewer::_stateSet(ViewerState &st) {
+  st.camera = camera;
+  st.lightDir = _lightDir;
+  st.mode = _mode;
+  st.widthBuffer = _widthBuffer;
+  st.heightBuffer = _heightBuffer;
+  st.interactAdapt = _interactAdapt;
+  st.reproject = _reprojWant;
+  st.slvalue = _slNow;
+  st.tvalue = _tNow;
+}
+
+/* makes st the state for drawing; needs the GL context */
+void Viewer::_stateUse(const ViewerState &st) {
+  if (_threaded) {
+    if (_slvalue) {
+      *(_slvalue) = st.slvalue;
+    }
+    if (_tvalue) {
+      *(_tvalue) = st.tvalue;
+    }
+  }
+  if (_state.interactAdapt && !st.interactAdapt) {
+    _renderScale = 1.0;
+  }
+  _state = st;
+  if (_state.reproject && !_reproj) {
+    _reproj = new Reproject(_state.widthBuffer, _state.heightBuffer);
+  } else if (!_state.reproject && _reproj) {
+    delete _reproj;
+    _reproj = NULL;
+  }
+}
+
+/* whether the snapshot needs drawing, if b was drawn */
+static bool
+stateDiffer(ViewerState &a, ViewerState &b) {
+  return (a.camera.view() != b.camera.view()
+          || a.camera.project() != b.camera.project()
+          || a.lightDir != b.lightDir
+          || a.mode != b.mode
+          || a.widthBuffer != b.widthBuffer
+          || a.heightBuffer != b.heightBuffer
+          || a.interactAdapt != b.interactAdapt
+          || a.reproject != b.reproject
+          || (a.slvalue != b.slvalue
+              && (AIR_EXISTS(a.slvalue) || AIR_EXISTS(b.slvalue)))
+          || a.tvalue != b.tvalue);
+}
+
+void Viewer::_renderWake() {
+  std::lock_guard<std::mutex> lock(_wakeMutex);
+  _wake.notify_one();
+}
+
+/* the render thread of run(true): everything that uses GL happens here */
+void Viewer::_renderLoop() {
+  static const char me[]="Hale::Viewer::_renderLoop";
+  traceThreadName("render");
+
+  current();
+  glfwSwapInterval(1);
+  while (!finishing) {
+    {
+      std::unique_lock<std::mutex> lock(_wakeMutex);
+      auto ready = [this]() {
+        return (finishing || _stateHandoff.fresh() || _redraw || _resetAsk
+                || _changeDrawn != _changes()
+                || (_sceneQueue && _sceneQueue->pending())
+                || (_uploader && _uploader->ready()));
+      };
+      if (_readback && _readback->pending()) {
+        /* wait, but come back around to finish snap()s */
+        _wake.wait_for(lock, std::chrono::milliseconds(10), ready);
+      } else {
+        _wake.wait(lock, ready);
+      }
+    }
+    if (finishing) {
+      break;
+    }
+    if (_readback && _readback->pending()) {
+      _readback->poll();
+    }
+    bool fresh = _stateHandoff.fetch();
+    if (fresh) {
+      _stateUse(_stateHandoff.readSlot());
+    }
+    if (_resetAsk.exchange(false)) {
+      std::pair<glm::vec3, glm::vec3> &bb = _boundsHandoff.writeSlot();
+      _scene->bounds(bb.first, bb.second);
+      _boundsHandoff.publish();
+      /* wake up the main thread to use them */
+      glfwPostEmptyEvent();
+    }
+    _frameStart();
+    if (_updateCB) {
+      unsigned int ccount = _sceneChangeCount;
+      _updateCB(_updateData);
+      if (_reproj && ccount != _sceneChangeCount) {
+        _reproj->invalidate();
+      }
+    }
+    if (!(fresh || _redraw || _changeDrawn != _changes())) {
+      continue;
+    }
+    TraceZone tzone(me, "redraw");
+    if (_refreshCB) {
+      _refreshCB(_refreshData);
+    } else {
+      draw();
+      bufferSwap();
+    }
+  }
+  glfwMakeContextCurrent(NULL);
+}
+
+void Viewer::run(bool thread) {
+  static const char me[]="Hale::Viewer::run";
+
+  if (thread) {
+    _threaded = true;
+    /* the first snapshot */
+    _stateSet(_stateHandoff.writeSlot());
+    _statePublished = _stateHandoff.writeSlot();
+    _stateHandoff.publish();
+    /* the context can only be current in one thread */
+    glfwMakeContextCurrent(NULL);
+    std::thread render(&Viewer::_renderLoop, this);
+    while (!finishing) {
+      glfwWaitEvents();
+      _cursorApply();
+      if (_boundsHandoff.fetch()) {
+        _cameraReset(_boundsHandoff.readSlot().first,
+                     _boundsHandoff.readSlot().second);
+      }
+      ViewerState &st = _stateHandoff.writeSlot();
+      _stateSet(st);
+      bool differ = stateDiffer(st, _statePublished);
+      if (differ) {
+        _statePublished = st;
+        _stateHandoff.publish();
+      }
+      if (differ || _redraw) {
+        _renderWake();
+      }
+    }
+    _renderWake();
+    render.join();
+    _threaded = false;
+    current();
+    return;
+  }
+  current();
+  /* so that bufferSwap() waits for vertical refresh: we never draw
+     more often than can be seen */
+  glfwSwapInterval(1);
+  while (!finishing) {
+    if (dirty()) {
+      /* handle whatever events are pending, but don't wait for more */
+      glfwPollEvents();
+    } else if (_readback && _readback->pending()) {
+      /* wait, but come back around to finish snap()s */
+      _readback->poll();
+      glfwWaitEventsTimeout(0.01);
+    } else {
+      /* nothing to do until something happens */
+      glfwWaitEvents();
+    }
+    /* all the cursor motion since last time, as one camera update */
+    _cursorApply();
+    _frameStart();
+    if (_updateCB) {
+      unsigned int ccount = _sceneChangeCount;
+      _updateCB(_updateData);
+      if (_reproj && ccount != _sceneChangeCount) {
+        /* we don't know what changed, so can't re-use last frame */
+        _reproj->invalidate();
+      }
+    }
+    if (finishing || !dirty()) {
+      continue;
+    }
+    TraceZone tzone(me, "redraw");
+    if (_verbose > 1) {
+      printf("%s: redrawing (%s)\n", me,
+             _redraw ? "asked" : "changed");
+    }
+    if (_refreshCB) {
+      _refreshCB(_refreshData);
+    } else {
+      draw();
+      bufferSwap();
+    }
+  }
+}
 
 void Viewer::bufferSwap() {
+  static const char me[]="Hale::Viewer::bufferSwap";
+  TraceZone tzone(me);
+  _snapRead();
+  if (_capture) {
+    glReadBuffer(GL_BACK);
+    _capture->frame(_state.widthBuffer, _state.heightBuffer);
+  }
   glfwSwapBuffers(_window);
   if (debugging)
     printf("## glfwSwapBuffers();\n");
+  if (_readback && _readback->pending()) {
+    _readback->poll();
+    if (_readback->pending()) {
+      /* make sure the event loop comes around again to finish these,
+         even if the user isn't doing anything */
+      glfwPostEmptyEvent();
+    }
+  }
+  /* what's now on screen is up-to-date */
+  _redraw = false;
+  _changeDrawn = _changes();
+  if (AIR_EXISTS(_drawStart)) {
+    _frameTime = glfwGetTime() - _drawStart;
+    _drawStart = AIR_NAN;
+    if (_governor) {
+      _governor->frame(_frameTime, refreshPeriod());
+    } else if (_state.interactAdapt && viewerModeNone != _state.mode) {
+      _renderScaleUpdate();
+    }
+  }
 }
 
 void Viewer::current() { glfwMakeContextCurrent(_window); }
 
 void Viewer::snap(const char *fname) {
-  static const char me[]="Hale::Viewer::snap";
-  glReadPixels(0, 0, _widthBuffer, _heightBuffer, GL_RGBA, GL_UNSIGNED_BYTE, _buffRGBA[0]);
-  if (nrrdFlip(_nbuffRGBA[1], _nbuffRGBA[0], 2)
-      || nrrdSave(fname, _nbuffRGBA[1], NULL)) {
-    char *err = biffGetDone(NRRD);
-    fprintf(stderr, "%s: error saving buffer:\n%s", me, err);
-    free(err);
+  static const std::string me="Hale::Viewer::snap";
+  if (!fname) {
+    throw std::runtime_error(me + ": got NULL fname");
   }
-  printf("%s: saved to %s\n", me, fname);
+  std::lock_guard<std::mutex> lock(_snapMutex);
+  _snapName.push_back(fname);
+  /* the pixels are read in bufferSwap() */
+  redraw();
 }
 
-void Viewer::snap() {
-  int si=0;
+bool Viewer::_snapPending() {
+  std::lock_guard<std::mutex> lock(_snapMutex);
+  return !_snapName.empty();
+}
+
+/* starts async reads of the back buffer, for all requested snaps, and
+   arranges for the resulting images to be saved by _encoder */
+void Viewer::_snapRead() {
+  static const char me[]="Hale::Viewer::_snapRead";
+  std::deque<std::string> names;
+  {
+    /* snap() may be called from another thread */
+    std::lock_guard<std::mutex> lock(_snapMutex);
+    names.swap(_snapName);
+  }
+  if (names.empty()) {
+    return;
+  }
+  TraceZone tzone(me);
+
+  if (!_readback) {
+    _readback = new Readback();
+    _encoder = new WorkerPool(2, "encoder");
+  }
+  glReadBuffer(GL_BACK);
+  while (names.size()) {
+    std::string fname = names.front();
+    names.pop_front();
+    WorkerPool *encoder = _encoder;
+    ReadbackDone done = [encoder, fname](Image *img) {
+      encoder->add([img, fname]() {
+          static const char me[]="Hale::Viewer::snap";
+          try {
+            img->save(fname.c_str());
+          } catch (...) {
+            delete img;
+            throw;
+          }
+          delete img;
+          printf("%s: saved to %s\n", me, fname.c_str());
+        });
+    };
+    if (!_readback->start(0, 0, _state.widthBuffer, _state.heightBuffer,
+                          done)) {
+      /* all slots are busy; rare, so just wait for them */
+      _readback->poll(true);
+      _readback->start(0, 0, _state.widthBuffer, _state.heightBuffer, done);
+    }
+  }
+}
+
+/* finds first snap-NNNN.<ext> filename not already in use. The last index
+   used is remembered, so a sequence of snaps doesn't re-probe all the
+   names before it (which was quadratic), and names handed out earlier
+   aren't re-used even if those files haven't been written yet. The index
+   is shared by all Viewers and Offscreens, which may snap() from
+   different threads, so it has its own lock (a Viewer's _snapMutex only
+   covers that Viewer) */
+std::string _snapFname(int format) {
+  static std::mutex mutex;
+  static int si=0;
+  std::lock_guard<std::mutex> lock(mutex);
   char fname[128];
   FILE *file=NULL;
+  const char *ext = airEnumStr(imageFormat, format);
   do {
-    sprintf(fname, "snap-%04d.png", si);
+    sprintf(fname, "snap-%04d.%s", si, ext);
     file = fopen(fname, "r");
     if (file) {
       fclose(file);
-      si++;
     }
+    si++;
   } while (file);
-  snap(fname);
+  return fname;
+}
+
+void Viewer::snap() {
+  snap(_snapFname(_snapFormat).c_str());
+}
+
+void Viewer::snapFormat(int format) {
+  static const std::string me="Hale::Viewer::snapFormat";
+  if (airEnumValCheck(imageFormat, format)) {
+    throw std::runtime_error(me + ": " + std::to_string(format)
+                             + " not a valid imageFormat");
+  }
+  _snapFormat = format;
+}
+int Viewer::snapFormat() const { return _snapFormat; }
+
+void Viewer::capture(Capture *cap) { _capture = cap; }
+Capture *Viewer::capture() { return _capture; }
+
+void Viewer::snapFinish() {
+  if (_readback) {
+    _readback->poll(true);
+    _encoder->wait();
+  }
 }
 
 const Scene *Viewer::scene() { return _scene; }
 void Viewer::scene(Scene *scn) { _scene = scn; }
 
-void Viewer::draw(void) {
-
-  Hale::uniform("projectMat", camera.project(), true);
+void _drawScene(Scene *scene, Camera &camera, glm::mat4 project,
+                glm::vec3 lightDir, bool clear) {
+  Hale::uniform("projectMat", project, true);
   Hale::uniform("viewMat", camera.view(), true);
   /* Here is where we convert view-space light direction into world-space */
-  glm::vec3 ldir = glm::vec3(camera.viewInv()*glm::vec4(_lightDir,0.0f));
+  glm::vec3 ldir = glm::vec3(camera.viewInv()*glm::vec4(lightDir,0.0f));
   Hale::uniform("lightDir", ldir, true);
-  _scene->draw();
+  if (clear) {
+    scene->draw();
+  } else {
+    scene->drawPolydata();
+  }
 }
 
-/*
-int Viewer::bufferSave(Nrrd *nrgba, Nrrd *ndepth) {
-  static const char me[]="Hale::Viewer::bufferSave";
+/* copies the lower-left width x height of fbuff's color into the whole
+   window (scaling up as needed), and goes back to drawing to the window */
+void Viewer::_blit(const Framebuffer *fbuff, int width, int height,
+                   GLenum filter) {
+  static const char me[]="Hale::Viewer::_blit";
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbuff->fboId());
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  int wb = _state.widthBuffer, hb = _state.heightBuffer;
+  glBlitFramebuffer(0, 0, width, height, 0, 0, wb, hb,
+                    GL_COLOR_BUFFER_BIT, filter);
+  if (debugging)
+    printf("# glBlitFramebuffer(0, 0, %d, %d, 0, 0, %d, %d, "
+           "GL_COLOR_BUFFER_BIT, %s);\n", width, height, wb, hb,
+           GL_LINEAR == filter ? "GL_LINEAR" : "GL_NEAREST");
+  glErrorCheck(me, "glBlitFramebuffer");
+  Framebuffer::unbind();
+  glViewport(0, 0, wb, hb);
+}
 
-  if (!nrgba && !ndepth) { // huh; no output requested?
-    return 0;
+void Viewer::draw(void) {
+  static const char me[]="Hale::Viewer::draw";
+  TraceZone tzone(me);
+
+  if (!_threaded) {
+    /* in case the caller has their own loop instead of run() */
+    _cursorApply();
+    /* the snapshot is used right away, rather than handed off (and isn't
+       a local, since constructing a Camera counts as a change) */
+    ViewerState &st = _stateHandoff.writeSlot();
+    _stateSet(st);
+    _stateUse(st);
   }
-
-  return 0;
+  _drawStart = glfwGetTime();
+  int wb = _state.widthBuffer, hb = _state.heightBuffer;
+  Camera &cam = _state.camera;
+  glViewport(0, 0, wb, hb);
+  bool interacting = (viewerModeNone != _state.mode);
+  /* frames that will be saved are drawn in full */
+  bool saving = _snapPending() || _capture;
+  if (_reproj) {
+    if (_reproj->width() != wb || _reproj->height() != hb) {
+      _reproj->resize(wb, hb);
+    }
+    bool full = !interacting || saving;
+    _drawnApprox = _reproj->draw(_scene, cam, _state.lightDir, full);
+    _blit(_reproj->framebuffer(), wb, hb, GL_NEAREST);
+    return;
+  }
+  if (saving
+      || !(_renderScale < 1 && (!_state.interactAdapt || interacting))) {
+    _drawScene(_scene, cam, cam.project(), _state.lightDir);
+    _drawnApprox = false;
+    return;
+  }
+  /* else draw fewer pixels, into the lower-left corner of _fbuffScaled,
+     and scale them up into the window. _fbuffScaled stays the size of the
+     window, so that changing the scale doesn't re-allocate anything */
+  int wsc = AIR_MAX(1, static_cast<int>(_renderScale*wb + 0.5));
+  int hsc = AIR_MAX(1, static_cast<int>(_renderScale*hb + 0.5));
+  if (!_fbuffScaled) {
+    _fbuffScaled = new Framebuffer(wb, hb);
+  } else if (_fbuffScaled->width() != wb || _fbuffScaled->height() != hb) {
+    _fbuffScaled->resize(wb, hb);
+  }
+  _fbuffScaled->bind();
+  glViewport(0, 0, wsc, hsc);
+  _drawScene(_scene, cam, cam.project(), _state.lightDir);
+  _blit(_fbuffScaled, wsc, hsc, GL_LINEAR);
+  /* (with a fixed scale, full resolution isn't coming) */
+  _drawnApprox = _state.interactAdapt;
 }
-*/
 
+/* (no GL here, since with run(true) this is called from the main
+   thread; draw() sets the viewport) */
 void Viewer::shapeUpdate() {
   // static const char me[]="Hale::Viewer::shapeUpdate";
 
   _pixDensity = _widthBuffer/_widthScreen;
   camera.aspect(static_cast<double>(_widthBuffer)/_heightBuffer);
-  glViewport(0, 0, _widthBuffer, _heightBuffer);
 }
 
 } // namespace Hale
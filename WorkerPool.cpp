@@ -0,0 +1,148 @@
+/*
+  Hale: support for minimalist scientific visualization
+  Copyright (C) 2014, 2015  University of Chicago
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software. Permission is granted to anyone to
+  use this software for any purpose, including commercial applications, and
+  to alter it and redistribute it freely, subject to the following
+  restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+  claim that you wrote the original software. If you use this software in a
+  product, an acknowledgment in the product documentation would be
+  appreciated but is not required.
+
+  2. Altered source versions must be plainly marked as such, and must not be
+  misrepresented as being the original software.
+
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "Hale.h"
+#include "privateHale.h"
+
+namespace Hale {
+
+WorkerPool::WorkerPool(unsigned int threadNum, const char *name) {
+
+  if (!threadNum) {
+    /* leave one core for the thread doing the rendering */
+    unsigned int hwnum = std::thread::hardware_concurrency();
+    threadNum = hwnum > 1 ? hwnum - 1 : 1;
+  }
+  _name = name ? name : "worker";
+  _running = 0;
+  _quit = false;
+  for (unsigned int ti=0; ti<threadNum; ti++) {
+    _thread.push_back(std::thread(&WorkerPool::_work, this, ti));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _wake.notify_all();
+  for (unsigned int ti=0; ti<_thread.size(); ti++) {
+    _thread[ti].join();
+  }
+}
+
+unsigned int WorkerPool::threadNum() const { return _thread.size(); }
+
+void
+WorkerPool::add(std::function<void()> task) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queue.push_back(task);
+  }
+  _wake.notify_one();
+}
+
+size_t
+WorkerPool::pending() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _queue.size() + _running;
+}
+
+void
+WorkerPool::wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_queue.size() || _running) {
+    _idle.wait(lock);
+  }
+}
+
+void
+WorkerPool::parallel(unsigned int num,
+                     std::function<void(unsigned int, unsigned int)> task) {
+  /* a few ranges per thread, for some load balancing */
+  unsigned int rnum = std::min(num, 4*threadNum());
+  if (!rnum) {
+    return;
+  }
+  std::mutex mutex;
+  std::condition_variable cond;
+  unsigned int left = rnum;
+  auto done = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!--left) {
+      cond.notify_one();
+    }
+  };
+  for (unsigned int ri=0; ri<rnum; ri++) {
+    unsigned int start = static_cast<uint64_t>(num)*ri/rnum;
+    unsigned int stop = static_cast<uint64_t>(num)*(ri + 1)/rnum;
+    add([&, start, stop]() {
+        /* (an error is reported by _work, but the range is still done) */
+        try {
+          task(start, stop);
+        } catch (...) {
+          done();
+          throw;
+        }
+        done();
+      });
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  cond.wait(lock, [&left]() { return !left; });
+}
+
+void
+WorkerPool::_work(unsigned int idx) {
+  static const char me[]="Hale::WorkerPool::_work";
+
+  traceThreadName((_name + "-" + std::to_string(idx)).c_str());
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (;;) {
+    while (!_quit && !_queue.size()) {
+      _wake.wait(lock);
+    }
+    if (!_queue.size()) {
+      /* _quit, and nothing left to do */
+      break;
+    }
+    std::function<void()> task = _queue.front();
+    _queue.pop_front();
+    _running++;
+    lock.unlock();
+    /* there is no one to catch exceptions on this thread, so errors are
+       reported here, same as other non-fatal errors */
+    try {
+      task();
+    } catch (std::exception &ex) {
+      fprintf(stderr, "%s: %s\n", me, ex.what());
+    }
+    lock.lock();
+    _running--;
+    if (!_queue.size() && !_running) {
+      _idle.notify_all();
+    }
+  }
+}
+
+} // namespace Hale
@@ -331,11 +331,7 @@ main(int argc, const char **argv) {
   }
 
   scene.drawInit();
-  render(&viewer);
-  while(!Hale::finishing){
-    glfwWaitEvents();
-    render(&viewer);
-  }
+  viewer.run();
 
   /* clean exit; all okay */
   Hale::done();
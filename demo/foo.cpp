@@ -106,6 +106,28 @@ void render(Hale::Viewer *viewer){
   viewer->bufferSwap();
 }
 
+/* what update() needs to re-isosurface as the slider moves */
+typedef struct {
+  const char *me;
+  Hale::Viewer *viewer;
+  seekContext *sctx;
+  limnPolyData *liso;
+  Hale::Polydata *hiso;
+  double *isovalue, *sliso;
+} isoState;
+
+/* called once per Viewer::run() iteration */
+void update(isoState *iss){
+  if (iss->viewer->sliding() && *(iss->sliso) != *(iss->isovalue)) {
+    *(iss->isovalue) = *(iss->sliso);
+    printf("!%s: isosurfacing at %g\n", iss->me, *(iss->isovalue));
+    seekIsovalueSet(iss->sctx, *(iss->isovalue));
+    seekUpdate(iss->sctx);
+    seekExtract(iss->sctx, iss->liso);
+    iss->hiso->rebuffer();
+  }
+}
+
 int
 main(int argc, const char **argv) {
   const char *me;
@@ -204,24 +226,37 @@ main(int argc, const char **argv) {
   }
 
   /* then create empty scene */
-  Hale::init();
+  Hale::init(!hitandquit);
   Hale::Scene scene;
-  /* then create viewer (in order to create the OpenGL context) */
-  Hale::Viewer viewer(camsize[0], camsize[1], "Iso", &scene);
-  viewer.lightDir(glm::vec3(-1.0f, 1.0f, 3.0f));
-  viewer.camera.init(glm::vec3(camfr[0], camfr[1], camfr[2]),
-                     glm::vec3(camat[0], camat[1], camat[2]),
-                     glm::vec3(camup[0], camup[1], camup[2]),
-                     camFOV, (float)camsize[0]/camsize[1],
-                     camnc, camfc, camortho);
-  viewer.refreshCB((Hale::ViewerRefresher)render);
-  viewer.refreshData(&viewer);
+  /* then create viewer (in order to create the OpenGL context), or for
+     hit-and-quit, an off-screen renderer that needs no window system */
+  Hale::Viewer *viewer = NULL;
+  Hale::Offscreen *offscr = NULL;
+  Hale::Camera *camera;
+  if (hitandquit) {
+    offscr = new Hale::Offscreen(camsize[0], camsize[1], &scene);
+    offscr->lightDir(glm::vec3(-1.0f, 1.0f, 3.0f));
+    camera = &(offscr->camera);
+  } else {
+    viewer = new Hale::Viewer(camsize[0], camsize[1], "Iso", &scene);
+    viewer->lightDir(glm::vec3(-1.0f, 1.0f, 3.0f));
+    camera = &(viewer->camera);
+  }
+  camera->init(glm::vec3(camfr[0], camfr[1], camfr[2]),
+               glm::vec3(camat[0], camat[1], camat[2]),
+               glm::vec3(camup[0], camup[1], camup[2]),
+               camFOV, (float)camsize[0]/camsize[1],
+               camnc, camfc, camortho);
   sliso = isovalue;
-  NrrdRange *range = nrrdRangeNewSet(nin, AIR_FALSE);
-  airMopAdd(mop, range, (airMopper)nrrdRangeNix, airMopAlways);
-  viewer.slider(&sliso, range->min, range->max);
-  viewer.sliding(true);
-  viewer.current();
+  if (viewer) {
+    viewer->refreshCB((Hale::ViewerRefresher)render);
+    viewer->refreshData(viewer);
+    NrrdRange *range = nrrdRangeNewSet(nin, AIR_FALSE);
+    airMopAdd(mop, range, (airMopper)nrrdRangeNix, airMopAlways);
+    viewer->slider(&sliso, range->min, range->max);
+    viewer->sliding(true);
+    viewer->current();
+  }
 
   if (!(vol = rkmVolNew(nin))) {
     airMopAdd(mop, err=biffGetDone(RKM), airFree, airMopAlways);
@@ -286,17 +321,19 @@ main(int argc, const char **argv) {
 
 
   /* then add to scene */
-  Hale::Polydata hiso(liso, true,  // hiso now owns liso
-                      Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid),
-                      "isosurface");
+  Hale::Polydata *hiso =
+    new Hale::Polydata(liso, true,  // hiso now owns liso
+                       Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid),
+                       "isosurface");
 
 
   limnPolyData *lcube = limnPolyDataNew();
   limnPolyDataCubeTriangles(lcube, 1 << limnPolyDataInfoNorm, AIR_TRUE);
-  Hale::Polydata hcube(lcube, true,
+  Hale::Polydata *hcube =
+    new Hale::Polydata(lcube, true,
                        Hale::ProgramLib(Hale::preprogramAmbDiffSolid),
                        "cube");
-  hcube.colorSolid(1,0.5,0.5);
+  hcube->colorSolid(1,0.5,0.5);
   glm::mat4 scalingMatrix = glm::mat4(1000.0f, 0.0f, 0.0f, 0.0f, 
                                       0.0f, 1000.0f, 0.0f, 0.0f, 
                                       0.0f, 0.0f, 1.0f, 0.0f,
@@ -305,40 +342,36 @@ main(int argc, const char **argv) {
                                                   (evec + 3*index[0])[1], (evec + 3*index[1])[1], (evec + 3*index[2])[1], mean[1],
                                                   (evec + 3*index[0])[2], (evec + 3*index[1])[2], (evec + 3*index[2])[2], mean[2],
                                                   0.0f, 0.0f, 0.0f, 1.0f);
-  hcube.model(glm::transpose(scalingMatrix* rotationTranslationMatrix));
-  scene.add(&hiso);
-  scene.add(&hcube);
+  hcube->model(glm::transpose(scalingMatrix* rotationTranslationMatrix));
+  scene.add(hiso);
+  scene.add(hcube);
 
   scene.drawInit();
-  render(&viewer);
   if (hitandquit) {
-    seekIsovalueSet(sctx, isovalue);
-    seekUpdate(sctx);
-    seekExtract(sctx, liso);
-    hiso.rebuffer();
-
-    render(&viewer);
-    glfwWaitEvents();
-    render(&viewer);
-    viewer.snap(name);
+    /* liso was already extracted at isovalue */
+    offscr->draw();
+    offscr->snap(name);
+    /* the Polydatas and programs are freed with the context current */
+    offscr->current();
+    delete hiso;
+    delete hcube;
+    Hale::programsDone();
+    delete offscr;
     Hale::done();
     airMopOkay(mop);
     return 0;
   }
-  while(!Hale::finishing){
-    glfwWaitEvents();
-     if (viewer.sliding() && sliso != isovalue) {
-      isovalue = sliso;
-      printf("!%s: isosurfacing at %g\n", me, isovalue);
-      seekIsovalueSet(sctx, isovalue);
-      seekUpdate(sctx);
-      seekExtract(sctx, liso);
-      hiso.rebuffer();
-    }
-    render(&viewer);
-  }
+  isoState iss = {me, viewer, sctx, liso, hiso, &isovalue, &sliso};
+  viewer->updateCB((Hale::ViewerRefresher)update);
+  viewer->updateData(&iss);
+  viewer->run();
 
   /* clean exit; all okay */
+  viewer->current();
+  delete hiso;
+  delete hcube;
+  Hale::programsDone();
+  delete viewer;
   Hale::done();
   airMopOkay(mop);
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <Hale.h>
 #include <glm/glm.hpp>
@@ -17,10 +18,38 @@ void render(Hale::Viewer *viewer){
   viewer->bufferSwap();
 }
 
+/* what update() needs to re-isosurface as the slider moves */
+typedef struct {
+  const char *me;
+  Hale::Viewer *viewer;
+  Hale::IsoSurface *iso;     // either this,
+  Hale::IsoStream *stream;   // or this, with -stream
+  double *isovalue, *sliso;
+} isoState;
+
+/* called once per Viewer::run() iteration (in the render thread, with
+   -thread); the isosurfacing itself happens in the IsoSurface's (or
+   IsoStream's) worker */
+void update(isoState *iss){
+  if (iss->viewer->sliding() && *(iss->sliso) != *(iss->isovalue)) {
+    *(iss->isovalue) = *(iss->sliso);
+    printf("%s: isosurfacing at %g\n", iss->me, *(iss->isovalue));
+    if (iss->stream) {
+      iss->stream->isovalue(*(iss->isovalue));
+    } else {
+      iss->iso->isovalue(*(iss->isovalue));
+    }
+  }
+  if (iss->stream) {
+    iss->stream->update();
+  } else {
+    iss->iso->update();
+  }
+}
+
 int
 main(int argc, const char **argv) {
   const char *me;
-  char *err;
   hestOpt *hopt=NULL;
   hestParm *hparm;
   airArray *mop;
@@ -55,8 +84,16 @@ main(int argc, const char **argv) {
   /* variables learned via hest */
   Nrrd *nin;
   float camfr[3], camat[3], camup[3], camnc, camfc, camFOV;
-  int camortho, hitandquit;
-  unsigned int camsize[2];
+  int camortho, hitandquit, adapt, govern, reproj, thread, upload, incr,
+    nets;
+  unsigned int prefetch, levelNum, streamLayers, alsoNum, cullVerts,
+    cullKeep;
+  double cullArea;
+  double *also;
+  int alsoLabel;
+  double cacheMB, cacheQuant;
+  char *capture, *gbprefix, *poster;
+  unsigned int camsize[2], postersize[2];
   double isovalue, sliso, isomin, isomax;
 
   /* boilerplate hest code */
@@ -89,8 +126,81 @@ main(int argc, const char **argv) {
   hestOptAdd(&hopt, "ortho", NULL, airTypeInt, 0, 0, &(camortho), NULL,
              "use orthographic instead of (the default) "
              "perspective projection ");
+  hestOptAdd(&hopt, "adapt", NULL, airTypeBool, 0, 0, &adapt, NULL,
+             "while interacting, render at lower resolution as needed "
+             "to keep up 60 frames per second (toggle with 'a' key)");
+  hestOptAdd(&hopt, "gov", NULL, airTypeBool, 0, 0, &govern, NULL,
+             "with -adapt, let a Hale::Governor pick the render scale, "
+             "from 5 levels, with hysteresis");
+  hestOptAdd(&hopt, "reproj", NULL, airTypeBool, 0, 0, &reproj, NULL,
+             "while interacting, re-use the previous frame where possible "
+             "(toggle with 'p' key)");
+  hestOptAdd(&hopt, "thread", NULL, airTypeBool, 0, 0, &thread, NULL,
+             "render in a separate thread from the one handling window "
+             "events");
+  hestOptAdd(&hopt, "upload", NULL, airTypeBool, 0, 0, &upload, NULL,
+             "get new isosurfaces to the GPU in a background thread, "
+             "rather than in the render thread");
+  hestOptAdd(&hopt, "cache", "MB", airTypeDouble, 1, 1, &cacheMB, "0",
+             "megabytes of isosurfaces to keep around, so that returning "
+             "to an isovalue doesn't re-isosurface");
+  hestOptAdd(&hopt, "cq", "quantum", airTypeDouble, 1, 1, &cacheQuant, "0",
+             "with -cache, round isovalues to multiples of this (0 for "
+             "1/256 of the value range)");
+  hestOptAdd(&hopt, "pf", "num", airTypeUInt, 1, 1, &prefetch, "0",
+             "with -cache, while idle, isosurface up to this many quanta "
+             "above and below the current isovalue");
+  hestOptAdd(&hopt, "lev", "num", airTypeUInt, 1, 1, &levelNum, "1",
+             "number of volume pyramid levels (including full resolution): "
+             "with more than 1, a new isovalue is first shown coarsely, "
+             "and then refined");
+  hestOptAdd(&hopt, "inc", NULL, airTypeBool, 0, 0, &incr, NULL,
+             "update the isosurface in place for a new isovalue, sending "
+             "only what changed to the GPU");
+  hestOptAdd(&hopt, "nets", NULL, airTypeBool, 0, 0, &nets, NULL,
+             "isosurface with Surface Nets rather than Marching Cubes "
+             "(fewer sliver triangles); -inc and -stream don't apply");
+  hestOptAdd(&hopt, "cv", "verts", airTypeUInt, 1, 1, &cullVerts, "0",
+             "remove connected components of the isosurface with fewer "
+             "than this many vertices (the specks of noisy volumes); "
+             "-inc doesn't apply with any of -cv, -ca, or -keep, which "
+             "don't apply with -stream");
+  hestOptAdd(&hopt, "ca", "area", airTypeDouble, 1, 1, &cullArea, "0",
+             "remove connected components with less than this area");
+  hestOptAdd(&hopt, "keep", "num", airTypeUInt, 1, 1, &cullKeep, "0",
+             "if non-zero, keep only this many of the biggest connected "
+             "components");
+  hestOptAdd(&hopt, "stream", "layers", airTypeUInt, 1, 1, &streamLayers,
+             "0", "if non-zero, don't wait for the whole isosurface: show it "
+             "as it is extracted, in slabs this many layers of (16-sample) "
+             "bricks thick (with -upload, slabs go to the GPU in the "
+             "background); -cache, -pf, -lev, and -inc don't apply");
+  hestOptAdd(&hopt, "also", "v0 v1", airTypeDouble, 0, -1, &also, "",
+             "isovalues of more surfaces to show (in different colors), "
+             "which stay put as the slider moves; all are extracted in one "
+             "pass over the volume", &alsoNum);
+  hestOptAdd(&hopt, "lab", NULL, airTypeBool, 0, 0, &alsoLabel, NULL,
+             "the -also values are labels (the volume is a label map), and "
+             "their surfaces are boundaries of the samples with those "
+             "values; with no -also values, all non-zero labels are shown");
   hestOptAdd(&hopt, "haq", NULL, airTypeBool, 0, 0, &(hitandquit), NULL,
              "save a screenshot rather than display the viewer");
+  hestOptAdd(&hopt, "gb", "prefix", airTypeString, 1, 1, &gbprefix, "",
+             "with -haq, also save G-buffer depth, position, and value "
+             "(here, the isovalue) to <prefix>-{depth,xyz,val}.nrrd, and "
+             "print the visible surface area");
+  hestOptAdd(&hopt, "poster", "fname", airTypeString, 1, 1, &poster, "",
+             "with -haq, also render a (possibly very large) image of the "
+             "same view in tiles, streamed to this file");
+  hestOptAdd(&hopt, "psz", "s0 s1", airTypeUInt, 2, 2, postersize,
+             "8192 6144", "size of the -poster image");
+  hestOptAdd(&hopt, "cap", "pattern", airTypeString, 1, 1, &capture, "",
+             "if non-empty, save every frame: either to numbered files "
+             "with this printf pattern (e.g. \"frame-%05u.png\"), or, "
+             "if it starts with \"|\", as a raw YUV 4:2:0 stream into the "
+             "command that follows (e.g. \"|ffmpeg -f rawvideo -pix_fmt "
+             "yuv420p -s 640x480 -i - iso.mp4\", with the -s reflecting "
+             "the framebuffer size)");
 
   hestParseOrDie(hopt, argc-1, argv+1, hparm,
                  me, "demo program", AIR_TRUE, AIR_TRUE, AIR_TRUE);
@@ -106,33 +216,96 @@ main(int argc, const char **argv) {
     isovalue = (isomin + isomax)/2;
   }
 
-  /* first, make sure we can isosurface ok */
+  /* first, make sure we can isosurface ok (unless streaming, which is
+     for not waiting for this). This is with Hale's Isocontour (like all
+     later isosurfaces) rather than Teem's seek, which has to be told
+     up front how much to grow its output by (and nrrdElementNumber(nin),
+     the usual choice, is absurd for big volumes); Isocontour allocates
+     exactly what's needed */
   limnPolyData *lpld = limnPolyDataNew();
-  seekContext *sctx = seekContextNew();
-  airMopAdd(mop, sctx, (airMopper)seekContextNix, airMopAlways);
-  sctx->pldArrIncr = nrrdElementNumber(nin);
-  seekVerboseSet(sctx, 0);
-  seekNormalsFindSet(sctx, AIR_TRUE);
-  if (seekDataSet(sctx, nin, NULL, 0)
-      || seekTypeSet(sctx, seekTypeIsocontour)
-      || seekIsovalueSet(sctx, isovalue)
-      || seekUpdate(sctx)
-      || seekExtract(sctx, lpld)) {
-    airMopAdd(mop, err=biffGetDone(SEEK), airFree, airMopAlways);
-    fprintf(stderr, "trouble with isosurfacing:\n%s", err);
-    airMopError(mop);
-    return 1;
+  if (!streamLayers || hitandquit) {
+    try {
+      Hale::Isocontour isoc(nin);
+      if (nets) {
+        isoc.extractNets(lpld, isovalue);
+      } else {
+        isoc.extract(lpld, isovalue);
+      }
+      if (cullVerts || cullArea > 0 || cullKeep) {
+        Hale::Components comps(isoc.threadNum());
+        comps.find(lpld);
+        unsigned int cnum = comps.num();
+        comps.cull(lpld, cullVerts, cullArea, cullKeep);
+        printf("%s: kept %u of %u connected components\n", me, comps.num(),
+               cnum);
+      }
+    } catch (std::exception &ex) {
+      fprintf(stderr, "trouble with isosurfacing:\n%s\n", ex.what());
+      limnPolyDataNix(lpld);
+      airMopError(mop);
+      return 1;
+    }
   }
-  if (!lpld->xyzwNum) {
+  if ((!streamLayers || hitandquit) && !lpld->xyzwNum) {
     fprintf(stderr, "%s: warning: No isocontour generated at isovalue %g\n",
             me, isovalue);
   }
 
   /* then create empty scene */
-  Hale::init();
+  Hale::init(!hitandquit);
   Hale::Scene scene;
-  /* then create viewer (in order to create the OpenGL context) */
-  Hale::Viewer viewer(camsize[0], camsize[1], "Iso", &scene);
+  if (hitandquit) {
+    /* render one frame off-screen, without any window (or window
+       system), and save it */
+    Hale::Offscreen offscr(camsize[0], camsize[1], &scene);
+    offscr.lightDir(glm::vec3(-1.0f, 1.0f, 3.0f));
+    offscr.camera.init(glm::vec3(camfr[0], camfr[1], camfr[2]),
+                       glm::vec3(camat[0], camat[1], camat[2]),
+                       glm::vec3(camup[0], camup[1], camup[2]),
+                       camFOV, (float)camsize[0]/camsize[1],
+                       camnc, camfc, camortho);
+    Hale::Polydata *hply =
+      new Hale::Polydata(lpld, true,  // hply now owns lpld
+                         Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid));
+    scene.add(hply);
+    scene.drawInit();
+    offscr.draw();
+    offscr.snap();
+    if (airStrlen(poster)) {
+      Hale::Poster pstr(postersize[0], postersize[1]);
+      pstr.verbose(1);
+      pstr.render(&scene, offscr.camera, offscr.lightDir(), poster);
+    }
+    if (airStrlen(gbprefix)) {
+      std::vector<float> val(lpld->xyzwNum, (float)isovalue);
+      hply->scalar(val.data(), lpld->xyzwNum);
+      Hale::GBuffer gbuff(camsize[0], camsize[1]);
+      gbuff.draw(&scene, offscr.camera);
+      gbuff.read([gbprefix](Nrrd *ndepth, Nrrd *nxyz, Nrrd *nval) {
+          printf("visible surface area: %g\n", Hale::gbufferArea(nxyz));
+          std::string pfx(gbprefix);
+          if (nrrdSave((pfx + "-depth.nrrd").c_str(), ndepth, NULL)
+              || nrrdSave((pfx + "-xyz.nrrd").c_str(), nxyz, NULL)
+              || nrrdSave((pfx + "-val.nrrd").c_str(), nval, NULL)) {
+            char *err = biffGetDone(NRRD);
+            fprintf(stderr, "trouble saving G-buffer:\n%s", err);
+            free(err);
+          }
+          nrrdNuke(ndepth);
+          nrrdNuke(nxyz);
+          nrrdNuke(nval);
+        });
+      gbuff.poll(true);
+    }
+    delete hply;
+    Hale::done();
+    airMopOkay(mop);
+    return 0;
+  }
+  /* then create viewer (in order to create the OpenGL context); it is on
+     the heap so that it can be deleted before Hale::done() */
+  Hale::Viewer *vwr = new Hale::Viewer(camsize[0], camsize[1], "Iso", &scene);
+  Hale::Viewer &viewer = *vwr;
   viewer.lightDir(glm::vec3(-1.0f, 1.0f, 3.0f));
   viewer.camera.init(glm::vec3(camfr[0], camfr[1], camfr[2]),
                      glm::vec3(camat[0], camat[1], camat[2]),
@@ -141,47 +314,141 @@ main(int argc, const char **argv) {
                      camnc, camfc, camortho);
   viewer.refreshCB((Hale::ViewerRefresher)render);
   viewer.refreshData(&viewer);
+  viewer.interactAdapt(adapt);
+  viewer.reproject(reproj);
+  Hale::Governor governor;
+  if (govern) {
+    governor.knob("scale", 5, 4, [&viewer](int level) {
+        viewer.renderScale(0.2*(level + 1));
+      });
+    viewer.governor(&governor);
+  }
   sliso = isovalue;
   viewer.slider(&sliso, isomin, isomax);
   viewer.current();
+  Hale::Capture *cap = NULL;
+  if (airStrlen(capture)) {
+    cap = ('|' == capture[0]
+           ? new Hale::Capture(Hale::captureOutputYUV, capture + 1)
+           : new Hale::Capture(Hale::captureOutputFiles, capture));
+    viewer.capture(cap);
+  }
 
 
   /* then create geometry, and add it to scene */
-  Hale::Polydata hply(lpld, true,  // hply now owns lpld
-                      Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid));
-  scene.add(&hply);
-
-
-  scene.drawInit();
-  render(&viewer);
-  if (hitandquit) {
-    seekIsovalueSet(sctx, isovalue);
-    seekUpdate(sctx);
-    seekExtract(sctx, lpld);
-    hply.rebuffer();
-
-    render(&viewer);
-    glfwWaitEvents();
-    render(&viewer);
-    viewer.snap();
-    Hale::done();
-    airMopOkay(mop);
-    return 0;
+  std::function<void()> wake = [&viewer]() {
+    viewer.redraw();
+    glfwPostEmptyEvent();
+  };
+  std::vector<Hale::Polydata*> alsoPly;
+  if (alsoNum || alsoLabel) {
+    std::vector<double> val(also, also + alsoNum);
+    std::vector<limnPolyData*> alsoLpld;
+    try {
+      Hale::Isocontour isoc(nin);
+      if (alsoLabel && !alsoNum) {
+        isoc.labels(val);
+        val.erase(std::remove(val.begin(), val.end(), 0.0), val.end());
+      }
+      for (unsigned int ii=0; ii<val.size(); ii++) {
+        alsoLpld.push_back(limnPolyDataNew());
+      }
+      if (alsoLabel) {
+        isoc.extractLabels(alsoLpld, val);
+      } else {
+        isoc.extract(alsoLpld, val);
+      }
+    } catch (std::exception &ex) {
+      fprintf(stderr, "trouble with -also surfaces:\n%s\n", ex.what());
+      for (limnPolyData *lp : alsoLpld) {
+        limnPolyDataNix(lp);
+      }
+      viewer.capture(NULL);
+      delete cap;
+      delete vwr;
+      airMopError(mop);
+      return 1;
+    }
+    for (unsigned int ii=0; ii<val.size(); ii++) {
+      Hale::Polydata *hply =
+        new Hale::Polydata(alsoLpld[ii], true,  // hply now owns it
+                           Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid),
+                           (alsoLabel ? "label " : "isovalue ")
+                           + std::to_string(val[ii]));
+      /* colors going around the hue circle */
+      float hue = 2*AIR_PI*ii/val.size();
+      hply->colorSolid(0.6f + 0.4f*cos(hue), 0.6f + 0.4f*cos(hue - 2*AIR_PI/3),
+                       0.6f + 0.4f*cos(hue + 2*AIR_PI/3));
+      scene.add(hply);
+      alsoPly.push_back(hply);
+    }
   }
-  while(!Hale::finishing){
-    glfwWaitEvents();
-    if (viewer.sliding() && sliso != isovalue) {
-      isovalue = sliso;
-      printf("%s: isosurfacing at %g\n", me, isovalue);
-      seekIsovalueSet(sctx, isovalue);
-      seekUpdate(sctx);
-      seekExtract(sctx, lpld);
-      hply.rebuffer();
+  Hale::IsoSurface *iso = NULL;
+  Hale::IsoStream *stream = NULL;
+  if (streamLayers) {
+    /* the slabs add themselves to the scene as they're done */
+    limnPolyDataNix(lpld);
+    stream = new Hale::IsoStream(nin, isovalue,
+                                 Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid),
+                                 &scene, streamLayers);
+    stream->wake(wake);
+    if (upload) {
+      stream->uploader(viewer.uploader());
+    }
+  } else {
+    iso = new Hale::IsoSurface(nin, isovalue,  // iso now owns lpld
+                               Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid),
+                               lpld, levelNum);
+    iso->wake(wake);
+    if (upload) {
+      iso->uploader(viewer.uploader());
     }
-    render(&viewer);
+    iso->incremental(incr);
+    iso->surfaceNets(nets);
+    iso->cullVertMin(cullVerts);
+    iso->cullAreaMin(cullArea);
+    iso->cullKeepNum(cullKeep);
+    if (cacheMB > 0) {
+      iso->cacheBudget(static_cast<size_t>(cacheMB*1024*1024));
+      iso->cacheQuantum(cacheQuant > 0 ? cacheQuant : (isomax - isomin)/256);
+      iso->prefetch(prefetch);
+    }
+    scene.add(iso->polydata());
   }
 
+
+  scene.drawInit();
+  isoState iss = {me, &viewer, iso, stream, &isovalue, &sliso};
+  viewer.updateCB((Hale::ViewerRefresher)update);
+  viewer.updateData(&iss);
+  viewer.run(thread);
+
   /* clean exit; all okay */
+  if (iso) {
+    Hale::PolyPool *polys = iso->polyPool();
+    printf("%s: isosurface meshes: %.1f MB at peak, %u allocations\n", me,
+           polys->bytesPeak()/(1024.0*1024.0), polys->allocNum());
+  }
+  if (iso && cacheMB > 0) {
+    unsigned int hits = iso->cacheHitNum(), misses = iso->cacheMissNum();
+    printf("%s: isosurface cache: %u hits, %u misses (%.1f%% hit rate); "
+           "%u meshes in %.1f MB\n", me, hits, misses,
+           100.0*hits/AIR_MAX(1, hits + misses), iso->cacheMeshNum(),
+           iso->cacheBytes()/(1024.0*1024.0));
+  }
+  /* the Polydatas and programs are freed with the context current */
+  viewer.current();
+  delete iso;
+  delete stream;
+  for (Hale::Polydata *hply : alsoPly) {
+    delete hply;
+  }
+  if (cap) {
+    viewer.capture(NULL);
+    delete cap;
+  }
+  Hale::programsDone();
+  delete vwr;
   Hale::done();
   //nanogui::shutdown();
   airMopOkay(mop);
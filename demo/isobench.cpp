@@ -0,0 +1,363 @@
+#include <iostream>
+#include <algorithm>
+#include <Hale.h>
+
+/* compares Hale::Isocontour against Teem's seekExtract: same vertices
+   (up to float precision), same area, and how much faster; and likewise
+   Isocontour::extractNets(), by triangle count, slivers, and (with -draw)
+   drawing time */
+
+/* a smooth but bumpy volume, for trying sizes bigger than what's handy */
+static int
+synthesize(Nrrd *nout, unsigned int size) {
+  if (nrrdAlloc_va(nout, nrrdTypeFloat, 3, static_cast<size_t>(size),
+                   static_cast<size_t>(size), static_cast<size_t>(size))) {
+    return 1;
+  }
+  float *data = static_cast<float*>(nout->data);
+  for (unsigned int zi=0; zi<size; zi++) {
+    double zz = AIR_AFFINE(0, zi, size-1, -1, 1);
+    for (unsigned int yi=0; yi<size; yi++) {
+      double yy = AIR_AFFINE(0, yi, size-1, -1, 1);
+      for (unsigned int xi=0; xi<size; xi++) {
+        double xx = AIR_AFFINE(0, xi, size-1, -1, 1);
+        double rr = sqrt(xx*xx + yy*yy + zz*zz);
+        *data++ = static_cast<float>(1 - rr + 0.1*sin(9*xx)*cos(7*yy)
+                                     + 0.07*sin(11*zz + 5*xx));
+      }
+    }
+  }
+  return 0;
+}
+
+static double
+area(const limnPolyData *lpld) {
+  double sum = 0;
+  for (unsigned int ti=0; ti<lpld->indxNum/3; ti++) {
+    const float *p0 = lpld->xyzw + 4*lpld->indx[3*ti + 0];
+    const float *p1 = lpld->xyzw + 4*lpld->indx[3*ti + 1];
+    const float *p2 = lpld->xyzw + 4*lpld->indx[3*ti + 2];
+    glm::vec3 e1(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+    glm::vec3 e2(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+    sum += glm::length(glm::cross(e1, e2))/2;
+  }
+  return sum;
+}
+
+/* number of slivers: triangles with quality (4*sqrt(3)*area over the sum
+   of squared edge lengths, 1 for equilateral) under 0.1 */
+static unsigned int
+sliverNum(const limnPolyData *lpld) {
+  unsigned int num = 0;
+  for (unsigned int ti=0; ti<lpld->indxNum/3; ti++) {
+    glm::vec3 pp[3];
+    for (unsigned int vi=0; vi<3; vi++) {
+      const float *xyzw = lpld->xyzw + 4*lpld->indx[3*ti + vi];
+      pp[vi] = glm::vec3(xyzw[0], xyzw[1], xyzw[2]);
+    }
+    double len2 = 0;
+    for (unsigned int vi=0; vi<3; vi++) {
+      glm::vec3 edge = pp[(vi + 1) % 3] - pp[vi];
+      len2 += glm::dot(edge, edge);
+    }
+    double area = glm::length(glm::cross(pp[1] - pp[0], pp[2] - pp[0]))/2;
+    num += (len2 > 0 && 4*sqrt(3.0)*area/len2 < 0.1);
+  }
+  return num;
+}
+
+/* for the mop */
+static void *
+isocontourDelete(void *ptr) {
+  delete static_cast<Hale::Isocontour *>(ptr);
+  return NULL;
+}
+static void *
+offscreenDone(void *ptr) {
+  Hale::Offscreen *offscr = static_cast<Hale::Offscreen *>(ptr);
+  /* the programs are freed with the context current */
+  offscr->current();
+  Hale::programsDone();
+  delete offscr;
+  Hale::done();
+  return NULL;
+}
+
+/* average time to draw lpld off-screen (until the GPU is done) */
+static double
+drawTime(Hale::Offscreen *offscr, const limnPolyData *lpld,
+         unsigned int num) {
+  Hale::Scene scene;
+  Hale::Polydata hply(lpld, Hale::ProgramLib(Hale::preprogramAmbDiff2SideSolid));
+  scene.add(&hply);
+  scene.drawInit();
+  offscr->scene(&scene);
+  glm::vec3 bmin, bmax;
+  scene.bounds(bmin, bmax);
+  glm::vec3 center = (bmin + bmax)/2.0f;
+  float diag = glm::length(bmax - bmin);
+  offscr->camera.init(center + glm::vec3(diag, 1.2f*diag, 1.5f*diag), center,
+                      glm::vec3(0.0f, 0.0f, 1.0f), 30,
+                      static_cast<double>(offscr->width())/offscr->height(),
+                      -diag, diag, false);
+  /* (the first draw includes getting the buffers to the GPU) */
+  offscr->draw();
+  glFinish();
+  double time0 = airTime();
+  for (unsigned int ii=0; ii<num; ii++) {
+    offscr->draw();
+  }
+  glFinish();
+  double time = (airTime() - time0)/num;
+  offscr->scene(NULL);
+  return time;
+}
+
+/* largest distance between corresponding vertices, after sorting both,
+   or -1 if they have different numbers of vertices */
+static double
+vertDist(const limnPolyData *aa, const limnPolyData *bb) {
+  if (aa->xyzwNum != bb->xyzwNum) {
+    return -1;
+  }
+  std::vector<glm::vec3> av(aa->xyzwNum), bv(bb->xyzwNum);
+  for (unsigned int vi=0; vi<aa->xyzwNum; vi++) {
+    av[vi] = glm::vec3(aa->xyzw[4*vi], aa->xyzw[4*vi+1], aa->xyzw[4*vi+2]);
+    bv[vi] = glm::vec3(bb->xyzw[4*vi], bb->xyzw[4*vi+1], bb->xyzw[4*vi+2]);
+  }
+  auto less = [](const glm::vec3 &pp, const glm::vec3 &qq) {
+    /* rounded, so that float noise doesn't change the order */
+    for (unsigned int ai=0; ai<3; ai++) {
+      float pr = floor(pp[ai]*1000 + 0.5), qr = floor(qq[ai]*1000 + 0.5);
+      if (pr != qr) {
+        return pr < qr;
+      }
+    }
+    return false;
+  };
+  std::sort(av.begin(), av.end(), less);
+  std::sort(bv.begin(), bv.end(), less);
+  double dist = 0;
+  for (unsigned int vi=0; vi<av.size(); vi++) {
+    dist = AIR_MAX(dist, glm::length(av[vi] - bv[vi]));
+  }
+  return dist;
+}
+
+int
+main(int argc, const char **argv) {
+  const char *me;
+  char *err;
+  hestOpt *hopt=NULL;
+  hestParm *hparm;
+  airArray *mop;
+
+  Nrrd *nin;
+  double *isoval;
+  unsigned int isoNum, *thread, threadNum, brick, reps, synsize, drawNum;
+
+  me = argv[0];
+  mop = airMopNew();
+  hparm = hestParmNew();
+  airMopAdd(mop, hparm, (airMopper)hestParmFree, airMopAlways);
+  hestOptAdd(&hopt, "i", "volume", airTypeOther, 1, 1, &nin, "",
+             "input volume to isosurface (or use -syn)", NULL, NULL,
+             nrrdHestNrrd);
+  hestOptAdd(&hopt, "syn", "size", airTypeUInt, 1, 1, &synsize, "0",
+             "if non-zero, instead of -i, use a synthetic float volume of "
+             "this size along each axis");
+  hestOptAdd(&hopt, "v", "iso0 iso1", airTypeDouble, 1, -1, &isoval, "nan",
+             "isovalues to try; \"nan\" for 1/4, 1/2, and 3/4 of the way "
+             "through the value range", &isoNum);
+  hestOptAdd(&hopt, "t", "thr0 thr1", airTypeUInt, 1, -1, &thread, "1 0",
+             "numbers of threads to try (0 for one per core, less one)",
+             &threadNum);
+  hestOptAdd(&hopt, "b", "size", airTypeUInt, 1, 1, &brick, "16",
+             "brick size");
+  hestOptAdd(&hopt, "r", "reps", airTypeUInt, 1, 1, &reps, "3",
+             "repetitions of each extraction (best time is reported)");
+  hestOptAdd(&hopt, "draw", "frames", airTypeUInt, 1, 1, &drawNum, "0",
+             "if non-zero, also time drawing each kind of isosurface "
+             "(off-screen, at 1024x768) this many times");
+  hestParseOrDie(hopt, argc-1, argv+1, hparm,
+                 me, "isosurfacing benchmark", AIR_TRUE, AIR_TRUE, AIR_TRUE);
+  airMopAdd(mop, hopt, (airMopper)hestOptFree, airMopAlways);
+  airMopAdd(mop, hopt, (airMopper)hestParseFree, airMopAlways);
+
+  if (synsize) {
+    nin = nrrdNew();
+    airMopAdd(mop, nin, (airMopper)nrrdNuke, airMopAlways);
+    if (synthesize(nin, synsize)) {
+      airMopAdd(mop, err=biffGetDone(NRRD), airFree, airMopAlways);
+      fprintf(stderr, "%s: trouble making volume:\n%s", me, err);
+      airMopError(mop);
+      return 1;
+    }
+  } else if (!nin) {
+    fprintf(stderr, "%s: need -i or -syn\n", me);
+    airMopError(mop);
+    return 1;
+  }
+  std::vector<double> isos(isoval, isoval + isoNum);
+  if (1 == isoNum && !AIR_EXISTS(isoval[0])) {
+    NrrdRange *range = nrrdRangeNewSet(nin, AIR_FALSE);
+    airMopAdd(mop, range, (airMopper)nrrdRangeNix, airMopAlways);
+    isos.clear();
+    for (unsigned int qi=1; qi<=3; qi++) {
+      isos.push_back(AIR_AFFINE(0, qi, 4, range->min, range->max));
+    }
+  }
+  printf("%s: %u x %u x %u %s volume\n", me,
+         static_cast<unsigned int>(nin->axis[0].size),
+         static_cast<unsigned int>(nin->axis[1].size),
+         static_cast<unsigned int>(nin->axis[2].size),
+         airEnumStr(nrrdType, nin->type));
+
+  seekContext *sctx = seekContextNew();
+  airMopAdd(mop, sctx, (airMopper)seekContextNix, airMopAlways);
+  seekVerboseSet(sctx, 0);
+  seekNormalsFindSet(sctx, AIR_TRUE);
+  limnPolyData *lseek = limnPolyDataNew();
+  airMopAdd(mop, lseek, (airMopper)limnPolyDataNix, airMopAlways);
+  limnPolyData *lhale = limnPolyDataNew();
+  airMopAdd(mop, lhale, (airMopper)limnPolyDataNix, airMopAlways);
+  limnPolyData *lnets = limnPolyDataNew();
+  airMopAdd(mop, lnets, (airMopper)limnPolyDataNix, airMopAlways);
+  Hale::Offscreen *offscr = NULL;
+  if (drawNum) {
+    Hale::init(false);
+    offscr = new Hale::Offscreen(1024, 768, NULL);
+    airMopAdd(mop, offscr, offscreenDone, airMopAlways);
+  }
+  if (seekDataSet(sctx, nin, NULL, 0)
+      || seekTypeSet(sctx, seekTypeIsocontour)) {
+    airMopAdd(mop, err=biffGetDone(SEEK), airFree, airMopAlways);
+    fprintf(stderr, "%s: trouble setting up seek:\n%s", me, err);
+    airMopError(mop);
+    return 1;
+  }
+  std::vector<Hale::Isocontour*> isoc;
+  try {
+    for (unsigned int ti=0; ti<threadNum; ti++) {
+      double time0 = airTime();
+      isoc.push_back(new Hale::Isocontour(nin, brick, thread[ti]));
+      airMopAdd(mop, isoc.back(), isocontourDelete, airMopAlways);
+      printf("%s: Isocontour with %u threads: setup %.1f ms\n", me,
+             isoc.back()->threadNum(), 1000*(airTime() - time0));
+    }
+  } catch (std::exception &ex) {
+    fprintf(stderr, "%s: %s\n", me, ex.what());
+    airMopError(mop);
+    return 1;
+  }
+
+  try {
+    for (double iso : isos) {
+      double best = AIR_POS_INF;
+      for (unsigned int ri=0; ri<reps; ri++) {
+        double time0 = airTime();
+        if (seekIsovalueSet(sctx, iso)
+            || seekUpdate(sctx)
+            || seekExtract(sctx, lseek)) {
+          airMopAdd(mop, err=biffGetDone(SEEK), airFree, airMopAlways);
+          fprintf(stderr, "%s: trouble with seek at %g:\n%s", me, iso, err);
+          airMopError(mop);
+          return 1;
+        }
+        best = AIR_MIN(best, airTime() - time0);
+      }
+      double seekTime = best, seekArea = area(lseek);
+      printf("isovalue %g:\n  seek: %.2f ms; %u verts, %u tris (%u slivers), "
+             "area %g\n", iso, 1000*seekTime, lseek->xyzwNum,
+             lseek->indxNum/3, sliverNum(lseek), seekArea);
+      for (Hale::Isocontour *ic : isoc) {
+        best = AIR_POS_INF;
+        for (unsigned int ri=0; ri<reps; ri++) {
+          double time0 = airTime();
+          ic->extract(lhale, iso);
+          best = AIR_MIN(best, airTime() - time0);
+        }
+        double dist = vertDist(lseek, lhale);
+        printf("  %u threads: %.2f ms (%.1fx); %u verts, %u tris, "
+               "area %g (%+.3f%%); %s %g\n", ic->threadNum(), 1000*best,
+               seekTime/best, lhale->xyzwNum, lhale->indxNum/3, area(lhale),
+               100*(area(lhale) - seekArea)/AIR_MAX(seekArea, 1e-30),
+               dist < 0 ? "DIFFERENT vertex count" : "max vertex distance",
+               dist);
+        best = AIR_POS_INF;
+        for (unsigned int ri=0; ri<reps; ri++) {
+          double time0 = airTime();
+          ic->extractNets(lnets, iso);
+          best = AIR_MIN(best, airTime() - time0);
+        }
+        printf("  %u threads, Surface Nets: %.2f ms (%.1fx); %u verts, "
+               "%u tris (%u slivers), area %g (%+.3f%%)\n", ic->threadNum(),
+               1000*best, seekTime/best, lnets->xyzwNum, lnets->indxNum/3,
+               sliverNum(lnets), area(lnets),
+               100*(area(lnets) - seekArea)/AIR_MAX(seekArea, 1e-30));
+        /* connected components of the marching cubes isosurface */
+        Hale::Components comps(ic->threadNum());
+        best = AIR_POS_INF;
+        for (unsigned int ri=0; ri<reps; ri++) {
+          double time0 = airTime();
+          comps.find(lhale);
+          best = AIR_MIN(best, airTime() - time0);
+        }
+        unsigned int speckNum = 0;
+        for (unsigned int ci=0; ci<comps.num(); ci++) {
+          speckNum += comps.vertNum(ci) < 20;
+        }
+        printf("  %u threads, components: %.2f ms; %u components (biggest "
+               "%u verts), %u with < 20 verts\n", ic->threadNum(), 1000*best,
+               comps.num(), comps.num() ? comps.vertNum(0) : 0, speckNum);
+      }
+      if (offscr) {
+        double seekDraw = drawTime(offscr, lseek, drawNum);
+        double haleDraw = drawTime(offscr, lhale, drawNum);
+        double netsDraw = drawTime(offscr, lnets, drawNum);
+        printf("  drawing: seek %.3f ms, Isocontour %.3f ms, "
+               "Surface Nets %.3f ms\n", 1000*seekDraw, 1000*haleDraw,
+               1000*netsDraw);
+      }
+    }
+    if (isos.size() > 1) {
+      /* all the isovalues together, in one pass over the volume */
+      std::vector<limnPolyData*> lmulti(isos.size());
+      for (unsigned int ii=0; ii<isos.size(); ii++) {
+        lmulti[ii] = limnPolyDataNew();
+        airMopAdd(mop, lmulti[ii], (airMopper)limnPolyDataNix, airMopAlways);
+      }
+      printf("all %u isovalues:\n", static_cast<unsigned int>(isos.size()));
+      for (Hale::Isocontour *ic : isoc) {
+        double sepBest = AIR_POS_INF, best = AIR_POS_INF;
+        for (unsigned int ri=0; ri<reps; ri++) {
+          double time0 = airTime();
+          for (double iso : isos) {
+            ic->extract(lhale, iso);
+          }
+          sepBest = AIR_MIN(sepBest, airTime() - time0);
+          time0 = airTime();
+          ic->extract(lmulti, isos);
+          best = AIR_MIN(best, airTime() - time0);
+        }
+        double dist = 0;
+        for (unsigned int ii=0; ii<isos.size(); ii++) {
+          ic->extract(lhale, isos[ii]);
+          double dd = vertDist(lhale, lmulti[ii]);
+          dist = (dd < 0 || dist < 0) ? -1 : AIR_MAX(dist, dd);
+        }
+        printf("  %u threads: %.2f ms in one pass, %.2f ms separately "
+               "(%.2fx); %s %g\n", ic->threadNum(), 1000*best, 1000*sepBest,
+               sepBest/best,
+               dist < 0 ? "DIFFERENT vertex count" : "max vertex distance",
+               dist);
+      }
+    }
+  } catch (std::exception &ex) {
+    fprintf(stderr, "%s: %s\n", me, ex.what());
+    airMopError(mop);
+    return 1;
+  }
+  airMopOkay(mop);
+  return 0;
+}
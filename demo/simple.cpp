@@ -99,11 +99,7 @@ main(int argc, const char **argv) {
   scene.add(&hpld);
 
   scene.drawInit();
-  render(&viewer);
-  while(!Hale::finishing){
-    glfwWaitEvents();
-    render(&viewer);
-  }
+  viewer.run();
 
   /* clean exit; all okay */
   Hale::done();
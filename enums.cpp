@@ -86,15 +86,90 @@ finishingStatus = &_finishingStatus;
 
 /* ------------------------------------------------------------- */
 
-#define VERT_ATTR_INDX_NUM 5
+#define IMAGE_FORMAT_NUM 3
+
+const char *
+_imageFormatStr[IMAGE_FORMAT_NUM+1] = {
+  "unknown image format", /* (0) */
+  "nrrd",                 /* 1 */
+  "ppm",                  /* 2 */
+  "png"                   /* 3 */
+};
+
+airEnum
+_imageFormat = {
+  "image format",
+  IMAGE_FORMAT_NUM,
+  _imageFormatStr, NULL,
+  NULL,
+  NULL, NULL,
+  AIR_FALSE
+};
+
+airEnum *
+imageFormat = &_imageFormat;
+
+/* ------------------------------------------------------------- */
+
+#define CAPTURE_OUTPUT_NUM 3
+
+const char *
+_captureOutputStr[CAPTURE_OUTPUT_NUM+1] = {
+  "unknown capture output", /* (0) */
+  "files",                  /* 1 */
+  "rgb",                    /* 2 */
+  "yuv"                     /* 3 */
+};
+
+airEnum
+_captureOutput = {
+  "capture output",
+  CAPTURE_OUTPUT_NUM,
+  _captureOutputStr, NULL,
+  NULL,
+  NULL, NULL,
+  AIR_FALSE
+};
+
+airEnum *
+captureOutput = &_captureOutput;
+
+/* ------------------------------------------------------------- */
+
+#define CAPTURE_POLICY_NUM 2
+
+const char *
+_capturePolicyStr[CAPTURE_POLICY_NUM+1] = {
+  "unknown capture policy", /* (0) */
+  "block",                  /* 1 */
+  "drop"                    /* 2 */
+};
+
+airEnum
+_capturePolicy = {
+  "capture policy",
+  CAPTURE_POLICY_NUM,
+  _capturePolicyStr, NULL,
+  NULL,
+  NULL, NULL,
+  AIR_FALSE
+};
+
+airEnum *
+capturePolicy = &_capturePolicy;
+
+/* ------------------------------------------------------------- */
+
+#define VERT_ATTR_INDX_NUM 6
 const char *
 _vertAttrIndxStr[VERT_ATTR_INDX_NUM+1] = {
   "unknown vert attr index", /* (-1) */
   "xyzw",                    /*  0 */
-  "rgba"                     /*  1 */
+  "rgba",                    /*  1 */
   "norm",                    /*  2 */
   "tex2",                    /*  3 */
-  "tang"                     /*  4 */
+  "tang",                    /*  4 */
+  "value"                    /*  5 */
 };
 
 airEnum
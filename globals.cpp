@@ -25,8 +25,10 @@
 
 namespace Hale {
 
-bool finishing = false;
+std::atomic<bool> finishing(false);
 int debugging = 0;
+std::atomic<unsigned int> _changeCount(0);
+std::atomic<unsigned int> _sceneChangeCount(0);
 
 const Program *_programCurrent = NULL;
 
@@ -36,6 +38,8 @@ const Program *_program[preprogramLast] = {
   NULL, /* preprogramAmbDiffSolid,       2 */
   NULL, /* preprogramAmbDiff2Side,       3 */
   NULL, /* preprogramAmbDiff2SideSolid,  4 */
+  NULL, /* preprogramGBuffer,            5 */
+  NULL, /* preprogramReproject,          6 */
 };
 
 } // namespace Hale
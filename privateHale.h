@@ -24,6 +24,7 @@
 #include <glm/gtc/matrix_transform.hpp> // for glm::lookAt(), glm::perspective()
 #include <glm/gtx/string_cast.hpp> // for glm::to_string()
 #include <glm/gtc/type_ptr.hpp> // for glm::value_ptr()
+#include <atomic>
 
 namespace Hale {
 
@@ -41,8 +42,50 @@ const double fovBest = 20;
 
 /* globals.cpp */
 extern const Program *_programCurrent;
+/* incremented by changed(), and by Camera changes */
+extern std::atomic<unsigned int> _changeCount;
+/* incremented by changed() only: counts changes to the scene and sticky
+   uniforms, not to the Camera, which reach the render thread of
+   Viewer::run(true) in a snapshot, and which Reproject can follow */
+extern std::atomic<unsigned int> _sceneChangeCount;
+
+/* Viewer.cpp: things shared by Viewer and Offscreen. _drawScene sets
+   the (sticky) view, projection, and world-space light direction
+   uniforms from the camera, projection, and view-space light direction,
+   and then draws the scene (clearing first, unless !clear) */
+extern void _drawScene(Scene *scene, Camera &camera, glm::mat4 project,
+                       glm::vec3 lightDir, bool clear=true);
+extern std::string _snapFname(int format);
 
 /* compiled as needed */
 extern const Program *_program[preprogramLast];
 
+/* BrickIndex.cpp, Isocontour.cpp: volumes are read in place, as whatever
+   type of Nrrd they are, if _typeInPlace(type). HALE_TYPE_SWITCH(type, T,
+   ...) does "..." with T typedef'd to the C type of the Nrrd type; the
+   "..." is a call of a kernel templated on T, so that the type is switched
+   on once per brick, row, or vertex, and not per sample */
+inline bool
+_typeInPlace(int type) {
+  switch (type) {
+  case nrrdTypeChar: case nrrdTypeUChar:
+  case nrrdTypeShort: case nrrdTypeUShort:
+  case nrrdTypeInt: case nrrdTypeUInt:
+  case nrrdTypeFloat: case nrrdTypeDouble:
+    return true;
+  }
+  return false;
+}
+#define HALE_TYPE_SWITCH(type, T, ...) \
+  switch (type) { \
+  case nrrdTypeChar: { typedef signed char T; __VA_ARGS__; } break; \
+  case nrrdTypeUChar: { typedef unsigned char T; __VA_ARGS__; } break; \
+  case nrrdTypeShort: { typedef short T; __VA_ARGS__; } break; \
+  case nrrdTypeUShort: { typedef unsigned short T; __VA_ARGS__; } break; \
+  case nrrdTypeInt: { typedef int T; __VA_ARGS__; } break; \
+  case nrrdTypeUInt: { typedef unsigned int T; __VA_ARGS__; } break; \
+  case nrrdTypeDouble: { typedef double T; __VA_ARGS__; } break; \
+  default: { typedef float T; __VA_ARGS__; } break; \
+  }
+
 }
@@ -196,8 +196,11 @@ glEnumDescInit() {
   return;
 }
 
+/* whether init() called glfwInit, so done() knows to glfwTerminate */
+static bool glfwInited = false;
+
 void
-init() {
+init(bool windowing) {
   static const std::string me="Hale::init";
   int iret;
 
@@ -212,6 +215,20 @@ init() {
   /* populate glEnumDesc (HEY figure out compile-time initialization) */
   glEnumDescInit();
 
+  /* tracing requested via environment */
+  const char *tfname = getenv("HALE_TRACE");
+  if (tfname && strlen(tfname)) {
+    traceFile(tfname);
+    traceThreadName("main");
+    traceEnable(true);
+  }
+
+#if !defined(__APPLE_CC__)
+  if (!windowing) {
+    /* Offscreen will get its context from EGL instead */
+    return;
+  }
+#endif
   /* install GLFW error hander, then try glfwInit */
   glfwSetErrorCallback(errorGLFW);
   iret = glfwInit();
@@ -227,27 +244,44 @@ init() {
     throw std::runtime_error(me + ": glfwInit failed");
   }
   printf("%s: GLFW version \"%s\" initialized\n", me.c_str(), glfwGetVersionString());
+  glfwInited = true;
 
   return;
 }
 
 void
-done() {
-
+programsDone() {
   for (int pi=preprogramUnknown+1;
        pi<preprogramLast;
        pi++) {
     if (_program[pi]) {
       delete _program[pi];
+      _program[pi] = NULL;
     }
   }
+}
+
+void
+done() {
+
+  if (!traceFile().empty()) {
+    try {
+      traceSave(traceFile().c_str());
+    } catch (std::exception &ee) {
+      fprintf(stderr, "%s\n", ee.what());
+    }
+  }
+  programsDone();
 
   /* HEY: without this, the errorGLFW is called at exit with
      GLFW_NOT_INITIALIZED/"The GLFW library is not initialized",
      perhaps by the atexit() stack, but isn't that turned off with
      GLFW version 3.0? http://www.glfw.org/changelog.html */
-  glfwSetErrorCallback(NULL);
-  glfwTerminate();
+  if (glfwInited) {
+    glfwSetErrorCallback(NULL);
+    glfwTerminate();
+    glfwInited = false;
+  }
   return;
 }
 
@@ -282,6 +316,9 @@ limnToGLPrim(int type) {
   return ret;
 }
 
+void changed(void) { _changeCount++; _sceneChangeCount++; }
+unsigned int changeCount(void) { return _changeCount; }
+
 /*
 ** Hey: check out https://www.opengl.org/wiki/Debug_Output
 ** (core in version 4.3)